@@ -6,6 +6,97 @@
 #include <asf.h>
 #include "HAL.h"
 
+/************************************************************************/
+/* @brief ADT7420_set_mode switches between active and inactive mode. Only a
+/* change of mode disturbs the accelerometer and starts a new data set
+/* @param mode ACTIVE_MODE or INACTIVE_MODE
+/* @returns none
+/************************************************************************/
+
+static void ADT7420_set_mode(uint8_t mode)
+{
+	if(mode == ucActiveInactive_Mode) return;
+	
+	// Either way we assume we are in stationary mode after the switch
+	ucActiveInactive_Mode = mode;
+	ucMotion_State = STATIONARY_MODE;
+	
+	if(mode == INACTIVE_MODE){
+		// Disable the accelerometer activity interrupt
+		ADXL375_disable_interrupt(ADXL375_INT_SRC_ACTIVITY);
+	}else{
+		// Re-enable the activity interrupt -- we need to do this because we are exiting inactive mode where the activity interrupt is disabled
+		ADXL375_enable_interrupt(ADXL375_INT_SRC_ACTIVITY);
+	}
+	
+	// We have switched modes, so the temperature data now needs to be marked as a new dataset
+	mark_data_set(&temperature_ring, &temperature_sets);
+}
+
+#if TEMPERATURE_THRESHOLD_INTERRUPT
+/************************************************************************/
+/* @brief ADT7420_configure_threshold programs the sensor to raise INT while the
+/* core temperature is above the activity threshold, and routes INT to the EIC
+/* @param none
+/* @returns none
+/************************************************************************/
+
+static void ADT7420_configure_threshold(void)
+{
+	int16_t iSetpoint;
+	uint8_t ucSetpoint[2];
+	uint8_t ucHysteresis = 0;
+	struct system_pinmux_config config_pinmux;
+	
+	// T_HIGH is the activity threshold. INT drops again once the temperature falls below T_HIGH - T_HYST,
+	// so the hysteresis puts the release point on the inactivity threshold
+	iSetpoint = ucActivityTemperatureThreshold * ADT7420_LSB_PER_C;
+	ucSetpoint[0] = iSetpoint >> 8;
+	ucSetpoint[1] = iSetpoint & 0xFF;
+	status = I2C_write_regs(TEMP_SENSOR_ADDRESS, TEMP_SENSOR_T_HIGH_ADDR, ucSetpoint, 2);
+	
+	iSetpoint = ADT7420_T_LOW_PARKED;
+	ucSetpoint[0] = iSetpoint >> 8;
+	ucSetpoint[1] = iSetpoint & 0xFF;
+	status = I2C_write_regs(TEMP_SENSOR_ADDRESS, TEMP_SENSOR_T_LOW_ADDR, ucSetpoint, 2);
+	
+	if(ucActivityTemperatureThreshold > ucInactivityTemperatureThreshold){
+		ucHysteresis = ucActivityTemperatureThreshold - ucInactivityTemperatureThreshold;
+		if(ucHysteresis > ADT7420_T_HYST_MAX) ucHysteresis = ADT7420_T_HYST_MAX;
+	}
+	status = I2C_write_reg(TEMP_SENSOR_ADDRESS, TEMP_SENSOR_T_HYST_ADDR, ucHysteresis);
+	
+	// One conversion a second, comparator mode with INT active high. Two faults in a row before INT moves so one noisy conversion does not flip the mode
+	status = I2C_write_reg(TEMP_SENSOR_ADDRESS, TEMP_SENSOR_CONFIG_ADDR, TEMP_SENSOR_CONFIG_OP_MODE_SPS | TEMP_SENSOR_CONFIG_COMP_MODE | TEMP_SENSOR_CONFIG_INT_POL_HIGH | TEMP_SENSOR_CONFIG_FLT_QUE_2);
+	
+	// Route INT to the external interrupt controller
+	system_pinmux_get_config_defaults(&config_pinmux);
+	config_pinmux.mux_position = ADT7420_INT_PINMUX & 0xFFFF;
+	config_pinmux.direction = SYSTEM_PINMUX_PIN_DIR_INPUT;
+	// INT is open-drain and only ever pulls low
+	config_pinmux.input_pull = SYSTEM_PINMUX_PIN_PULL_UP;
+	system_pinmux_pin_set_config(ADT7420_INT_PINMUX >> 16, &config_pinmux);
+	
+	// Disable the EIC while it is reconfigured
+	REG_EIC_CTRLA = 0x00;
+	while(EIC->SYNCBUSY.reg);
+	
+	// Both edges, no filter. Both edges are needed because the level of INT is the mode
+	REG_EIC_INTENSET |= 1 << ADT7420_INT_EXTINT;
+	REG_EIC_CONFIG0 &= ~(0xF << (4 * ADT7420_INT_EXTINT));
+	REG_EIC_CONFIG0 |= EIC_CONFIG_SENSE0_BOTH_Val << (4 * ADT7420_INT_EXTINT);
+	REG_EIC_ASYNCH |= 1 << ADT7420_INT_EXTINT;
+	extint_register_callback(ADT7420_ISR_Handler, ADT7420_INT_EXTINT, EXTINT_CALLBACK_TYPE_DETECT);
+	
+	// Enable the EIC
+	REG_EIC_CTRLA = 0x02;
+	while(EIC->SYNCBUSY.reg);
+	
+	// There is no edge for the level INT already has, so pick it up once
+	work_post(ADT7420_threshold_service);
+}
+#endif
+
 /************************************************************************/
 /* @brief configure_ADT7420 Configures the ADT7420 Temperature sensor module, and the
 /* Micrel switch that controls its power domain.
@@ -15,17 +106,6 @@
 
 void configure_ADT7420(void)
 {
-	// Create an i2c pacekt struct and populate it with the address of the configuration register and the shutdown operating mode value
-	struct i2c_master_packet i2c_packet;
-	uint16_t timeout = 0;
-	uint8_t wr_buffer[2] = {TEMP_SENSOR_CONFIG_ADDR,TEMP_SENSOR_CONFIG_OP_MODE_SHDN};
-	
-	i2c_packet.address = TEMP_SENSOR_ADDRESS;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	i2c_packet.data_length = 2;
-	i2c_packet.data = wr_buffer;
-	
 	// Configure the Micrel switch enable pin
 	struct system_pinmux_config config_pinmux;
 	system_pinmux_get_config_defaults(&config_pinmux);
@@ -37,14 +117,17 @@ void configure_ADT7420(void)
 	system_pinmux_pin_set_config(ADT7420_EN_PIN, &config_pinmux);
 	port_pin_set_output_level(ADT7420_EN_PIN, true);
 	
-	// Write the packet to the sensor. If we timeout we break with no notification to the calling function
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
- 		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
+#if TEMPERATURE_THRESHOLD_INTERRUPT
+	// The sensor stays powered and watches the threshold itself, the thresholds must be set before this is called
+	wait_ms(ADT7420_POWERUP_MS);
+	ADT7420_configure_threshold();
+#else
+	// Write the shutdown operating mode to the configuration register. If this fails there is no notification to the calling function
+	status = I2C_write_reg(TEMP_SENSOR_ADDRESS, TEMP_SENSOR_CONFIG_ADDR, TEMP_SENSOR_CONFIG_OP_MODE_SHDN);
 	
-	// Shut it back down, and initialize the global temperature array index
+	// Shut it back down, the temperature ring is set up by configure_databuffers
 	port_pin_set_output_level(ADT7420_EN_PIN, false);
-	ucTemperatureArrayPtr = 0;
+#endif
 }
 
 /************************************************************************/
@@ -56,116 +139,75 @@ void configure_ADT7420(void)
 
 void ADT7420_read_temp(void)
 {
-	// Create an I2C master packet and populate it with the configuration register address and the oneshot mode value
-	// This wakes the sensor up, does a conversion, and then the sensor automatically goes back into low-power mode until its turned off
-	
-	// The timer used throughout the reads/writes ensure that we don't get stuck in an infinite loop if the sensor is unresponsive.
+	// Each transaction ends with an error instead of hanging if the sensor is unresponsive.
+	uint32_t start = cycle_count();
 	uint16_t uiTemperature=0;
-	struct i2c_master_packet i2c_packet;
-	uint16_t uiTimer = 0;
-	uint8_t ucDataBuffer[1] = {0};
-	uint8_t wr_buffer[2] = {0,0};
-	
-	i2c_packet.address = TEMP_SENSOR_ADDRESS;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	i2c_packet.hs_master_code = 0;
-	i2c_packet.data_length = 2;
-	i2c_packet.data = wr_buffer;
-	wr_buffer[0] = TEMP_SENSOR_CONFIG_ADDR;
-	wr_buffer[1] = TEMP_SENSOR_CONFIG_OP_MODE_OS;
+	uint8_t ucDataBuffer[2] = {0};
+	
+#if !TEMPERATURE_THRESHOLD_INTERRUPT
+	// Write the configuration register with the oneshot mode value
+	// This wakes the sensor up, does a conversion, and then the sensor automatically goes back into low-power mode until its turned off
 	
 	// Turn on the sensor
 	port_pin_set_output_level(ADT7420_EN_PIN, true);
 	
-	// Delay long enough for the chip to fully power up. This is a busy-wait and is not great for energy.
-	for(int i = 0; i < 10000; i++);
+	// Delay long enough for the chip to fully power up. The core sleeps in standby meanwhile
+	wait_ms(ADT7420_POWERUP_MS);
 	
-	// Write the packet
-	do{
-		status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet);
-		if(uiTimer++ == i2c_master_instance.buffer_timeout) break;
-	}while(status != STATUS_OK);
+	// Write the oneshot mode
+	status = I2C_write_reg(TEMP_SENSOR_ADDRESS, TEMP_SENSOR_CONFIG_ADDR, TEMP_SENSOR_CONFIG_OP_MODE_OS);
 	
 	// Wait for 240 ms for the sampling to complete
-	for(int i = 0; i < 10000; i++);
-	
-	uiTimer = 0;
-	
-	// Set register pointer to upper sensor value byte and write it
-	i2c_packet.data_length = 1;
-	wr_buffer[0] = TEMP_SENSOR_TEMP_REG_MS_ADDR;
-	do{
-		status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet);
-		if(uiTimer++ == i2c_master_instance.buffer_timeout) break;
-	}while(status != STATUS_OK);
-	
-	uiTimer = 0;
-	
-	// Read the response from the sensor and store it in the upper byte of the temperature variable
-	i2c_packet.data_length = 1;
-	i2c_packet.data = ucDataBuffer;
-	do{
-		status = i2c_master_read_packet_wait(&i2c_master_instance, &i2c_packet);
-		if(uiTimer++ == i2c_master_instance.buffer_timeout) break;
-	}while(status != STATUS_OK);
-	uiTemperature = ucDataBuffer[0] << 8;
-	
-	uiTimer = 0;
-	
-	// Set register pointer to lower byte and write it
-	i2c_packet.data = wr_buffer;
-	i2c_packet.data_length = 1;
-	wr_buffer[0] = TEMP_SENSOR_TEMP_REG_LS_ADDR;
-	do{
-		status = i2c_master_write_packet_wait_no_stop(&i2c_master_instance, &i2c_packet);
-		if(uiTimer++ == i2c_master_instance.buffer_timeout) break;
-	}while(status != STATUS_OK);
-	i2c_packet.data_length = 1;
-	i2c_packet.data = ucDataBuffer;
-	
-	uiTimer = 0;
-	
-	// Read the response and store it in the lower byte of the temperature variable
-	do{
-		status = i2c_master_read_packet_wait(&i2c_master_instance, &i2c_packet);
-		if(uiTimer++ == i2c_master_instance.buffer_timeout) break;
-	}while(status != STATUS_OK);
-	uiTemperature = uiTemperature | ucDataBuffer[0];
-	
-	// Put the sensor in shutdown and store the temperature in the array
+	wait_ms(ADT7420_CONVERSION_MS);
+#endif
+	
+	// Read the upper and lower bytes in one transaction, the register pointer auto-increments from the MS to the LS byte.
+	// With the threshold interrupt this is the latest of the sensor's own once a second conversions
+	status = I2C_read_regs(TEMP_SENSOR_ADDRESS, TEMP_SENSOR_TEMP_REG_MS_ADDR, ucDataBuffer, 2);
+	uiTemperature = (ucDataBuffer[0] << 8) | ucDataBuffer[1];
+	
+	// Queue the temperature for offload
+	ring_write(&temperature_ring, &uiTemperature, 1);
+	
+#if !TEMPERATURE_THRESHOLD_INTERRUPT
+	// Put the sensor in shutdown
 	port_pin_set_output_level(ADT7420_EN_PIN, false);
-	uiTemperatureArray[ucTemperatureArrayPtr++] = uiTemperature;
 	
-	// If the core temperature is below the set threshold then we are inactive, and we assume stationary mode
-	//		if the core temperature is above the threshold then we are active, and we assume we are still in stationary mode
+	// If the core temperature is at or below the inactivity threshold then we are inactive,
+	//		if the core temperature is above the activity threshold then we are active,
 	//		otherwise, we do nothing (this case only occurs for thresholds that are not equal)
-	// NOTE--Raw Temp*128 is the conversion for positive numbers, if the animal falls below freezing, things may get weird.
-	if(128*uiTemperature <= ucInactivityTemperatureThreshold){
-		
-		/* Inactive Mode */
-		ucActiveInactive_Mode = INACTIVE_MODE;
-		ucMotion_State = STATIONARY_MODE;
-		
-		// Disable the accelerometer activity interrupt
-		ADXL375_disable_interrupt(ADXL375_INT_SRC_ACTIVITY);
-		
-		// We have switched modes, so the temperature data now needs to be marked as a new dataset
-		ucTemperatureDataSets++;
-		cTemperatureDataSetPtr[ucTemperatureDataSets] = ucTemperatureArrayPtr;
-		get_timestamp(ucTemperatureTimestamps[ucTemperatureDataSets]);
-	}else if(128*uiTemperature > ucActivityTemperatureThreshold){
-		
-		/* Active Mode */
-		ucActiveInactive_Mode = ACTIVE_MODE;
-		ucMotion_State = STATIONARY_MODE;
-		
-		// Re-enable the activity interrupt -- we need to do this because we are exiting inactive mode where the activity interrupt is disabledf
-		ADXL375_enable_interrupt(ADXL375_INT_SRC_ACTIVITY);
-		
-		// We have switched modes, so the temperature data now needs to be marked as a new dataset
-		ucTemperatureDataSets++;
-		cTemperatureDataSetPtr[ucTemperatureDataSets] = ucTemperatureArrayPtr;
-		get_timestamp(ucTemperatureTimestamps[ucTemperatureDataSets]);
+	// The raw reading is signed and in 1/128 C, so the thresholds are scaled up rather than the reading
+	if((int16_t)uiTemperature <= ucInactivityTemperatureThreshold * ADT7420_LSB_PER_C){
+		ADT7420_set_mode(INACTIVE_MODE);
+	}else if((int16_t)uiTemperature > ucActivityTemperatureThreshold * ADT7420_LSB_PER_C){
+		ADT7420_set_mode(ACTIVE_MODE);
 	}
+#endif
+	
+	ADT7420_read_cycles = cycles_since(start);
+	if(ADT7420_read_cycles > ADT7420_read_cycles_max) ADT7420_read_cycles_max = ADT7420_read_cycles;
+}
+
+/************************************************************************/
+/* @brief ADT7420_ISR_Handler runs on either edge of the ADT7420 INT pin and
+/* defers the mode change to the work queue
+/* @param none
+/* @returns none
+/************************************************************************/
+
+void ADT7420_ISR_Handler(void)
+{
+	work_post(ADT7420_threshold_service);
+}
+
+/************************************************************************/
+/* @brief ADT7420_threshold_service follows the level of INT, which is high
+/* while the core temperature is above the activity threshold
+/* @param none
+/* @returns none
+/************************************************************************/
+
+void ADT7420_threshold_service(void)
+{
+	ADT7420_set_mode(port_pin_get_input_level(ADT7420_INT_PIN) ? ACTIVE_MODE : INACTIVE_MODE);
 }
\ No newline at end of file
@@ -6,13 +6,32 @@
 #ifndef ADT7420_H_
 #define ADT7420_H_
 
+#include <asf.h>
+
 #define ADT7420_EN_PIN						PIN_PA15
+#define ADT7420_POWERUP_MS					1
+#define ADT7420_CONVERSION_MS				240
+
+// INT pin, comparator output for the T_HIGH threshold. Needs the board to route INT to PA19.
+// INT is open-drain, the PA19 internal pull-up holds it high when the ADT7420 releases it
+#define ADT7420_INT_PIN						PIN_PA19
+#define ADT7420_INT_PINMUX					PINMUX_PA19A_EIC_EXTINT3
+#define ADT7420_INT_EXTINT					3
+// Raw register LSBs per degree C, for the temperature and setpoint registers
+#define ADT7420_LSB_PER_C					128
+// T_LOW is parked below anything an animal will see, only T_HIGH drives INT
+#define ADT7420_T_LOW_PARKED				(-40 * ADT7420_LSB_PER_C)
+#define ADT7420_T_HYST_MAX					15
 
 #define TEMP_SENSOR_ADDRESS					0x48
 #define TEMP_SENSOR_TEMP_REG_MS_ADDR		0x00
 #define TEMP_SENSOR_TEMP_REG_LS_ADDR		0x01
 #define TEMP_SENSOR_STATUS_ADDR				0x02 
 #define TEMP_SENSOR_CONFIG_ADDR				0x03
+#define TEMP_SENSOR_T_HIGH_ADDR				0x04
+#define TEMP_SENSOR_T_LOW_ADDR				0x06
+#define TEMP_SENSOR_T_CRIT_ADDR				0x08
+#define TEMP_SENSOR_T_HYST_ADDR				0x0A
 
 #define TEMP_SESNOR_SFTW_RESET_ADDR			0x2F
 
@@ -33,8 +52,14 @@
 #define TEMP_SENSOR_CONFIG_FLT_QUE_3		0x02
 #define TEMP_SENSOR_CONFIG_FLT_QUE_4		0x03
 
+// Read profiling, active core cycles from the SysTick cycle counter. The sleeps in wait_ms and I2C_transfer do not count
+uint32_t ADT7420_read_cycles;
+uint32_t ADT7420_read_cycles_max;
+
 // Temp Sensor
 void configure_ADT7420(void);
 void ADT7420_read_temp(void);
+void ADT7420_ISR_Handler(void);
+void ADT7420_threshold_service(void);
 
 #endif
\ No newline at end of file
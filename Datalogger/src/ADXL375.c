@@ -5,6 +5,125 @@
 
 #include "HAL.h"
 #include <asf.h>
+#include <string.h>
+
+// One descriptor per FIFO entry so a whole drain is queued on the I2C engine as a single job
+static struct i2c_transaction ADXL375_fifo_transactions[ADXL375_FIFO_DEPTH];
+static uint8_t ADXL375_fifo_raw[ADXL375_FIFO_DEPTH][ADXL375_SAMPLE_SIZE];
+static uint8_t ADXL375_data_reg = ADXL375_DATAX0;
+// Shock capture state, the event is built here and copied into the shock ring
+static bool ADXL375_shock_armed;
+static struct shock_event ADXL375_shock;
+// RAM copy of the configuration registers, bit n of dirty set if ADXL375_SHADOW_FIRST + n needs writing
+static uint8_t ADXL375_shadow[ADXL375_SHADOW_SIZE];
+static uint32_t ADXL375_shadow_dirty;
+static struct i2c_transaction ADXL375_shadow_transactions[ADXL375_SHADOW_RUNS];
+static uint8_t ADXL375_shadow_buffers[ADXL375_SHADOW_RUNS][ADXL375_SHADOW_SIZE + 1];
+
+/**************************************************************************/
+/* @brief ADXL375_shadow_load fills the shadow from the part, the part keeps its
+/* registers while powered so this is only needed once
+/* @params none
+/* @returns none
+**************************************************************************/
+static void ADXL375_shadow_load(void)
+{
+	// INT_SOURCE and the data registers are left out, reading them has side effects
+	I2C_read_regs(ADXL375_ADDR, ADXL375_SHADOW_FIRST, ADXL375_shadow, ADXL375_INT_MAP_ADDR - ADXL375_SHADOW_FIRST + 1);
+	I2C_read_regs(ADXL375_ADDR, ADXL375_DATA_FORMAT_ADDR, &ADXL375_shadow[ADXL375_DATA_FORMAT_ADDR - ADXL375_SHADOW_FIRST], 1);
+	I2C_read_regs(ADXL375_ADDR, ADXL375_FIFO_ADDR, &ADXL375_shadow[ADXL375_FIFO_ADDR - ADXL375_SHADOW_FIRST], 1);
+	ADXL375_shadow_dirty = 0;
+}
+
+/**************************************************************************/
+/* @brief ADXL375_shadow_read gives a configuration register from the shadow
+/* @params[in] reg the register address, ADXL375_SHADOW_FIRST to ADXL375_SHADOW_LAST
+/* @returns the register value
+**************************************************************************/
+static uint8_t ADXL375_shadow_read(uint8_t reg)
+{
+	return ADXL375_shadow[reg - ADXL375_SHADOW_FIRST];
+}
+
+/**************************************************************************/
+/* @brief ADXL375_shadow_write changes a configuration register in the shadow, it
+/* reaches the part on the next ADXL375_shadow_flush. Writing the current value is free.
+/* @params[in] reg the register address, a writable one from ADXL375_SHADOW_FIRST to ADXL375_SHADOW_LAST
+/* @params[in] value the register value
+/* @returns none
+**************************************************************************/
+static void ADXL375_shadow_write(uint8_t reg, uint8_t value)
+{
+	if(ADXL375_shadow[reg - ADXL375_SHADOW_FIRST] == value) return;
+	ADXL375_shadow[reg - ADXL375_SHADOW_FIRST] = value;
+	ADXL375_shadow_dirty |= 1UL << (reg - ADXL375_SHADOW_FIRST);
+}
+
+/**************************************************************************/
+/* @brief ADXL375_shadow_flush writes the changed registers. Each run of writable
+/* registers holding a change goes as one auto-increment burst, clean registers in
+/* between are rewritten with their shadow value. All bursts are queued on the I2C
+/* engine as one job. Registers whose burst failed stay dirty for the next flush.
+/* Flushes are applied in address order, sequences that need another order flush between steps.
+/* @params none
+/* @returns STATUS_OK if every burst was written
+**************************************************************************/
+static enum status_code ADXL375_shadow_flush(void)
+{
+	uint32_t dirty = ADXL375_shadow_dirty;
+	uint32_t runs[ADXL375_SHADOW_RUNS];
+	uint8_t count = 0, first, last, i;
+	enum status_code result = STATUS_OK;
+	
+	while(dirty && count < ADXL375_SHADOW_RUNS){
+		for(first = 0; !(dirty & (1UL << first)); first++);
+		// Stretch the burst to the last change before a register that can't be written
+		last = first;
+		for(i = first; i < ADXL375_SHADOW_SIZE && (ADXL375_SHADOW_WRITABLE & (1UL << i)); i++){
+			if(dirty & (1UL << i)) last = i;
+		}
+		runs[count] = ((1UL << (last + 1)) - 1) & ~((1UL << first) - 1);
+		dirty &= ~runs[count];
+		
+		ADXL375_shadow_buffers[count][0] = ADXL375_SHADOW_FIRST + first;
+		memcpy(&ADXL375_shadow_buffers[count][1], &ADXL375_shadow[first], last - first + 1);
+		ADXL375_shadow_transactions[count].address = ADXL375_ADDR;
+		ADXL375_shadow_transactions[count].write_data = ADXL375_shadow_buffers[count];
+		ADXL375_shadow_transactions[count].write_length = last - first + 2;
+		ADXL375_shadow_transactions[count].read_data = NULL;
+		ADXL375_shadow_transactions[count].read_length = 0;
+		ADXL375_shadow_transactions[count].callback = NULL;
+		count++;
+	}
+	if(!count) return STATUS_OK;
+	
+	// The last burst is waited on, the engine completes the queue in order
+	for(i = 0; i < count - 1; i++) I2C_submit(&ADXL375_shadow_transactions[i]);
+	I2C_transfer(&ADXL375_shadow_transactions[count - 1]);
+	ADXL375_shadow_bursts += count;
+	
+	for(i = 0; i < count; i++){
+		if(ADXL375_shadow_transactions[i].status == STATUS_OK) ADXL375_shadow_dirty &= ~runs[i];
+		else result = ADXL375_shadow_transactions[i].status;
+	}
+	
+	return result;
+}
+
+/**************************************************************************/
+/* @brief ADXL375_close_data_set ends the current run of samples when sampling
+/* stops: a new data set in raw mode, the last (short) epoch in summary mode
+/* @params none
+/* @returns none
+**************************************************************************/
+static void ADXL375_close_data_set(void)
+{
+#if ACCEL_SUMMARY_MODE
+	summary_flush();
+#else
+	mark_data_set(&accel_ring, &accel_sets);
+#endif
+}
 
 /**************************************************************************/
 /* @brief configure_ADXL375 function to configure the ADXL375 accelerometer
@@ -13,22 +132,8 @@
 **************************************************************************/
 void configure_ADXL375(void)
 {
-	// All buffers are separate for readability
-	struct i2c_master_packet i2c_packet;
-	uint16_t timeout = 0;
-	// FIFO Stream mode (ring buffer) and 32 data points
-	uint8_t wr_buffer1[2] = {ADXL375_FIFO_ADDR, ADXL375_FIFO_STREAM | 0x1F};
-	// Map interrupts for act, watermark, and inact to int1
-	uint8_t wr_buffer4[2] = {ADXL375_INT_MAP_ADDR, (~ADXL375_INT_MAP_ACTIVITY & ~ADXL375_INT_SRC_WATERMARK & ~ADXL375_INT_SRC_INACTIVITY) & 0xFF};
-	// Enable interrupts for activity, inactivity, and watermark
-	uint8_t wr_buffer5[2] = {ADXL375_INT_EN_ADDR, ADXL375_INT_EN_WATERMARK | ADXL375_INT_EN_ACTIVITY};
-	// Set the part to measure and sleep
-	// Realistically, this should be sleep and standby, but the part doesn't wake from standby
-	// FIX: change ADXL375 for ADXL362
-	uint8_t wr_buffer6[2] = {ADXL375_POWER_CTL_ADDR, ADXL375_POWER_CTL_SLEEP | ADXL375_POWER_CTL_MEASUSRE};
-	//Set low power mode
-	uint8_t wr_buffer7[2] = {ADXL375_BW_RATE_ADDR, ADXL375_BW_RATE_LOW_PWR};
-	
+	// All configuration register changes go through the shadow
+	ADXL375_shadow_load();
 	
 	// Calibrate the sensor before configuring anything else
 	ADXL375_calibrate();
@@ -36,44 +141,20 @@ void configure_ADXL375(void)
 	ADXL375_set_activity_thresh(4, true, true, true);
 	ADXL375_set_inactivity_thresh(3, 5, true, true, true);
 	
-	i2c_packet.address = ADXL375_ADDR;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	i2c_packet.data_length = 2;
-	i2c_packet.data = wr_buffer1;
-	
-	/* Write each packet one at a time, bad for efficiency, but good for readability */
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	i2c_packet.data = wr_buffer4;
-	timeout = 0;
-	
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	i2c_packet.data = wr_buffer5;
-	timeout = 0;
-	
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	i2c_packet.data = wr_buffer6;
-	timeout = 0;
-	
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	i2c_packet.data = wr_buffer7;
-	timeout = 0;
-	
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
+	/* Set each register one at a time for readability, the flush writes them in two bursts */
+	// FIFO Stream mode (ring buffer), the watermark leaves room for the samples taken while it waits
+	ADXL375_shadow_write(ADXL375_FIFO_ADDR, ADXL375_FIFO_STREAM | ADXL375_FIFO_WATERMARK);
+	// Map interrupts for act, watermark, and inact to int1
+	ADXL375_shadow_write(ADXL375_INT_MAP_ADDR, (~ADXL375_INT_MAP_ACTIVITY & ~ADXL375_INT_SRC_WATERMARK & ~ADXL375_INT_SRC_INACTIVITY) & 0xFF);
+	// Enable interrupts for activity, inactivity, and watermark
+	ADXL375_shadow_write(ADXL375_INT_EN_ADDR, ADXL375_INT_EN_WATERMARK | ADXL375_INT_EN_ACTIVITY);
+	// Set the part to measure and sleep
+	// Realistically, this should be sleep and standby, but the part doesn't wake from standby
+	// FIX: change ADXL375 for ADXL362
+	ADXL375_shadow_write(ADXL375_POWER_CTL_ADDR, ADXL375_POWER_CTL_SLEEP | ADXL375_POWER_CTL_MEASUSRE);
+	//Set low power mode
+	ADXL375_shadow_write(ADXL375_BW_RATE_ADDR, ADXL375_BW_RATE_LOW_PWR);
+	ADXL375_shadow_flush();
 	
 		
 	// Set up the interrupt pin
@@ -111,10 +192,10 @@ void configure_ADXL375(void)
 	// Wait for the sync to complete
 	while(REG_EIC_SYNCBUSY & 0x02);
 	
-	// Set the buffer index pointer to 0
-	uiAccelerometerMatrixPtr = 0;
+	// The accelerometer ring is set up by configure_databuffers
 	ADXL375_inactive_interrupts = 0;
-	ADXL375_buffer_full_count = 0;
+	ADXL375_burst_samples = 0;
+	ADXL375_fifo_overruns = 0;
 	
 	
 }
@@ -123,59 +204,71 @@ void configure_ADXL375(void)
 /**************************************************************************/
 /* @brief ADXL375_ISR_Handler ADXL375 ISR handler function
 /* When INT1 pin on the ADXL375 is triggered, this function is called.
+/* The interrupt is only recorded here, ADXL375_service does the work from the main loop.
 /* @params none
 /* @returns none
 **************************************************************************/
 void ADXL375_ISR_Handler(void)
 {
-	struct i2c_master_packet i2c_packet;
-	uint16_t timeout = 0;
-	uint8_t buffer = ADXL375_INT_SRC_ADDR;
-	
-	i2c_packet.address = ADXL375_ADDR;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	i2c_packet.data_length = 1;
-	i2c_packet.data = &buffer;
+	work_post(ADXL375_service);
+}
+
+/**************************************************************************/
+/* @brief ADXL375_service reads the interrupt source and handles activity,
+/* watermark and inactivity. Runs from the deferred work queue.
+/* @params none
+/* @returns none
+**************************************************************************/
+void ADXL375_service(void)
+{
+	uint8_t buffer = 0;
+	int16_t block[ADXL375_FIFO_DEPTH * ACCEL_AXES];
+	uint8_t count;
+	uint32_t start = cycle_count();
+	uint32_t cycles;
+	// The FIFO holds shock samples rather than the 12.5 Hz stream while armed
+	bool armed = ADXL375_shock_armed;
 	
 	// Check the interrupt source value
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	while((status = i2c_master_read_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
+	I2C_read_regs(ADXL375_ADDR, ADXL375_INT_SRC_ADDR, &buffer, 1);
+	// The overrun bit is set whether or not its interrupt is enabled, count it so lost samples are visible
+	if(buffer & ADXL375_INT_SRC_OVERRUN) ADXL375_fifo_overruns++;
+	// Read a shock out of the FIFO before anything else changes the FIFO mode
+	if(armed && (buffer & ADXL375_INT_SRC_SINGLE_SHOCK)) ADXL375_capture_shock();
 	// If the source of the interrupt was movement, handle it.
 	if(buffer & ADXL375_INT_SRC_ACTIVITY){
 		// If we are in inactive mode, then switch to active mode
 		ucMotion_State = MOTION_MODE;
 		// We have switched modes, so the temperature data needs to be marked as a new set
-		ucTemperatureDataSets++;
-		cTemperatureDataSetPtr[ucTemperatureDataSets] = ucTemperatureArrayPtr;
-		get_timestamp(ucTemperatureTimestamps[ucTemperatureDataSets]);
+		mark_data_set(&temperature_ring, &temperature_sets);
 		// Re-enable the inactivity interrupt in case it was disabled previously (this happens when the animal is stationary and the inactive interrupt is triggered more than once)
 		ADXL375_enable_interrupt(ADXL375_INT_SRC_INACTIVITY);
 		// Movement interrupt triggered, enter 12.5 Hz sampling mode
+		ADXL375_burst_samples = 0;
 		ADXL375_begin_sampling();		
 	}
-	// If the source of the interrupt is from the the FIFO filling up
-	if(buffer & ADXL375_INT_SRC_WATERMARK){
-		// FIFO is full, read it out
-		// We know that 32 points are in the FIFO since thats the size we set it to
-		for(int i = 0; i < 32; i++){
-			
-			ADXL375_read_samples(ucAccelerometerMatrix + uiAccelerometerMatrixPtr, 1);
-			// Three consecutive data points make up one accelerometer data point so point to the next empty location in mem
-			uiAccelerometerMatrixPtr += 4;
-		}
-		// If we have taken 2 sets of samples, then stop (5.12 seconds worth of data)
+	// If the source of the interrupt is from the the FIFO filling up. The watermark bit is set
+	// whether or not its interrupt is enabled, so it means nothing while armed for shocks
+	if(!armed && (buffer & ADXL375_INT_SRC_WATERMARK)){
+		// FIFO is at the watermark, read it out and queue the samples for offload
+		count = ADXL375_read_samples(block, ADXL375_FIFO_DEPTH);
+#if ACCEL_SUMMARY_MODE
+		// Only the epoch summaries are stored
+		summary_add(block, count);
+#else
+		// Samples that don't fit in the ring are dropped and counted as ring overruns
+		ring_write(&accel_ring, block, count);
+#endif
+		// If we have taken a burst of samples, then stop (at least 5.12 seconds worth of data)
 		// This section is optional depending upon if ADXL362 also has inactivity
-		if(ADXL375_buffer_full_count >= 2){
+		ADXL375_burst_samples += count;
+		if(ADXL375_burst_samples >= ADXL375_BURST_SAMPLES){
 			 ADXL375_end_sampling();
-			 uiAccelerometerDataSets++;
-			 iAccelerometerDataSetPtr[uiAccelerometerDataSets] = uiAccelerometerMatrixPtr;
-			 get_timestamp(ucAccelTimestamps[uiAccelerometerDataSets]);
+			 ADXL375_close_data_set();
+#if ACCEL_SHOCK_CAPTURE
+			 // Keep watching for shocks until the next burst of movement
+			 ADXL375_arm_shock_capture();
+#endif
 		}
 	}
 	// If the source of the interrupt was from inactivity
@@ -184,15 +277,17 @@ void ADXL375_ISR_Handler(void)
 		// 3 Interrupts yields 12.75 minutes (255/60 is 4.25 minutes per interrupt--255 is the number of seconds to wait for inactivity)
 		if(++ADXL375_inactive_interrupts >= 3){
 			ucMotion_State = STATIONARY_MODE;
-			// Also need to stop the accel
+			// Also need to stop the accel, and stop waiting for shocks
+			ADXL375_disarm_shock_capture();
 			ADXL375_end_sampling();
-			uiAccelerometerDataSets++;
-			iAccelerometerDataSetPtr[uiAccelerometerDataSets] = uiAccelerometerMatrixPtr;
-			get_timestamp(ucAccelTimestamps[uiAccelerometerDataSets]);
+			ADXL375_close_data_set();
 		}
 		// We are now stationary, so disable the inactive interrupt
 		ADXL375_disable_interrupt(ADXL375_INT_EN_INACTIVITY);
 	}
+	
+	cycles = cycles_since(start);
+	if(cycles > ADXL375_service_cycles_max) ADXL375_service_cycles_max = cycles;
 }
 
 /**************************************************************************/
@@ -203,35 +298,9 @@ void ADXL375_ISR_Handler(void)
 **************************************************************************/
 void ADXL375_disable_interrupt(uint8_t interrupt_src)
 {
-	struct i2c_master_packet i2c_packet;
-	uint8_t wr_buffer[2] = {ADXL375_INT_EN_ADDR, interrupt_src};
-	uint16_t timeout = 0;
-		
-	i2c_packet.address = ADXL375_ADDR;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	i2c_packet.data_length = 1;
-	i2c_packet.data = wr_buffer;
-	
-	// Write the interrupt enable address for readback
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	timeout = 0;
-	// Read back the value from the interrupt enable reg
-	while((status = i2c_master_read_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	// Reset the buffer with the disabled interrupt bit set low
-	wr_buffer[1] = wr_buffer[0] & ~interrupt_src;
-	wr_buffer[0] = ADXL375_INT_EN_ADDR;
-	timeout = 0;
-	
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
+	// The shadow holds the interrupt enable reg, so this is a single write
+	ADXL375_shadow_write(ADXL375_INT_EN_ADDR, ADXL375_shadow_read(ADXL375_INT_EN_ADDR) & ~interrupt_src);
+	ADXL375_shadow_flush();
 }
 
 /**************************************************************************/
@@ -242,35 +311,9 @@ void ADXL375_disable_interrupt(uint8_t interrupt_src)
 **************************************************************************/
 void ADXL375_enable_interrupt(uint8_t interrupt_src)
 {
-	struct i2c_master_packet i2c_packet;
-	uint8_t wr_buffer[2] = {ADXL375_INT_EN_ADDR, interrupt_src};
-	uint16_t timeout = 0;
-	
-	i2c_packet.address = ADXL375_ADDR;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	i2c_packet.data_length = 1;
-	i2c_packet.data = wr_buffer;
-	
-	// Write the interrupt enable address for readback
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	timeout = 0;
-	// Read back the value from the interrupt enable reg
-	while((status = i2c_master_read_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	// Reset the buffer with the enabled interrupt bit set high
-	wr_buffer[1] = wr_buffer[0] | interrupt_src;
-	wr_buffer[0] = ADXL375_INT_EN_ADDR;
-	timeout = 0;
-	
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
+	// The shadow holds the interrupt enable reg, so this is a single write
+	ADXL375_shadow_write(ADXL375_INT_EN_ADDR, ADXL375_shadow_read(ADXL375_INT_EN_ADDR) | interrupt_src);
+	ADXL375_shadow_flush();
 }
 
 /************************************************************************/
@@ -282,96 +325,35 @@ void ADXL375_enable_interrupt(uint8_t interrupt_src)
 /************************************************************************/
 void ADXL375_calibrate(void)
 {
-	
-	struct i2c_master_packet i2c_packet;
-	uint16_t timeout = 0;
-	uint8_t wr_buffer[3] = {ADXL375_DATAX0, ADXL375_DATAY0, ADXL375_DATAZ0};
-	uint8_t wr_buffer2 = ADXL375_FIFO_STATUS_ADDR;
-	int8_t data[6];
-	volatile int8_t avgs[3] = {0, 0, 0};
-	int8_t wr_buffer3[2];
-	
-	i2c_packet.address = ADXL375_ADDR;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	i2c_packet.data_length = 1;
-	i2c_packet.data = &wr_buffer2;
+	uint8_t entries = 0;
+	uint8_t data[6];
+	int32_t sums[3] = {0, 0, 0};
 	
 	ADXL375_begin_sampling();
-	// Wait for some samples
- 	for(int i = 0; i < 65535; i++);
+	// Wait for some samples (about 12 at 12.5 Hz)
+ 	wait_ms(1000);
 	ADXL375_end_sampling();
-	// Make sure some time has passed so that the data can be moved from the fifo to the regs
-	for(int i = 0; i < 65535; i++);
-	
-	// Write the fifo status reg address for readback
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	// Read back the value from the fifo status reg
-	while((status = i2c_master_read_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	i2c_packet.data_length = 3;
-	i2c_packet.data = wr_buffer;
-	
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	i2c_packet.data_length = 3;
-	i2c_packet.data = data;
-	for(int i = 0; i < wr_buffer2; i++){
-		while((status = i2c_master_read_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-			if(timeout++ == i2c_master_instance.buffer_timeout) break;
-		}
-		avgs[0] += (data[0]);
-		avgs[1] += (data[1]);
-		avgs[2] += (data[2]);
-	}
-	avgs[0] /= wr_buffer2;
-	avgs[1] /= wr_buffer2;
-	avgs[2] /= wr_buffer2;
-	
-	
-	i2c_packet.data_length = 2;
-	i2c_packet.data = &wr_buffer3;
-	
-	wr_buffer3[0] = ADXL375_OFSX_ADDR;
-	wr_buffer3[1] = avgs[0];
-	
-	// Write offset x
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	// Write offset y
-	i2c_packet.data_length = 2;
-	wr_buffer3[0] = ADXL375_OFSY_ADDR;
-	wr_buffer3[1] = avgs[1];
-	timeout = 0;
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-
-	// Write offset y
-	wr_buffer3[0] = ADXL375_OFSZ_ADDR;
-	wr_buffer3[1] = avgs[2];
-	timeout = 0;
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	// Write offset y
-	i2c_packet.data_length = 1;
-	wr_buffer3[0] = ADXL375_OFSY_ADDR;
-	timeout = 0;
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
+	// Make sure some time has passed so that the data can be moved from the fifo to the regs (5 us per the datasheet)
+	wait_us(5);
+	
+	// Read back the number of samples waiting in the fifo
+	if(I2C_read_regs(ADXL375_ADDR, ADXL375_FIFO_STATUS_ADDR, &entries, 1) != STATUS_OK) return;
+	entries &= ADXL375_FIFO_STATUS_ENTRIES;
+	if(!entries) return;
+	
+	// Each read pops one sample, all six data regs are read in one go
+	for(int i = 0; i < entries; i++){
+		I2C_read_regs(ADXL375_ADDR, ADXL375_DATAX0, data, 6);
+		sums[0] += (int16_t)(data[0] | data[1] << 8);
+		sums[1] += (int16_t)(data[2] | data[3] << 8);
+		sums[2] += (int16_t)(data[4] | data[5] << 8);
+	}
+	
+	// The offset regs are added to the output, so write the negated average in offset reg units
+	ADXL375_shadow_write(ADXL375_OFSX_ADDR, (int8_t)(-(sums[0] / entries) / ADXL375_OFS_SCALE));
+	ADXL375_shadow_write(ADXL375_OFSY_ADDR, (int8_t)(-(sums[1] / entries) / ADXL375_OFS_SCALE));
+	ADXL375_shadow_write(ADXL375_OFSZ_ADDR, (int8_t)(-(sums[2] / entries) / ADXL375_OFS_SCALE));
+	ADXL375_shadow_flush();
 }
 
 /************************************************************************/
@@ -384,46 +366,16 @@ void ADXL375_calibrate(void)
 /************************************************************************/
 void ADXL375_set_activity_thresh(int8_t threshold, bool x, bool y, bool z)
 {
+	uint8_t act_inact_ctl = ADXL375_shadow_read(ADXL375_ACT_INACT_CTL_ADDR);
 	
-	struct i2c_master_packet i2c_packet;
-	uint16_t timeout = 0;
-	uint8_t wr_buffer1[2] = {ADXL375_THRESH_ACT_ADDR, threshold};
-	uint8_t wr_buffer2[2] = {ADXL375_ACT_INACT_CTL_ADDR, (x ? ADXL375_ACT_INACT_ACT_X_EN : 0x00) | (y ? ADXL375_ACT_INACT_ACT_Y_EN : 0x00) | (z ? ADXL375_ACT_INACT_ACT_Z_EN : 0x00)};
+	ADXL375_shadow_write(ADXL375_THRESH_ACT_ADDR, threshold);
 	
-	i2c_packet.address = ADXL375_ADDR;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	i2c_packet.data_length = 2;
-	i2c_packet.data = wr_buffer1;
-	
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	// Read out the act inact ctl reg contents, then OR them with the value that needs to be set to set up the activity
-	// that way we don't stomp a previously set value
-	i2c_packet.data_length = 1;
-	i2c_packet.data = wr_buffer2;
-	timeout = 0;
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	timeout = 0;
-	while((status = i2c_master_read_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	wr_buffer2[1] |= wr_buffer2[0];
-	wr_buffer2[0] = ADXL375_ACT_INACT_CTL_ADDR;
-	
-	i2c_packet.data_length = 2;
-	i2c_packet.data = wr_buffer2;
-	timeout = 0;
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
+	// OR the activity enables into the act inact ctl reg so we don't stomp a previously set value
+	act_inact_ctl |= (x ? ADXL375_ACT_INACT_ACT_X_EN : 0x00) | (y ? ADXL375_ACT_INACT_ACT_Y_EN : 0x00) | (z ? ADXL375_ACT_INACT_ACT_Z_EN : 0x00);
+	ADXL375_shadow_write(ADXL375_ACT_INACT_CTL_ADDR, act_inact_ctl);
 	
+	// THRESH_ACT to ACT_INACT_CTL go in one burst
+	ADXL375_shadow_flush();
 }
 
 /************************************************************************/
@@ -438,53 +390,17 @@ void ADXL375_set_activity_thresh(int8_t threshold, bool x, bool y, bool z)
 /************************************************************************/
 void ADXL375_set_inactivity_thresh(int8_t threshold, uint8_t duration, bool x, bool y, bool z)
 {
-	struct i2c_master_packet i2c_packet;
-	uint16_t timeout = 0;
-	uint8_t wr_buffer1[2] = {ADXL375_THRESH_INACT_ADDR, threshold};
-	uint8_t wr_buffer2[2] = {ADXL375_TIME_INACT_ADDR, duration};
-	uint8_t wr_buffer3[2] = {ADXL375_ACT_INACT_CTL_ADDR, (x ? ADXL375_ACT_INACT_INACT_X_EN : 0x00) | (y ? ADXL375_ACT_INACT_INACT_Y_EN : 0x00) | (z ? ADXL375_ACT_INACT_INACT_Z_EN : 0x00)};
-
-	i2c_packet.address = ADXL375_ADDR;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	i2c_packet.data_length = 2;
-	i2c_packet.data = wr_buffer1;
-
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-
-	i2c_packet.data = wr_buffer2;
-	timeout = 0;
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	// Read out the act inact ctl reg contents, then OR them with the value that needs to be set to set up the inactivity
-	// that way we don't stomp a previously set value
-	i2c_packet.data_length = 1;
-	i2c_packet.data = wr_buffer3;
-	timeout = 0;
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
+	uint8_t act_inact_ctl = ADXL375_shadow_read(ADXL375_ACT_INACT_CTL_ADDR);
 	
-	timeout = 0;
-	while((status = i2c_master_read_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
+	ADXL375_shadow_write(ADXL375_THRESH_INACT_ADDR, threshold);
+	ADXL375_shadow_write(ADXL375_TIME_INACT_ADDR, duration);
 	
-	wr_buffer3[1] |= wr_buffer3[0];
-	wr_buffer3[0] = ADXL375_ACT_INACT_CTL_ADDR;
+	// OR the inactivity enables into the act inact ctl reg so we don't stomp a previously set value
+	act_inact_ctl |= (x ? ADXL375_ACT_INACT_INACT_X_EN : 0x00) | (y ? ADXL375_ACT_INACT_INACT_Y_EN : 0x00) | (z ? ADXL375_ACT_INACT_INACT_Z_EN : 0x00);
+	ADXL375_shadow_write(ADXL375_ACT_INACT_CTL_ADDR, act_inact_ctl);
 	
-	i2c_packet.data_length = 2;
-	i2c_packet.data = wr_buffer3;
-	timeout = 0;
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-
+	// THRESH_INACT to ACT_INACT_CTL go in one burst
+	ADXL375_shadow_flush();
 }
 
 /************************************************************************/
@@ -494,28 +410,13 @@ void ADXL375_set_inactivity_thresh(int8_t threshold, uint8_t duration, bool x, b
 /************************************************************************/
 void ADXL375_begin_sampling(void)
 {
-	
-	struct i2c_master_packet i2c_packet;
-	uint16_t timeout = 0;
+	// Put the FIFO back in stream mode if it was waiting for a shock
+	ADXL375_disarm_shock_capture();
 	// Set the output data rate for 12.5 Hz (Closest to 10 available) and set for low power mode ("somewhat more noisy" -- datasheet).
-	uint8_t wr_buffer[2] = {ADXL375_BW_RATE_ADDR, ADXL375_BW_RATE_LOW_PWR | 0x07};
-	uint8_t wr_buffer2[2] = {ADXL375_POWER_CTL_ADDR, ADXL375_POWER_CTL_MEASUSRE};	
-	
-	i2c_packet.address = ADXL375_ADDR;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	i2c_packet.data_length = 2;
-	i2c_packet.data = wr_buffer;
-	// Write the datarate buffer
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
-	
-	// Write the measurement mode buffer
-	i2c_packet.data = wr_buffer2;
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
+	ADXL375_shadow_write(ADXL375_BW_RATE_ADDR, ADXL375_BW_RATE_LOW_PWR | ADXL375_BW_RATE_12_5HZ);
+	// Write the measurement mode, in the same burst as the rate
+	ADXL375_shadow_write(ADXL375_POWER_CTL_ADDR, ADXL375_POWER_CTL_MEASUSRE);
+	ADXL375_shadow_flush();
 }
 
 /************************************************************************/
@@ -525,56 +426,144 @@ void ADXL375_begin_sampling(void)
 /************************************************************************/
 void ADXL375_end_sampling(void)
 {
+	ADXL375_shadow_write(ADXL375_POWER_CTL_ADDR, ~ADXL375_POWER_CTL_MEASUSRE & 0xFF);
+	ADXL375_shadow_flush();
+}
+
+/************************************************************************/
+/* @brief ADXL375_read_samples drains the ADXL375 FIFO. FIFO_STATUS is read once,
+/* then every entry is read with a register pointer write and a 6 byte auto-increment
+/* read of DATAX0..DATAZ1. All entries are queued on the I2C engine together. The
+/* stop/start between transactions is longer than the 5 us the FIFO needs to pop.
+/* Samples are kept at the full 13 bit resolution, sign extended by the part.
+/* @param[out] data, pointer to data array of 3*length, x, y, z per sample
+/* @param[in] length, maximum number of samples to read
+/* @returns the number of samples read
+/************************************************************************/
+uint8_t ADXL375_read_samples(int16_t* data, uint8_t length)
+{
+	uint8_t entries = 0;
+	uint8_t read = 0;
+	uint32_t start = cycle_count();
+	
+	if(I2C_read_regs(ADXL375_ADDR, ADXL375_FIFO_STATUS_ADDR, &entries, 1) != STATUS_OK) return 0;
+	entries &= ADXL375_FIFO_STATUS_ENTRIES;
+	if(entries > ADXL375_FIFO_DEPTH) entries = ADXL375_FIFO_DEPTH;
+	if(entries > length) entries = length;
+	
+	if(entries){
+		for(int i = 0; i < entries; i++){
+			ADXL375_fifo_transactions[i].address = ADXL375_ADDR;
+			ADXL375_fifo_transactions[i].write_data = &ADXL375_data_reg;
+			ADXL375_fifo_transactions[i].write_length = 1;
+			ADXL375_fifo_transactions[i].read_data = ADXL375_fifo_raw[i];
+			ADXL375_fifo_transactions[i].read_length = ADXL375_SAMPLE_SIZE;
+			ADXL375_fifo_transactions[i].callback = NULL;
+			// The last entry is waited on, the engine completes the queue in order
+			if(i < entries - 1) I2C_submit(&ADXL375_fifo_transactions[i]);
+		}
+		I2C_transfer(&ADXL375_fifo_transactions[entries - 1]);
+		
+		for(read = 0; read < entries; read++){
+			if(ADXL375_fifo_transactions[read].status != STATUS_OK) break;
+			for(int axis = 0; axis < ACCEL_AXES; axis++){
+				data[ACCEL_AXES*read + axis] = (int16_t)(ADXL375_fifo_raw[read][2*axis] | ADXL375_fifo_raw[read][2*axis + 1] << 8);
+			}
+		}
+	}
 	
-	struct i2c_master_packet i2c_packet;
-	uint16_t timeout = 0;
-	uint8_t wr_buffer[2] = {ADXL375_POWER_CTL_ADDR, ~ADXL375_POWER_CTL_MEASUSRE};	
-	
-	i2c_packet.address = ADXL375_ADDR;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	i2c_packet.data_length = 2;
-	i2c_packet.data = wr_buffer;
+	ADXL375_drain_bytes = (ADXL375_READ_OVERHEAD + 1) + entries * (ADXL375_READ_OVERHEAD + ADXL375_SAMPLE_SIZE);
+	ADXL375_drain_cycles = cycles_since(start);
+	if(ADXL375_drain_cycles > ADXL375_drain_cycles_max) ADXL375_drain_cycles_max = ADXL375_drain_cycles;
 	
-	while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-		if(timeout++ == i2c_master_instance.buffer_timeout) break;
-	}
+	return read;
+}
+
+/************************************************************************/
+/* @brief ADXL375_arm_shock_capture waits for a shock at ADXL375_SHOCK_RATE with the
+/* FIFO in trigger mode. The part keeps the last ADXL375_SHOCK_PRETRIGGER samples in
+/* its FIFO and fills the rest after a shock, so the MCU sleeps through the high rate
+/* sampling and only wakes for the single shock interrupt. Over I2C the MCU could not
+/* keep a pre-trigger ring of its own at these rates (one FIFO entry takes about 1 ms).
+/* Capture is disarmed again after ADXL375_SHOCK_WINDOW seconds, the 800 Hz rate has
+/* no low power mode and would otherwise run until the animal is stationary.
+/* @params none
+/* @returns none
+/************************************************************************/
+void ADXL375_arm_shock_capture(void)
+{
+	// The rate and FIFO mode are changed in standby
+	ADXL375_end_sampling();
 	
+	ADXL375_shadow_write(ADXL375_THRESH_SHOCK_ADDR, ADXL375_SHOCK_THRESHOLD);
+	ADXL375_shadow_write(ADXL375_DUR_ADDR, ADXL375_SHOCK_DURATION);
+	ADXL375_shadow_write(ADXL375_SHOCK_AXES_ADDR, ADXL375_SHOCK_AXES_X_EN | ADXL375_SHOCK_AXES_Y_EN | ADXL375_SHOCK_AXES_Z_EN);
+	// Low power mode only goes up to 400 Hz
+	ADXL375_shadow_write(ADXL375_BW_RATE_ADDR, ADXL375_SHOCK_RATE);
+	// Map the shock to INT1, the trigger source and the pin the EIC watches
+	ADXL375_shadow_write(ADXL375_INT_MAP_ADDR, ADXL375_shadow_read(ADXL375_INT_MAP_ADDR) & ~ADXL375_INT_MAP_SINGLE_SHOCK);
+	// The watermark would fire as soon as the pre-trigger samples are in
+	ADXL375_shadow_write(ADXL375_INT_EN_ADDR, (ADXL375_shadow_read(ADXL375_INT_EN_ADDR) & ~ADXL375_INT_EN_WATERMARK) | ADXL375_INT_EN_SINGLE_SHOCK);
+	// Bypass empties the FIFO
+	ADXL375_shadow_write(ADXL375_FIFO_ADDR, ADXL375_FIFO_BYPASS);
+	ADXL375_shadow_flush();
+	
+	// Then trigger mode on INT1 keeps the pre-trigger samples
+	ADXL375_shadow_write(ADXL375_FIFO_ADDR, ADXL375_FIFO_TRIGGER | ADXL375_SHOCK_PRETRIGGER);
+	ADXL375_shadow_flush();
+	ADXL375_shadow_write(ADXL375_POWER_CTL_ADDR, ADXL375_POWER_CTL_MEASUSRE);
+	ADXL375_shadow_flush();
+	ADXL375_shock_armed = true;
+	
+	schedule_at(SCHEDULE_SHOCK_WINDOW, schedule_now() + ADXL375_SHOCK_WINDOW, 0, ADXL375_SHOCK_WINDOW_SLACK, ADXL375_disarm_shock_capture);
 }
 
 /************************************************************************/
-/* @brief ADXL375_read_samples function to read out the samples from the ADXL375 FIFO
-/* Only uses the lower byte of data. This results in up to 12g
-/* @param[in,out] data, pointer to data array of 3*length
-/* @param[in] length, number of bytes to read out per axis
+/* @brief ADXL375_disarm_shock_capture stops waiting for shocks and puts the FIFO
+/* back in stream mode with the watermark interrupt. Does nothing if not armed.
+/* The part is left in standby.
+/* @params none
 /* @returns none
 /************************************************************************/
-void ADXL375_read_samples(uint8_t* data, uint8_t length)
+void ADXL375_disarm_shock_capture(void)
 {
-	struct i2c_master_packet i2c_packet;
-	uint16_t timeout = 0;
-	uint8_t tempBuffer[6];
-	uint8_t wr_buffer[6] = {ADXL375_DATAX0, ADXL375_DATAX1, ADXL375_DATAY0, ADXL375_DATAY1, ADXL375_DATAZ0, ADXL375_DATAZ1};
-	
-	i2c_packet.address = ADXL375_ADDR;
-	i2c_packet.ten_bit_address = false;
-	i2c_packet.high_speed = false;
-	
-	for(int i = 0; i < length; i++){
-		// Write the registers that should be read out
-		i2c_packet.data_length = 6;
-		i2c_packet.data = wr_buffer;
-		while((status = i2c_master_write_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-			if(timeout++ == i2c_master_instance.buffer_timeout) break;
-		}
-		// Perform the readout
-		i2c_packet.data_length = 6;
-		i2c_packet.data = tempBuffer;
-		while((status = i2c_master_read_packet_wait(&i2c_master_instance, &i2c_packet)) != STATUS_OK){
-			if(timeout++ == i2c_master_instance.buffer_timeout) break;
-		}
-		data[i]		= tempBuffer[1];
-		data[i+1]	= tempBuffer[3];
-		data[i+2]	= tempBuffer[5];
-	}
+	if(!ADXL375_shock_armed) return;
+	
+	// Disarmed early by movement or inactivity, the window alarm is not needed
+	schedule_cancel(SCHEDULE_SHOCK_WINDOW);
+	ADXL375_shadow_write(ADXL375_INT_EN_ADDR, (ADXL375_shadow_read(ADXL375_INT_EN_ADDR) & ~ADXL375_INT_EN_SINGLE_SHOCK) | ADXL375_INT_EN_WATERMARK);
+	ADXL375_shadow_write(ADXL375_POWER_CTL_ADDR, ~ADXL375_POWER_CTL_MEASUSRE & 0xFF);
+	ADXL375_shadow_write(ADXL375_FIFO_ADDR, ADXL375_FIFO_STREAM | ADXL375_FIFO_WATERMARK);
+	ADXL375_shadow_flush();
+	ADXL375_shock_armed = false;
+}
+
+/************************************************************************/
+/* @brief ADXL375_capture_shock reads a triggered FIFO out as one shock event for
+/* the shock ring, then re-arms the trigger. Runs from the deferred work queue.
+/* @params none
+/* @returns none
+/************************************************************************/
+void ADXL375_capture_shock(void)
+{
+	uint8_t axes = 0;
+	
+	get_timestamp(ADXL375_shock.timestamp);
+	// The FIFO stops once the samples after the shock have filled it
+	wait_ms((ADXL375_FIFO_DEPTH - ADXL375_SHOCK_PRETRIGGER) * 1000UL / ADXL375_SHOCK_RATE_HZ + 1);
+	
+	I2C_read_regs(ADXL375_ADDR, ADXL375_ACT_SHOCK_STATUS_ADDR, &axes, 1);
+	ADXL375_shock.rate = ADXL375_SHOCK_RATE;
+	ADXL375_shock.pretrigger = ADXL375_SHOCK_PRETRIGGER;
+	ADXL375_shock.axes = axes & ADXL375_ACT_SHOCK_STATUS_SHOCK_AXES;
+	ADXL375_shock.count = ADXL375_read_samples(ADXL375_shock.samples, ADXL375_FIFO_DEPTH);
+	
+	// Events that don't fit are dropped and counted as ring overruns
+	if(ring_write(&shock_ring, &ADXL375_shock, 1)) ADXL375_shock_events++;
+	
+	// Bypass clears the trigger, back in trigger mode the FIFO waits for the next shock
+	ADXL375_shadow_write(ADXL375_FIFO_ADDR, ADXL375_FIFO_BYPASS);
+	ADXL375_shadow_flush();
+	ADXL375_shadow_write(ADXL375_FIFO_ADDR, ADXL375_FIFO_TRIGGER | ADXL375_SHOCK_PRETRIGGER);
+	ADXL375_shadow_flush();
 }
\ No newline at end of file
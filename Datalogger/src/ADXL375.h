@@ -10,32 +10,65 @@
 void configure_ADXL375(void);
 void ADXL375_begin_sampling(void);
 void ADXL375_end_sampling(void);
-void ADXL375_read_samples(uint8_t* data, uint8_t length);
+uint8_t ADXL375_read_samples(int16_t* data, uint8_t length);
 void ADXL375_ISR_Handler(void);
+void ADXL375_service(void);
 void ADXL375_sample(void);
 void ADXL375_calibrate(void);
 void ADXL375_set_activity_thresh(int8_t threshold, bool x, bool y, bool z);
 void ADXL375_set_inactivity_thresh(int8_t threshold, uint8_t duration, bool x, bool y, bool z);
 void ADXL375_disable_interrupt(uint8_t interrupt_src);
 void ADXL375_enable_interrupt(uint8_t interrupt_src);
+void ADXL375_arm_shock_capture(void);
+void ADXL375_disarm_shock_capture(void);
+void ADXL375_capture_shock(void);
 
 uint8_t ADXL375_inactive_interrupts;
-uint8_t ADXL375_buffer_full_count;
+// Samples read since sampling started, it stops after ADXL375_BURST_SAMPLES
+uint8_t ADXL375_burst_samples;
+// Watermarks serviced too late, the FIFO had overrun and samples were lost
+uint16_t ADXL375_fifo_overruns;
+
+// FIFO drain profiling, cycles are active core cycles from the SysTick cycle counter
+uint32_t ADXL375_drain_cycles;
+uint32_t ADXL375_drain_cycles_max;
+uint16_t ADXL375_drain_bytes;
+uint32_t ADXL375_service_cycles_max;
+// Shock events captured, events lost to a full shock ring are counted as its overruns
+uint16_t ADXL375_shock_events;
+// Register bursts written by the shadow flush
+uint16_t ADXL375_shadow_bursts;
 
 /* Defines for the ADXL375 temperature sensor */
 
 #define ADXL375_ADDR							0x53
 
+// Shock threshold register -- 780 mg per LSB
+#define ADXL375_THRESH_SHOCK_ADDR				0x1D
+
 // Offset registers to ensure that the device is zeroed before operation
 #define ADXL375_OFSX_ADDR						0x1E
 #define ADXL375_OFSY_ADDR						0x1F
 #define ADXL375_OFSZ_ADDR						0x20
+// Data LSBs (49 mg) per offset reg LSB (196 mg)
+#define ADXL375_OFS_SCALE						4
 
 
 // Shock duration register -- Amount of time the shock thresh must be me to recognize as a shock event
 #define ADXL375_DUR_ADDR						0x21
 #define ADXL375_DUR_DISABLE_SHOCK				0x00
 
+// Shock axes control reg -- which axes take part in shock detection
+#define ADXL375_SHOCK_AXES_ADDR					0x2A
+#define ADXL375_SHOCK_AXES_SUPPRESS				0x08
+#define ADXL375_SHOCK_AXES_X_EN					0x04
+#define ADXL375_SHOCK_AXES_Y_EN					0x02
+#define ADXL375_SHOCK_AXES_Z_EN					0x01
+
+// Shock status reg -- the axes that took part in the last shock
+#define ADXL375_ACT_SHOCK_STATUS_ADDR			0x2B
+#define ADXL375_ACT_SHOCK_STATUS_SHOCK_AXES		0x07
+
 // Active inactive thresh regs -- Values for the shock to be above and below for active/inactive to be met
 #define ADXL375_THRESH_ACT_ADDR					0x24
 #define ADXL375_THRESH_INACT_ADDR				0x25
@@ -70,6 +103,10 @@ uint8_t ADXL375_buffer_full_count;
 #define ADXL375_BW_RATE_ADDR					0x2C
 #define ADXL375_BW_RATE_LOW_PWR					0x10
 #define ADXL375_BW_RATE_ONE_TENTH				0x00
+#define ADXL375_BW_RATE_12_5HZ					0x07
+#define ADXL375_BW_RATE_800HZ					0x0D
+#define ADXL375_BW_RATE_1600HZ					0x0E
+#define ADXL375_BW_RATE_3200HZ					0x0F
 
 
 // INT_MAP Interrupt Mapping Register
@@ -115,9 +152,20 @@ uint8_t ADXL375_buffer_full_count;
 #define ADXL375_FIFO_FIFO						0x40
 #define ADXL375_FIFO_STREAM						0x80
 #define ADXL375_FIFO_TRIGGER					0xC0
+// Trigger mode trigger source, clear for INT1
+#define ADXL375_FIFO_TRIGGER_INT2				0x20
+#define ADXL375_FIFO_SAMPLES					0x1F
 
 // FIFO status
 #define ADXL375_FIFO_STATUS_ADDR				0x39
+#define ADXL375_FIFO_STATUS_ENTRIES				0x3F
+#define ADXL375_FIFO_STATUS_TRIGGERED			0x80
+#define ADXL375_FIFO_DEPTH						32
+// Watermark level. The 8 entries above it are 640 ms at 12.5 Hz for the main loop to get to the
+// watermark before the FIFO overruns, longer than the 241 ms ADT7420 conversion wait (test_offload)
+#define ADXL375_FIFO_WATERMARK					24
+// Samples taken per burst of movement, 5.12 s at 12.5 Hz
+#define ADXL375_BURST_SAMPLES					64
 
 // Data regs
 #define ADXL375_DATAX0							0x32
@@ -126,6 +174,35 @@ uint8_t ADXL375_buffer_full_count;
 #define ADXL375_DATAY1							0x35
 #define ADXL375_DATAZ0							0x36
 #define ADXL375_DATAZ1							0x37
+// One FIFO entry, DATAX0 to DATAZ1
+#define ADXL375_SAMPLE_SIZE						6
+// Bus bytes per register read transaction: address+W, register pointer, address+R
+#define ADXL375_READ_OVERHEAD					3
+
+// Shock capture -- the part samples at a high rate in FIFO trigger mode, so its FIFO
+// holds the samples before a shock, and fills up with the samples after it
+#define ADXL375_SHOCK_RATE						ADXL375_BW_RATE_800HZ
+#define ADXL375_SHOCK_RATE_HZ					800
+// Samples kept from before the shock, the rest of the FIFO is filled after it
+#define ADXL375_SHOCK_PRETRIGGER				16
+// 50 g
+#define ADXL375_SHOCK_THRESHOLD					64
+// Longest time over the threshold that is still a shock, 10 ms at 625 us per LSB
+#define ADXL375_SHOCK_DURATION					16
+// Seconds shock capture stays armed after a burst of movement. Armed the part draws about
+// 145 uA at 800 Hz, in standby 0.1 uA, so it is only kept up while a shock is likely
+#define ADXL375_SHOCK_WINDOW					60
+#define ADXL375_SHOCK_WINDOW_SLACK				5
+
+// Register shadow -- THRESH_SHOCK to FIFO_CTL are kept in RAM, changes are written back in bursts
+#define ADXL375_SHADOW_FIRST					ADXL375_THRESH_SHOCK_ADDR
+#define ADXL375_SHADOW_LAST						ADXL375_FIFO_ADDR
+#define ADXL375_SHADOW_SIZE						(ADXL375_SHADOW_LAST - ADXL375_SHADOW_FIRST + 1)
+// Bit n set if ADXL375_SHADOW_FIRST + n may be written: 0x1D-0x27, 0x2A, 0x2C-0x2F, 0x31 and 0x38.
+// Status, data and reserved registers split the bursts
+#define ADXL375_SHADOW_WRITABLE					0x0817A7FFUL
+// Most separate bursts a flush can need, one per writable run
+#define ADXL375_SHADOW_RUNS						5
 
 // Interrupt pin
 #define ADXL375_INT_PIN							PIN_PA16
@@ -0,0 +1,38 @@
+/************************************************************************/
+/* @file checksum.h
+/* @brief contains the CRC-32 checksum service prototype declarations
+/************************************************************************/
+
+#ifndef CHECKSUM_H_
+#define CHECKSUM_H_
+
+#include <asf.h>
+
+/* Checksum defines */
+// CRC-32 (IEEE 802.3, the zlib one). Start with the seed, run the data through checksum_update and
+// invert the result, checksum_crc32 does all three
+#define CHECKSUM_SEED		0xFFFFFFFFUL
+#define CHECKSUM_SIZE		4
+// Set to 0 to compute the CRC in software only. The DSU is only there on the target, the host
+// tests build it against a model by defining CHECKSUM_DSU themselves
+#ifndef CHECKSUM_DSU
+#ifdef __arm__
+#define CHECKSUM_DSU		1
+#else
+#define CHECKSUM_DSU		0
+#endif
+#endif
+// Shorter runs are done in software, starting the DSU costs more than it saves
+#define CHECKSUM_DSU_MIN	16
+
+// Active cycles and length of the last checksum_update, for comparing the DSU with the software CRC
+uint32_t checksum_cycles;
+uint32_t checksum_bytes;
+
+/* Checksum prototype definitions */
+void configure_checksum(void);
+uint32_t checksum_update(uint32_t crc, const void * data, uint32_t length);
+uint32_t checksum_software(uint32_t crc, const void * data, uint32_t length);
+uint32_t checksum_crc32(const void * data, uint32_t length);
+
+#endif /* CHECKSUM_H_ */
@@ -0,0 +1,284 @@
+/************************************************************************/
+/* @file Codec.c
+/* @brief Lossless sample codecs for the record payloads
+/************************************************************************/
+
+#include <asf.h>
+#include "HAL.h"
+
+/************************************************************************/
+/* @brief bit_writer packs values MSB first into a byte buffer
+/************************************************************************/
+struct bit_writer {
+	uint8_t * out;
+	uint16_t length;
+	uint32_t accumulator;
+	uint8_t count;
+};
+
+/************************************************************************/
+/* @brief bits_put appends the low width bits of value
+/* @params[in] writer the bit writer
+/* @params[in] value the value to write
+/* @params[in] width the number of bits, at most 24
+/* @returns none
+/************************************************************************/
+static void bits_put(struct bit_writer * writer, uint32_t value, uint8_t width)
+{
+	// Fewer than 8 bits are ever left over, so 24 more never overflow the accumulator
+	writer->accumulator = (writer->accumulator << width) | (value & ((1UL << width) - 1));
+	writer->count += width;
+	while(writer->count >= 8){
+		writer->count -= 8;
+		writer->out[writer->length++] = writer->accumulator >> writer->count;
+	}
+}
+
+/************************************************************************/
+/* @brief bits_flush writes out a partial last byte, padded with zeros
+/* @params[in] writer the bit writer
+/* @returns none
+/************************************************************************/
+static void bits_flush(struct bit_writer * writer)
+{
+	if(writer->count){
+		writer->out[writer->length++] = writer->accumulator << (8 - writer->count);
+		writer->count = 0;
+	}
+}
+
+/************************************************************************/
+/* @brief zigzag16 maps a signed delta to an unsigned value so small deltas of
+/* either sign get small codes (0, -1, 1, -2 ... -> 0, 1, 2, 3 ...)
+/* @params[in] value the signed value
+/* @returns the zigzag code
+/************************************************************************/
+static uint16_t zigzag16(int16_t value)
+{
+	return ((uint16_t)value << 1) ^ (uint16_t)(value >> 15);
+}
+
+/************************************************************************/
+/* @brief temperature_encode packs ADT7420 readings (RECORD_ENCODING_S16_DELTA_PACKED):
+/*   count        1 byte
+/*   shift        1 byte, trailing zero bits shared by every delta (3 for 13 bit readings)
+/*   first        2 bytes, the first sample little endian
+/*   groups       for every TEMPERATURE_CODEC_GROUP deltas (the last group may be short):
+/*                a 4 bit width code (0-14 bits, 15 means 16 bits) then each zigzag
+/*                coded delta >> shift in that many bits, MSB first, zero padded at the end
+/* A slowly changing core temperature has deltas of 0 or +-1 LSB, which costs at
+/* most 2.5 bits per sample, and 0.5 bits when it holds steady, plus the 4 byte
+/* header and the padding of each record. bench_codec checks both.
+/* @params[in] samples the readings
+/* @params[in] count the number of readings, at most TEMPERATURE_CODEC_MAX_SAMPLES
+/* @params[out] out room for RECORD_MAX_PAYLOAD bytes
+/* @returns the number of bytes written
+/************************************************************************/
+uint8_t temperature_encode(const int16_t * samples, uint8_t count, uint8_t * out)
+{
+	struct bit_writer writer = {out, 0, 0, 0};
+	uint16_t deltas[TEMPERATURE_CODEC_GROUP];
+	uint16_t common = 0, largest;
+	uint8_t shift = 0, width, group;
+	
+	if(!count) return 0;
+	
+	// Readings in 13 bit mode step by 8, don't spend bits on the always zero LSBs
+	for(uint8_t i = 1; i < count; i++){
+		common |= (uint16_t)(samples[i] - samples[i-1]);
+	}
+	while(common && !(common & (1 << shift))) shift++;
+	
+	out[writer.length++] = count;
+	out[writer.length++] = shift;
+	out[writer.length++] = samples[0] & 0xFF;
+	out[writer.length++] = samples[0] >> 8 & 0xFF;
+	
+	for(uint8_t i = 1; i < count; i += group){
+		group = (count - i < TEMPERATURE_CODEC_GROUP) ? count - i : TEMPERATURE_CODEC_GROUP;
+		largest = 0;
+		for(uint8_t j = 0; j < group; j++){
+			deltas[j] = zigzag16((int16_t)(samples[i+j] - samples[i+j-1]) >> shift);
+			largest |= deltas[j];
+		}
+		width = 0;
+		while(width < 16 && (largest >> width)) width++;
+		// 15 bit deltas are stored in 16 bits to keep the code in a nibble
+		if(width == 15) width = 16;
+		bits_put(&writer, (width == 16) ? 15 : width, 4);
+		for(uint8_t j = 0; j < group; j++){
+			bits_put(&writer, deltas[j], width);
+		}
+	}
+	bits_flush(&writer);
+	
+	return writer.length;
+}
+
+/************************************************************************/
+/* @brief rice_parameter picks the Rice parameter for a block, about log2 of the mean code
+/* @params[in] codes the zigzag codes
+/* @params[in] count the number of codes
+/* @returns the Rice parameter, 0 to 15
+/************************************************************************/
+static uint8_t rice_parameter(const uint16_t * codes, uint8_t count)
+{
+	uint32_t sum = 0;
+	uint8_t k = 0;
+	
+	for(uint8_t i = 0; i < count; i++) sum += codes[i];
+	while(k < 15 && ((uint32_t)count << (k + 1)) <= sum) k++;
+	
+	return k;
+}
+
+/************************************************************************/
+/* @brief rice_cost gives the exact number of bits rice_put will write for a block
+/* @params[in] codes the zigzag codes
+/* @params[in] count the number of codes
+/* @params[in] k the Rice parameter
+/* @returns the number of bits
+/************************************************************************/
+static uint16_t rice_cost(const uint16_t * codes, uint8_t count, uint8_t k)
+{
+	uint16_t bits = 0;
+	uint16_t quotient;
+	
+	for(uint8_t i = 0; i < count; i++){
+		quotient = codes[i] >> k;
+		bits += (quotient < ACCEL_CODEC_ESCAPE) ? quotient + 1 + k : ACCEL_CODEC_ESCAPE + 16;
+	}
+	
+	return bits;
+}
+
+/************************************************************************/
+/* @brief rice_put writes a Rice code: the quotient in unary (ones ended by a zero)
+/* then the k low bits. Quotients of ACCEL_CODEC_ESCAPE or more are written as
+/* ACCEL_CODEC_ESCAPE ones and the code in 16 bits.
+/* @params[in] writer the bit writer
+/* @params[in] code the zigzag code
+/* @params[in] k the Rice parameter
+/* @returns none
+/************************************************************************/
+static void rice_put(struct bit_writer * writer, uint16_t code, uint8_t k)
+{
+	uint16_t quotient = code >> k;
+	
+	if(quotient < ACCEL_CODEC_ESCAPE){
+		bits_put(writer, ((1UL << quotient) - 1) << 1, quotient + 1);
+		bits_put(writer, code, k);
+	}else{
+		bits_put(writer, (1UL << ACCEL_CODEC_ESCAPE) - 1, ACCEL_CODEC_ESCAPE);
+		bits_put(writer, code, 16);
+	}
+}
+
+/************************************************************************/
+/* @brief accel_encode packs x, y, z samples (RECORD_ENCODING_S16X3_RICE):
+/*   count        1 byte, samples in the record
+/*   first        6 bytes, the first x, y, z little endian
+/*   blocks       for every ACCEL_CODEC_BLOCK samples (the last block may be short),
+/*                for x, then y, then z: a 4 bit Rice parameter k then the Rice code
+/*                of each zigzag coded delta from the previous sample on that axis.
+/*                MSB first, zero padded at the end.
+/* The parameter follows the activity of each block, so a resting animal costs
+/* 1-3 bits per axis and a running one only what its deltas need. Vigorous movement
+/* costs more than the old clipped 8 bit samples: about 25.6 bits per sample for a
+/* 4 g run in bench_codec, 27.2 with the record, against 24 and 25.1. A raw escape
+/* would not help, the full 13 bits take 39 bits per sample. A block that
+/* doesn't fit is halved until it does and ends the record, so a record may hold
+/* fewer than count samples.
+/* @params[in] samples x, y, z per sample
+/* @params[in] count the number of samples
+/* @params[out] out room for capacity bytes
+/* @params[in] capacity the space in out, at least 7 bytes
+/* @params[out] encoded the number of samples that fit
+/* @returns the number of bytes written
+/************************************************************************/
+uint8_t accel_encode(const int16_t * samples, uint8_t count, uint8_t * out, uint8_t capacity, uint8_t * encoded)
+{
+	struct bit_writer writer = {out, 0, 0, 0};
+	uint16_t codes[ACCEL_AXES][ACCEL_CODEC_BLOCK];
+	uint8_t k[ACCEL_AXES];
+	uint16_t bits;
+	uint8_t block, done = 1;
+	bool shrunk = false;
+	
+	*encoded = 0;
+	if(!count) return 0;
+	
+	writer.length = 1;
+	for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+		out[writer.length++] = samples[axis] & 0xFF;
+		out[writer.length++] = samples[axis] >> 8 & 0xFF;
+	}
+	
+	while(done < count){
+		block = (count - done < ACCEL_CODEC_BLOCK) ? count - done : ACCEL_CODEC_BLOCK;
+		for(uint8_t i = 0; i < block; i++){
+			for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+				const int16_t * sample = &samples[(done + i) * ACCEL_AXES + axis];
+				codes[axis][i] = zigzag16(sample[0] - sample[-ACCEL_AXES]);
+			}
+		}
+		// Shrink the block until it fits the space left
+		for(;;){
+			bits = 0;
+			for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+				k[axis] = rice_parameter(codes[axis], block);
+				bits += 4 + rice_cost(codes[axis], block, k[axis]);
+			}
+			if(8UL * writer.length + writer.count + bits <= 8UL * capacity) break;
+			block /= 2;
+			shrunk = true;
+			if(!block) break;
+		}
+		if(!block) break;
+		
+		for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+			bits_put(&writer, k[axis], 4);
+			for(uint8_t i = 0; i < block; i++){
+				rice_put(&writer, codes[axis][i], k[axis]);
+			}
+		}
+		done += block;
+		// Readers size every block from the count, so a shrunk block has to be the last
+		if(shrunk) break;
+	}
+	bits_flush(&writer);
+	
+	out[0] = done;
+	*encoded = done;
+	
+	return writer.length;
+}
+
+/************************************************************************/
+/* @brief shock_encode packs a shock event (RECORD_ENCODING_SHOCK_S16X3):
+/*   rate         1 byte, ADXL375 BW_RATE code
+/*   pretrigger   1 byte, samples before the shock
+/*   axes         1 byte, ACT_SHOCK_STATUS shock axes
+/*   count        1 byte, samples
+/*   samples      count x 6 bytes, x, y, z little endian
+/* The samples are stored raw so an event always fits one record (196 bytes for
+/* a full FIFO) whatever the shock looks like.
+/* @params[in] shock the shock event
+/* @params[out] out room for 4 + 6 * ADXL375_FIFO_DEPTH bytes
+/* @returns the number of bytes written
+/************************************************************************/
+uint8_t shock_encode(const struct shock_event * shock, uint8_t * out)
+{
+	uint8_t length = 0;
+	
+	out[length++] = shock->rate;
+	out[length++] = shock->pretrigger;
+	out[length++] = shock->axes;
+	out[length++] = shock->count;
+	for(uint8_t i = 0; i < shock->count * ACCEL_AXES; i++){
+		out[length++] = shock->samples[i] >> 0 & 0xFF;
+		out[length++] = shock->samples[i] >> 8 & 0xFF;
+	}
+	
+	return length;
+}
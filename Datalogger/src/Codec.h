@@ -0,0 +1,33 @@
+/************************************************************************/
+/* @file codec.h
+/* @brief contains the sample codec defines and prototype declarations
+/************************************************************************/
+
+#ifndef CODEC_H_
+#define CODEC_H_
+
+#include <asf.h>
+
+/* Temperature codec defines */
+// Deltas sharing one width code
+#define TEMPERATURE_CODEC_GROUP			8
+// Most samples whose worst case encoding (16 bit deltas) still fits one record payload
+#define TEMPERATURE_CODEC_MAX_SAMPLES	120
+
+/* Accelerometer codec defines */
+// Samples sharing one Rice parameter per axis, one FIFO's worth
+#define ACCEL_CODEC_BLOCK				32
+// Most samples offered to one record, half the accelerometer ring
+#define ACCEL_CODEC_MAX_SAMPLES			64
+// Quotients this long are replaced by the raw 16 bit zigzag code
+#define ACCEL_CODEC_ESCAPE				16
+
+/* Codec prototype definitions */
+// Defined in hal.h with the other buffered data
+struct shock_event;
+
+uint8_t temperature_encode(const int16_t * samples, uint8_t count, uint8_t * out);
+uint8_t accel_encode(const int16_t * samples, uint8_t count, uint8_t * out, uint8_t capacity, uint8_t * encoded);
+uint8_t shock_encode(const struct shock_event * shock, uint8_t * out);
+
+#endif /* CODEC_H_ */
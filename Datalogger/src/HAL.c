@@ -4,15 +4,23 @@
 /************************************************************************/
 #include "HAL.h"
 #include <asf.h>
+#include <string.h>
 
 /************************************************************************/
 /* @brief sleep function to replace the general system_sleep function
 /* This function is necessary to fix the errata for the part upon wakeup and sleep every time
+/* Interrupts are masked around the sleep, the wake fixes are applied before the waking ISR runs,
+/* and the part doesn't sleep at all if deferred work is already queued.
 /* @params none
 /* @returns none
 /************************************************************************/
 void sleep(void)
 {
+	irqflags_t flags = cpu_irq_save();
+	if(work_pending()){
+		cpu_irq_restore(flags);
+		return;
+	}
 	/* Errata 13901 fix */
 	SUPC->VREF.reg |= (1 << 8);
 	SUPC->VREG.bit.SEL = 0;
@@ -21,8 +29,14 @@ void sleep(void)
 	// Make sure the DFLL and DPLL are shut off before entering sleep mode again
 	system_clock_source_disable(SYSTEM_CLOCK_SOURCE_DFLL);
 	system_clock_source_disable(SYSTEM_CLOCK_SOURCE_DPLL);
-	// Put the part in sleep mode
+	// Put the part in sleep mode, a pending interrupt still wakes it
 	system_sleep();
+	/* Errata 13901 fix */
+	SUPC->VREF.reg &= ~(1 << 8);
+	SUPC->VREG.bit.SEL = 1;
+	/* Errata 14539 fix */
+	GCLK->GENCTRL->bit.SRC = SYSTEM_CLOCK_SOURCE_OSC16M;
+	cpu_irq_restore(flags);
 }
 
 /************************************************************************/
@@ -72,17 +86,9 @@ void configure_rtc(void)
     /* Initialize RTC in calendar mode. */
     struct rtc_calendar_config config_rtc_calendar;
     rtc_calendar_get_config_defaults(&config_rtc_calendar);
-	// Alarm time for first time based interrupt
-    alarm.time.year = 2015;
-    alarm.time.month = 11;
-    alarm.time.day = 2;
-    alarm.time.hour = 19;
-    alarm.time.minute = 31;
-    alarm.time.second = 00;
-	// Configure 24 hour clock mode, set the alarm, and use a grainularity of seconds
+	// Configure 24 hour clock mode. The alarm stays off until the scheduler sets the first wake
     config_rtc_calendar.clock_24h = true;
-    config_rtc_calendar.alarm[0].time = alarm.time;
-    config_rtc_calendar.alarm[0].mask = RTC_CALENDAR_ALARM_MASK_SEC;
+    config_rtc_calendar.alarm[0].mask = RTC_CALENDAR_ALARM_MASK_DISABLED;
     rtc_calendar_init(&rtc_instance, RTC, &config_rtc_calendar);
     rtc_calendar_enable(&rtc_instance);
     /* Set current time. */
@@ -119,26 +125,48 @@ void configure_rtc(void)
 /************************************************************************/
 void rtc_match_callback(void)
 {
-	struct rtc_calendar_time stCurrent_time;
-	/* Errata 13901 fix */
-	SUPC->VREF.reg &= ~(1 << 8);
-	SUPC->VREG.bit.SEL = 1;
-	/* Errata 14539 fix */
-	GCLK->GENCTRL->bit.SRC = SYSTEM_CLOCK_SOURCE_OSC16M;
-	
+	// The wake errata fixes are applied by sleep(), the due tasks run from the main loop and set the next alarm
+	work_post(schedule_service);
+}
+
+/************************************************************************/
+/* @brief temperature_task takes a temperature reading. The interval to the
+/* next reading follows the mode the reading leaves us in
+/* @params none
+/* @returns none
+/************************************************************************/
+static void temperature_task(void)
+{
 	ADT7420_read_temp();
+	schedule_set_period(SCHEDULE_TEMPERATURE, (ucActiveInactive_Mode == INACTIVE_MODE) ? TEMPERATURE_PERIOD_INACTIVE : TEMPERATURE_PERIOD_ACTIVE);
+}
+
+/************************************************************************/
+/* @brief offload_check_task writes out whatever is buffered, so a slow trickle of
+/* samples does not sit in RAM for days waiting for a ring to fill half way
+/* @params none
+/* @returns none
+/************************************************************************/
+static void offload_check_task(void)
+{
+	offload_data();
+}
+
+/************************************************************************/
+/* @brief configure_tasks starts the periodic tasks on the scheduler. The first
+/* temperature reading is taken straight away and sets the mode. Call after
+/* configure_rtc, configure_ADT7420 and configure_databuffers
+/* @params none
+/* @returns none
+/************************************************************************/
+void configure_tasks(void)
+{
+	uint32_t now;
 	
-	// Set a new alarm for the interval depending on what mode we are in
-	// This method is according to the Atmel App note AT03266
-	if(ucActiveInactive_Mode == INACTIVE_MODE){
-		// Inactive mode
-		alarm.time.hour += 2;
-		alarm.time.hour %= 24;
-	}else{
-		// Active mode
-		alarm.time.minute += 20;
-		alarm.time.minute %= 60;
-	}
+	configure_schedule();
+	now = schedule_now();
+	schedule_at(SCHEDULE_TEMPERATURE, now, TEMPERATURE_PERIOD_ACTIVE, TEMPERATURE_SLACK, temperature_task);
+	schedule_at(SCHEDULE_OFFLOAD_CHECK, now + OFFLOAD_CHECK_PERIOD, OFFLOAD_CHECK_PERIOD, OFFLOAD_CHECK_SLACK, offload_check_task);
 }
 
 /************************************************************************/
@@ -155,10 +183,14 @@ void configure_i2c(void)
 	config_i2c_master.baud_rate = I2C_MASTER_BAUD_RATE_100KHZ;
 	config_i2c_master.pinmux_pad0 =  PINMUX_PA22C_SERCOM3_PAD0;
 	config_i2c_master.pinmux_pad1 =  PINMUX_PA23C_SERCOM3_PAD1;
+	/* A stuck slave holding SCL low ends the transaction with an error instead of hanging the engine */
+	config_i2c_master.scl_low_timeout = true;
 	
 	/* Initialize and enable device with config */
 	i2c_master_init(&i2c_master_instance, SERCOM3, &config_i2c_master);
 	i2c_master_enable(&i2c_master_instance);
+	/* Transactions are run by the interrupt driven engine from here on */
+	configure_I2C_engine();
 	
 }
 
@@ -207,31 +239,6 @@ void configure_mag_sw_int(void (*callback)(void))
 
 }
 
-/************************************************************************/
-/* @brief Initializes the accelerometer and temperature data buffers
-/* Only call at the start of execution, otherwise data will be lost
-/* @params none
-/* @returns none
-/************************************************************************/
-void configure_databuffers(void)
-{
-	// Configure the buffers and their pointers
-	ucTemperatureArrayPtr = 0;
-	uiAccelerometerMatrixPtr = 0;
-	ucTemperatureDataSets = 0;
-	uiAccelerometerDataSets = 0;
-	// Set the first element of the data set pointer vector to be 0 (the 0th element is where the first data set starts)
-	cTemperatureDataSetPtr[ucTemperatureDataSets] = ucTemperatureArrayPtr;
-	iAccelerometerDataSetPtr[uiAccelerometerDataSets] = ucAccelerometerMatrix;
-	// Set all the rest of the elements of the data set pointer vectors to be -1 (-1 represents unused)
-	for(int i = 1; i < TEMP_BUFFER_SIZE; i++){
-		cTemperatureDataSetPtr[i] = -1;
-	}
-	for(int i = 1; i < ACCEL_BUFFER_SIZE; i++){
-		iAccelerometerDataSetPtr[i] = -1;
-	}
-}
-
 /************************************************************************/
 /* @brief get_timestamp get the system timestamp in seconds since 2000
 /* @params ucTimestampVector vector that will contain the timestamp
@@ -252,134 +259,130 @@ void get_timestamp(uint8_t * ucTimestampVector)
 }
 
 /************************************************************************/
-/* @brief offload_data moves buffered temperature and acceleration
-/* data to off-chip memory
-/* @params none
+/* @brief wait_ticks runs the wait timer once and sleeps until it expires
+/* The timer interrupt is left masked and its flag is polled, a pending interrupt
+/* still wakes the core so this is safe to call from critical sections and ISRs.
+/* @params[in] generator the GCLK generator that clocks the timer
+/* @params[in] prescaler the timer prescaler
+/* @params[in] ticks the number of timer ticks to wait
+/* @params[in] sleepmode the sleep mode to wait in (IDLE or STANDBY)
 /* @returns none
 /************************************************************************/
-void offload_data(void)
-{	
-	cpu_irq_enter_critical();
-	uint8_t ucHeaderSize = 2 + 4*(ucTemperatureDataSets + uiAccelerometerDataSets);
-	uint8_t header[ucHeaderSize];
-	uint8_t ucHeaderIndex = 0, ucDataIndex = 0;
-	header[ucHeaderIndex++] = ucHeaderSize;
-	header[ucHeaderIndex++] = ucTemperatureDataSets + uiAccelerometerDataSets;
-	// Using these for loops is a bit overkill, but it shows more clearly that the upper nibble and lower nibble are
-	//		separate fields.
-	// Fill in the descriptors the temperature data sets
-	for(ucDataIndex = 0; ucDataIndex < ucTemperatureDataSets - 1; ucDataIndex+=2){
-		header[ucHeaderIndex++] = LNIBBLE(TEMPERATURE_DESCRIPTOR) | UNIBBLE(TEMPERATURE_DESCRIPTOR << 4);
-	}
-	// If there are an uneven number of temperature data sets, then we need to put one temp descriptor with one accel descriptor
-	ucDataIndex = 0;
-	if(ucTemperatureDataSets % 2){
-		header[ucHeaderIndex++] = LNIBBLE(TEMPERATURE_DESCRIPTOR) | UNIBBLE(ACCEL_DESCRIPTOR << 4);
-		ucDataIndex = 1;
-	}
-	// Fill in the accel descriptors
-	for(ucDataIndex; ucDataIndex < uiAccelerometerDataSets - 1; ucDataIndex+=2){
-		header[ucHeaderIndex++] = LNIBBLE(ACCEL_DESCRIPTOR) | UNIBBLE(ACCEL_DESCRIPTOR << 4);
-	}
-	// If there is an uneven number of datasets for accel, then we need to put the lower nibble in as an accel descriptor
-	if(ucTemperatureDataSets % 2){
-		header[ucHeaderIndex++] = LNIBBLE(ACCEL_DESCRIPTOR);
-	}
-	// Fill in the data set lengths
-	for(ucDataIndex = 0; ucDataIndex < ucTemperatureDataSets - 1; ucDataIndex++){
-		header[ucHeaderIndex++] = cTemperatureDataSetPtr[ucHeaderIndex + 1] - cTemperatureDataSetPtr[ucHeaderIndex];
-	}
-	// Fill in the data set lengths
-	for(ucDataIndex = 0; ucDataIndex < uiAccelerometerDataSets - 1; ucDataIndex++){
-		header[ucHeaderIndex++] = iAccelerometerDataSetPtr[ucHeaderIndex + 1] - iAccelerometerDataSetPtr[ucHeaderIndex];
-	}
-	// Fill in the data lengths, we are assuming 8 bits each
-	for(ucDataIndex = 0; ucDataIndex < ucTemperatureDataSets - 1; ucDataIndex++){
-		header[ucHeaderIndex++] = 8;
-	}
-	for(ucDataIndex = 0; ucDataIndex < uiAccelerometerDataSets - 1; ucDataIndex++){
-		header[ucHeaderIndex++] = 8;
+static void wait_ticks(enum gclk_generator generator, enum tc_clock_prescaler prescaler, uint16_t ticks, enum system_sleepmode sleepmode)
+{
+	irqflags_t flags;
+	if(!ticks) return;
+	
+	// One-shot, counts up to CC0 and stops
+	tc_get_config_defaults(&config_tc);
+	config_tc.clock_source = generator;
+	config_tc.clock_prescaler = prescaler;
+	config_tc.counter_size = TC_COUNTER_SIZE_16BIT;
+	config_tc.wave_generation = TC_WAVE_GENERATION_MATCH_FREQ;
+	config_tc.oneshot = true;
+	config_tc.run_in_standby = true;
+	config_tc.counter_16_bit.compare_capture_channel[TC_COMPARE_CAPTURE_CHANNEL_0] = ticks;
+	tc_init(&tc_instance_cap, WAIT_TC, &config_tc);
+	
+	flags = cpu_irq_save();
+	WAIT_TC->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+	WAIT_TC->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+	NVIC_EnableIRQ(WAIT_TC_IRQn);
+	system_set_sleepmode(sleepmode);
+	if(sleepmode == SYSTEM_SLEEPMODE_STANDBY){
+		/* Errata 13901 fix */
+		SUPC->VREF.reg |= (1 << 8);
+		SUPC->VREG.bit.SEL = 0;
+		/* Errata 14539 fix */
+		GCLK->GENCTRL->bit.SRC = SYSTEM_CLOCK_SOURCE_ULP32K;
 	}
-	// Write the header
-	for(int i = 0; i < ucHeaderSize; i++)
-	{
-		// If we are at the end of the die, then switch die and reset the address pointer
-		// If we hit the end of the second die, then we restart at the beginning of the first dei
-		if(S70FL01_address >= S70FL01_MAX_ADDR){
-			S70FL01_active_die++;
-			S70FL01_active_die %= 2;
-			S70FL01_address = 0;
-	 	}
-		S70FL01_verified_write(header[i], S70FL01_active_die, S70FL01_address++);
+	tc_enable(&tc_instance_cap);
+	
+	while(!(WAIT_TC->COUNT16.INTFLAG.reg & TC_INTFLAG_MC0)){
+		system_sleep();
 	}
-	// TODO change to the new format
 	
-	// Loop over all the data sets in the temperature data
-	for(int i = 0, ucDataIndex = 0; i < ucTemperatureDataSets - 1; i++){
-		// Check that the memory is not full
-		if(S70FL01_address >= S70FL01_MAX_ADDR){
-			S70FL01_active_die++;
-			S70FL01_active_die %= 2;
-			S70FL01_address = 0;
-		}
-		// We have reached the end of actual data
-		if(cTemperatureDataSetPtr[i] < 0){
-			break;
-		}
-		// Write the timestamps
-		S70FL01_verified_write(ucTemperatureTimestamps[i+0], S70FL01_active_die, S70FL01_address++);
-		S70FL01_verified_write(ucTemperatureTimestamps[i+1], S70FL01_active_die, S70FL01_address++);
-		S70FL01_verified_write(ucTemperatureTimestamps[i+2], S70FL01_active_die, S70FL01_address++);
-		S70FL01_verified_write(ucTemperatureTimestamps[i+3], S70FL01_active_die, S70FL01_address++);
-		// Iterate over each block of data
-		for(int j = cTemperatureDataSetPtr[i]; j < cTemperatureDataSetPtr[i] - cTemperatureDataSetPtr[i+1]; j++){
-			// Check that the memory is not full
-			if(S70FL01_address >= S70FL01_MAX_ADDR){
-				S70FL01_active_die++;
-				S70FL01_active_die %= 2;
-				S70FL01_address = 0;
-			}
-			// If we are at the first point, write the entire data point
-			if(j == 0 || j == cTemperatureDataSetPtr[i]){
-				S70FL01_verified_write(uiTemperatureArray[j] >> 0x00 & 0xFF, S70FL01_active_die, S70FL01_address++);
-				S70FL01_verified_write(uiTemperatureArray[j] >> 0x08 & 0xFF, S70FL01_active_die, S70FL01_address++);
-			}
-			// Otherwise delta encode and write
-			else{
-				S70FL01_verified_write((uiTemperatureArray[j] - uiTemperatureArray[j-1]) >> 0x08 & 0xFF, S70FL01_active_die, S70FL01_address++);
-			}
-		}
+	if(sleepmode == SYSTEM_SLEEPMODE_STANDBY){
+		/* Errata 13901 fix */
+		SUPC->VREF.reg &= ~(1 << 8);
+		SUPC->VREG.bit.SEL = 1;
+		/* Errata 14539 fix */
+		GCLK->GENCTRL->bit.SRC = SYSTEM_CLOCK_SOURCE_OSC16M;
 	}
-	// Loop over all the data sets in the accel data
-	for(int i = 0, ucDataIndex = 0; i < uiAccelerometerDataSets - 1; i++){
-		// Check that the memory is not full
-		if(S70FL01_address >= S70FL01_MAX_ADDR){
-			S70FL01_active_die++;
-			S70FL01_active_die %= 2;
-			S70FL01_address = 0;
-		}
-		if(iAccelerometerDataSetPtr[i] < 0){
-			break;
-		}
-		S70FL01_verified_write(ucAccelTimestamps[i+0], S70FL01_active_die, S70FL01_address++);
-		S70FL01_verified_write(ucAccelTimestamps[i+1], S70FL01_active_die, S70FL01_address++);
-		S70FL01_verified_write(ucAccelTimestamps[i+2], S70FL01_active_die, S70FL01_address++);
-		S70FL01_verified_write(ucAccelTimestamps[i+3], S70FL01_active_die, S70FL01_address++);
-		// Iterate over each block of data
-		for(int j = iAccelerometerDataSetPtr[i]; j < iAccelerometerDataSetPtr[i] - iAccelerometerDataSetPtr[i+1]; j++){
-			// Check that the memory is not full
-			if(S70FL01_address >= S70FL01_MAX_ADDR){
-				S70FL01_active_die++;
-				S70FL01_active_die %= 2;
-				S70FL01_address = 0;
-			}
-			// We are already only storing 8 bit numbers for the accel data, so no need for delta encoding
-			S70FL01_verified_write(ucAccelerometerMatrix[j+0], S70FL01_active_die, S70FL01_address++);
-			S70FL01_verified_write(ucAccelerometerMatrix[j+1], S70FL01_active_die, S70FL01_address++);
-			S70FL01_verified_write(ucAccelerometerMatrix[j+2], S70FL01_active_die, S70FL01_address++);			
-		}
+	tc_disable(&tc_instance_cap);
+	WAIT_TC->COUNT16.INTENCLR.reg = TC_INTENCLR_MC0;
+	WAIT_TC->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+	NVIC_ClearPendingIRQ(WAIT_TC_IRQn);
+	// Back to the mode that sleep() expects
+	system_set_sleepmode(SYSTEM_SLEEPMODE_STANDBY);
+	cpu_irq_restore(flags);
+}
+
+/************************************************************************/
+/* @brief wait_us waits for a number of microseconds with the core in IDLE. The
+/* flash power-up loop it replaced kept the core active for an estimated 65 ms,
+/* 65535 iterations at an assumed 4 cycles each, not measured
+/* @params[in] us the number of microseconds to wait
+/* @returns none
+/************************************************************************/
+void wait_us(uint32_t us)
+{
+	// 4 MHz main clock divided by 4 gives 1 us ticks
+	while(us > 0xFFFF){
+		wait_ticks(WAIT_US_GCLK, TC_CLOCK_PRESCALER_DIV4, 0xFFFF, SYSTEM_SLEEPMODE_IDLE);
+		us -= 0xFFFF;
+	}
+	wait_ticks(WAIT_US_GCLK, TC_CLOCK_PRESCALER_DIV4, us, SYSTEM_SLEEPMODE_IDLE);
+}
+
+/************************************************************************/
+/* @brief wait_ms waits for a number of milliseconds with the core in STANDBY.
+/* The loops it replaced kept the core active for an estimated 10 ms each in the
+/* ADT7420 read and 65 ms each between radio commands, on the same assumption
+/* @params[in] ms the number of milliseconds to wait
+/* @returns none
+/************************************************************************/
+void wait_ms(uint32_t ms)
+{
+	// 32.768 kHz ticks, one second is 32768 ticks which fits the 16 bit counter
+	while(ms > 1000){
+		wait_ticks(WAIT_MS_GCLK, TC_CLOCK_PRESCALER_DIV1, 32768, SYSTEM_SLEEPMODE_STANDBY);
+		ms -= 1000;
 	}
-	// Reconfigure the buffers and their pointers
-	configure_databuffers();
-	cpu_irq_leave_critical();	
+	wait_ticks(WAIT_MS_GCLK, TC_CLOCK_PRESCALER_DIV1, (ms * 32768UL + 999) / 1000, SYSTEM_SLEEPMODE_STANDBY);
+}
+
+/************************************************************************/
+/* @brief configure_cycle_counter starts SysTick as a free running cycle counter
+/* for profiling. The SysTick interrupt is not used.
+/* @params none
+/* @returns none
+/************************************************************************/
+void configure_cycle_counter(void)
+{
+	SysTick->LOAD = CYCLE_COUNTER_MASK;
+	SysTick->VAL = 0;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+}
+
+/************************************************************************/
+/* @brief cycle_count reads the cycle counter
+/* @params none
+/* @returns the current counter value, pass it to cycles_since
+/************************************************************************/
+uint32_t cycle_count(void)
+{
+	return SysTick->VAL;
+}
+
+/************************************************************************/
+/* @brief cycles_since gives the active core cycles elapsed since a cycle_count
+/* reading. Intervals longer than 2^24 cycles (about 4 s at 4 MHz) wrap.
+/* @params[in] start the earlier cycle_count reading
+/* @returns the number of elapsed cycles
+/************************************************************************/
+uint32_t cycles_since(uint32_t start)
+{
+	// The counter counts down
+	return (start - SysTick->VAL) & CYCLE_COUNTER_MASK;
 }
\ No newline at end of file
@@ -8,19 +8,54 @@
 
 #include "ADT7420.h"
 #include "ADXL375.h"
+#include "Checksum.h"
+#include "Codec.h"
+#include "I2C.h"
+#include "Offload.h"
+#include "Record.h"
+#include "Ring.h"
+#include "Schedule.h"
+#include "Summary.h"
+#include "WorkQueue.h"
 #include "SP1ML.h"
 #include "S70FL01.h"
 
-#define TEMPERATURE_DESCRIPTOR 0x0
-#define ACCEL_DESCRIPTOR 0x1
-#define LNIBBLE(x) 0x0F & x
-#define UNIBBLE(x) 0xF0 & x
 #define INACTIVE_MODE 1
 #define ACTIVE_MODE 0
 #define STATIONARY_MODE 1
 #define MOTION_MODE 0
-#define ACCEL_BUFFER_SIZE 999
-#define TEMP_BUFFER_SIZE 72
+// Ring capacities in elements, all powers of two
+#define ACCEL_RING_SIZE 128
+#define TEMP_RING_SIZE 64
+#define DATA_SET_RING_SIZE 16
+#define SUMMARY_RING_SIZE 8
+#define SHOCK_RING_SIZE 2
+// x, y, z, each a full resolution 16 bit value
+#define ACCEL_AXES 3
+#define ACCEL_SAMPLE_SIZE (ACCEL_AXES * sizeof(int16_t))
+// Temperature sampling interval in each mode and how late a reading may be taken to share a wake, in seconds
+#define TEMPERATURE_PERIOD_ACTIVE (20 * 60)
+#define TEMPERATURE_PERIOD_INACTIVE (2 * 60 * 60)
+#define TEMPERATURE_SLACK 30
+// Buffered data goes to flash at least this often, even when no ring is half full, in seconds
+#define OFFLOAD_CHECK_PERIOD (6 * 60 * 60)
+#define OFFLOAD_CHECK_SLACK (20 * 60)
+// Set to 1 to start the accelerometer at boot and keep it sampling, for checking the overrun counters on the bench
+#define ACQUISITION_BURST_TEST 0
+// Set to 1 to store per epoch activity summaries instead of every acceleration sample
+#define ACCEL_SUMMARY_MODE 0
+// Set to 1 to wait for shocks at a high rate between bursts of movement, see ADXL375_arm_shock_capture
+#define ACCEL_SHOCK_CAPTURE 0
+// Set to 1 to let the ADT7420 comparator switch active/inactive mode through its INT pin instead of comparing each reading in software
+#define TEMPERATURE_THRESHOLD_INTERRUPT 0
+
+// Wait service timer. GCLK0 (4 MHz) is used for us waits in idle, GCLK3 (XOSC32K, runs in standby) for ms waits in standby
+#define WAIT_TC TC4
+#define WAIT_TC_IRQn TC4_IRQn
+#define WAIT_US_GCLK GCLK_GENERATOR_0
+#define WAIT_MS_GCLK GCLK_GENERATOR_3
+// SysTick free runs at the core clock as a 24 bit down counter. It stops while the core sleeps so it counts active cycles only
+#define CYCLE_COUNTER_MASK 0x00FFFFFF
 
 void configure_i2c(void);
 void configure_mag_sw_int(void (*callback)(void));
@@ -28,9 +63,13 @@ void configure_sleepmode(void);
 void sleep(void);
 void configure_rtc(void);
 void rtc_match_callback(void);
-void offload_data(void);
-void configure_databuffers(void);
+void configure_tasks(void);
 void get_timestamp(uint8_t * ucTimestampVector);
+void wait_us(uint32_t us);
+void wait_ms(uint32_t ms);
+void configure_cycle_counter(void);
+uint32_t cycle_count(void);
+uint32_t cycles_since(uint32_t start);
 
 void extint_callback(void);
 
@@ -44,21 +83,58 @@ uint8_t ucMotion_State;
 
 /*Data buffer Variables*/
 
-// Temperature array
-int16_t uiTemperatureArray[TEMP_BUFFER_SIZE];
-uint8_t ucTemperatureArrayPtr;
-// Allow for up to 1 datapoint data sets as worst case buffer sizes
-int8_t cTemperatureDataSetPtr[TEMP_BUFFER_SIZE];
-uint8_t ucTemperatureTimestamps[TEMP_BUFFER_SIZE * 4];
-uint8_t ucTemperatureDataSets;
-
-// Accelerometer matrix (3 rows per sample x,y,z)
-int8_t ucAccelerometerMatrix[ACCEL_BUFFER_SIZE];
-uint16_t uiAccelerometerMatrixPtr;
-// Allow for up to 1 datapoint data sets
-int16_t iAccelerometerDataSetPtr[ACCEL_BUFFER_SIZE];
-uint8_t ucAccelTimestamps[ACCEL_BUFFER_SIZE * 4];
-uint16_t uiAccelerometerDataSets;
+// A data set starts at a mode switch. start is the sequence number of its first sample in the sample ring
+struct data_set {
+	uint16_t start;
+	uint8_t timestamp[4];
+};
+
+// Each ring has one producer (the deferred sensor handlers) and one consumer (offload_data/offload_step)
+// The rings are used as ping-pong buffers: when one half fills it is swapped out to the storage writer
+// while new samples land in the other half
+// Temperature samples
+struct ring temperature_ring;
+int16_t temperature_samples[TEMP_RING_SIZE];
+struct ring temperature_sets;
+struct data_set temperature_set_buffer[DATA_SET_RING_SIZE];
+
+// Accelerometer samples (6 bytes per sample x,y,z)
+struct ring accel_ring;
+int16_t accel_samples[ACCEL_RING_SIZE * ACCEL_AXES];
+struct ring accel_sets;
+struct data_set accel_set_buffer[DATA_SET_RING_SIZE];
+
+// Activity summary of one epoch, see Summary.c. Acceleration values are in ADXL375 counts
+struct accel_summary {
+	uint8_t timestamp[4];
+	uint16_t samples;
+	int16_t mean[ACCEL_AXES];
+	uint32_t variance[ACCEL_AXES];
+	uint16_t odba;
+	uint16_t vedba;
+	uint16_t peak;
+};
+
+// Activity summaries, used instead of the accelerometer samples in ACCEL_SUMMARY_MODE
+struct ring summary_ring;
+struct accel_summary summary_buffer[SUMMARY_RING_SIZE];
+
+// A captured shock, the FIFO contents around the single shock interrupt
+struct shock_event {
+	uint8_t timestamp[4];
+	// BW_RATE code the samples were taken at
+	uint8_t rate;
+	// Samples before the shock
+	uint8_t pretrigger;
+	// ACT_SHOCK_STATUS axes that took part in the shock
+	uint8_t axes;
+	uint8_t count;
+	int16_t samples[ADXL375_FIFO_DEPTH * ACCEL_AXES];
+};
+
+// Shock events from ADXL375_capture_shock
+struct ring shock_ring;
+struct shock_event shock_buffer[SHOCK_RING_SIZE];
 /*End data buffer variables */
 
 // General status return value used all over the place
@@ -80,16 +156,25 @@ struct usart_config config_usart;
 struct usart_module usart_instance;
 bool usart_enabled;
 
-// Timer Counter for energy monitoring
+// Timer Counter for energy monitoring and the wait service
 struct tc_module tc_instance_cap;
 struct tc_config config_tc;
 
 // RTC Module
 struct rtc_module rtc_instance;
-struct rtc_calendar_alarm_time alarm;
 
 // Memory module
 uint8_t S70FL01_active_die;
 uint32_t S70FL01_address;
+uint32_t S70FL01_die_size;
+// Location of the oldest record still in memory (found by S70FL01_mount)
+uint8_t S70FL01_oldest_die;
+uint32_t S70FL01_oldest_address;
+// Sectors the writer had to erase itself because the erase-ahead had fallen behind
+uint16_t S70FL01_erase_stalls;
+// Failures reported by the P_ERR/E_ERR status flags, and pages read back and found wrong by the verify policy
+uint16_t S70FL01_program_errors;
+uint16_t S70FL01_erase_errors;
+uint16_t S70FL01_verify_failures;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,302 @@
+/************************************************************************/
+/* @file I2C.c
+/* @brief Interrupt driven I2C transaction engine. Transactions are queued as
+/* descriptors and shifted out by the SERCOM3 interrupt so the core can sleep
+/* while the bus runs at 100 kHz. SERCOM3 is set up by configure_i2c() through
+/* the ASF polled driver, this engine only takes over the byte level protocol.
+/************************************************************************/
+
+#include <asf.h>
+#include <string.h>
+#include "HAL.h"
+
+// Transaction queue, the head is the transaction on the bus
+static struct i2c_transaction * volatile I2C_head;
+static struct i2c_transaction * volatile I2C_tail;
+// Position in the current phase of the head transaction
+static uint8_t I2C_index;
+static bool I2C_reading;
+
+/************************************************************************/
+/* @brief I2C_sync waits for a CTRLB command or ADDR/DATA access to synchronize
+/* @params none
+/* @returns none
+/************************************************************************/
+static void I2C_sync(void)
+{
+	while(I2C_SERCOM->I2CM.SYNCBUSY.reg & SERCOM_I2CM_SYNCBUSY_SYSOP);
+}
+
+/************************************************************************/
+/* @brief I2C_start puts the address phase of a transaction on the bus
+/* @params[in] transaction the transaction to start
+/* @returns none
+/************************************************************************/
+static void I2C_start(struct i2c_transaction * transaction)
+{
+	SercomI2cm *const i2c = &I2C_SERCOM->I2CM;
+	
+	I2C_index = 0;
+	I2C_reading = (transaction->write_length == 0);
+	
+	// ACK received bytes until the last one
+	i2c->CTRLB.reg &= ~SERCOM_I2CM_CTRLB_ACKACT;
+	i2c->INTENSET.reg = SERCOM_I2CM_INTENSET_MB | SERCOM_I2CM_INTENSET_SB | SERCOM_I2CM_INTENSET_ERROR;
+	I2C_sync();
+	i2c->ADDR.reg = (transaction->address << 1) | (I2C_reading ? I2C_TRANSFER_READ : I2C_TRANSFER_WRITE);
+}
+
+/************************************************************************/
+/* @brief I2C_finish completes the head transaction and starts the next one
+/* @params[in] transaction_status the status to complete the transaction with
+/* @params[in] stop true if a stop condition still has to be sent
+/* @returns none
+/************************************************************************/
+static void I2C_finish(enum status_code transaction_status, bool stop)
+{
+	SercomI2cm *const i2c = &I2C_SERCOM->I2CM;
+	struct i2c_transaction * transaction = I2C_head;
+	
+	if(stop){
+		I2C_sync();
+		i2c->CTRLB.reg |= SERCOM_I2CM_CTRLB_CMD(I2C_CMD_STOP);
+	}
+	
+	I2C_head = transaction->next;
+	if(I2C_head == NULL){
+		I2C_tail = NULL;
+		i2c->INTENCLR.reg = SERCOM_I2CM_INTENCLR_MB | SERCOM_I2CM_INTENCLR_SB | SERCOM_I2CM_INTENCLR_ERROR;
+	}else{
+		I2C_start(I2C_head);
+	}
+	
+	transaction->status = transaction_status;
+	if(transaction->callback) transaction->callback(transaction);
+}
+
+/************************************************************************/
+/* @brief I2C_service runs one step of the transaction state machine. Called
+/* from the SERCOM3 interrupt, or directly by I2C_transfer when the interrupt
+/* can't preempt the caller.
+/* @params none
+/* @returns none
+/************************************************************************/
+static void I2C_service(void)
+{
+	SercomI2cm *const i2c = &I2C_SERCOM->I2CM;
+	struct i2c_transaction * transaction = I2C_head;
+	uint8_t flags = i2c->INTFLAG.reg;
+	uint16_t bus_status = i2c->STATUS.reg;
+	
+	if(transaction == NULL){
+		i2c->INTENCLR.reg = SERCOM_I2CM_INTENCLR_MB | SERCOM_I2CM_INTENCLR_SB | SERCOM_I2CM_INTENCLR_ERROR;
+		return;
+	}
+	if(!(flags & (SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB | SERCOM_I2CM_INTFLAG_ERROR))) return;
+	
+	// Lost arbitration, bus error or SCL low timeout. The hardware has already released the bus
+	if(flags & SERCOM_I2CM_INTFLAG_ERROR || bus_status & (SERCOM_I2CM_STATUS_ARBLOST | SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_LOWTOUT)){
+		i2c->STATUS.reg = SERCOM_I2CM_STATUS_ARBLOST | SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_LOWTOUT;
+		i2c->INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB | SERCOM_I2CM_INTFLAG_ERROR;
+		I2C_finish((bus_status & SERCOM_I2CM_STATUS_LOWTOUT) ? STATUS_ERR_TIMEOUT : STATUS_ERR_PACKET_COLLISION, false);
+		return;
+	}
+	
+	if(flags & SERCOM_I2CM_INTFLAG_MB){
+		// Address or data byte shifted out. On a read this can only be an address NACK
+		i2c->INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB;
+		if(bus_status & SERCOM_I2CM_STATUS_RXNACK || I2C_reading){
+			I2C_finish((I2C_index == 0) ? STATUS_ERR_BAD_ADDRESS : STATUS_ERR_OVERFLOW, true);
+			return;
+		}
+		if(I2C_index < transaction->write_length){
+			I2C_sync();
+			i2c->DATA.reg = transaction->write_data[I2C_index++];
+			return;
+		}
+		if(transaction->read_length){
+			// Writing ADDR with the bus owned issues a repeated start
+			I2C_reading = true;
+			I2C_index = 0;
+			I2C_sync();
+			i2c->ADDR.reg = (transaction->address << 1) | I2C_TRANSFER_READ;
+			return;
+		}
+		I2C_finish(STATUS_OK, true);
+		return;
+	}
+	
+	// SB, a byte has been received. Smart mode sends the ACK/NACK when DATA is read
+	if(I2C_index == transaction->read_length - 1){
+		i2c->CTRLB.reg |= SERCOM_I2CM_CTRLB_ACKACT;
+		I2C_sync();
+		i2c->CTRLB.reg |= SERCOM_I2CM_CTRLB_CMD(I2C_CMD_STOP);
+	}
+	I2C_sync();
+	transaction->read_data[I2C_index++] = i2c->DATA.reg;
+	if(I2C_index == transaction->read_length){
+		// The stop has already been issued with the NACK
+		I2C_finish(STATUS_OK, false);
+	}
+}
+
+/************************************************************************/
+/* @brief SERCOM3_Handler SERCOM3 interrupt, overrides the weak startup handler
+/* @params none
+/* @returns none
+/************************************************************************/
+void SERCOM3_Handler(void)
+{
+	I2C_service();
+}
+
+/************************************************************************/
+/* @brief configure_I2C_engine hands SERCOM3 over to the engine, must be called
+/* after i2c_master_enable()
+/* @params none
+/* @returns none
+/************************************************************************/
+void configure_I2C_engine(void)
+{
+	I2C_head = NULL;
+	I2C_tail = NULL;
+	I2C_SERCOM->I2CM.INTENCLR.reg = SERCOM_I2CM_INTENCLR_MB | SERCOM_I2CM_INTENCLR_SB | SERCOM_I2CM_INTENCLR_ERROR;
+	NVIC_ClearPendingIRQ(I2C_SERCOM_IRQn);
+	NVIC_EnableIRQ(I2C_SERCOM_IRQn);
+}
+
+/************************************************************************/
+/* @brief I2C_submit queues a transaction and returns immediately. The
+/* transaction status is STATUS_BUSY until it completes, then the callback is run.
+/* @params[in] transaction the transaction to queue
+/* @returns none
+/************************************************************************/
+void I2C_submit(struct i2c_transaction * transaction)
+{
+	irqflags_t flags;
+	
+	transaction->status = STATUS_BUSY;
+	transaction->next = NULL;
+	
+	flags = cpu_irq_save();
+	if(I2C_tail == NULL){
+		I2C_head = transaction;
+		I2C_tail = transaction;
+		I2C_start(transaction);
+	}else{
+		I2C_tail->next = transaction;
+		I2C_tail = transaction;
+	}
+	cpu_irq_restore(flags);
+}
+
+/************************************************************************/
+/* @brief I2C_transfer queues a transaction and sleeps in IDLE until it completes.
+/* From an ISR or a critical section the SERCOM3 interrupt can't run, so the
+/* state machine is stepped from here instead, still sleeping between bytes.
+/* @params[in] transaction the transaction to run
+/* @returns the transaction status
+/************************************************************************/
+enum status_code I2C_transfer(struct i2c_transaction * transaction)
+{
+	irqflags_t flags;
+	bool inline_service;
+	
+	I2C_submit(transaction);
+	
+	flags = cpu_irq_save();
+	inline_service = !cpu_irq_is_enabled_flags(flags) || __get_IPSR();
+	system_set_sleepmode(SYSTEM_SLEEPMODE_IDLE);
+	while(transaction->status == STATUS_BUSY){
+		if(inline_service && (I2C_SERCOM->I2CM.INTFLAG.reg & (SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB | SERCOM_I2CM_INTFLAG_ERROR))){
+			I2C_service();
+			NVIC_ClearPendingIRQ(I2C_SERCOM_IRQn);
+			continue;
+		}
+		// A pending interrupt still wakes the core with interrupts masked
+		system_sleep();
+		if(!inline_service){
+			// Let the SERCOM3 interrupt run, then mask again before checking the status
+			cpu_irq_enable();
+			cpu_irq_disable();
+		}
+	}
+	// Back to the mode that sleep() expects
+	system_set_sleepmode(SYSTEM_SLEEPMODE_STANDBY);
+	cpu_irq_restore(flags);
+	
+	return transaction->status;
+}
+
+/************************************************************************/
+/* @brief I2C_write_reg writes one register of a device
+/* @params[in] address the 7 bit device address
+/* @params[in] reg the register address
+/* @params[in] value the value to write
+/* @returns the transaction status
+/************************************************************************/
+enum status_code I2C_write_reg(uint8_t address, uint8_t reg, uint8_t value)
+{
+	uint8_t wr_buffer[2] = {reg, value};
+	struct i2c_transaction transaction = {
+		.address = address,
+		.write_data = wr_buffer,
+		.write_length = 2,
+		.read_data = NULL,
+		.read_length = 0,
+		.callback = NULL,
+	};
+	
+	return I2C_transfer(&transaction);
+}
+
+/************************************************************************/
+/* @brief I2C_write_regs writes consecutive registers of a device in one
+/* auto-increment write, such as the two bytes of a 16 bit register
+/* @params[in] address the 7 bit device address
+/* @params[in] reg the first register address
+/* @params[in] data the values to write
+/* @params[in] length the number of registers, at most I2C_WRITE_MAX
+/* @returns the transaction status
+/************************************************************************/
+enum status_code I2C_write_regs(uint8_t address, uint8_t reg, const uint8_t * data, uint8_t length)
+{
+	uint8_t wr_buffer[I2C_WRITE_MAX + 1];
+	struct i2c_transaction transaction = {
+		.address = address,
+		.write_data = wr_buffer,
+		.write_length = length + 1,
+		.read_data = NULL,
+		.read_length = 0,
+		.callback = NULL,
+	};
+	
+	if(length > I2C_WRITE_MAX) return STATUS_ERR_INVALID_ARG;
+	wr_buffer[0] = reg;
+	memcpy(&wr_buffer[1], data, length);
+	
+	return I2C_transfer(&transaction);
+}
+
+/************************************************************************/
+/* @brief I2C_read_regs reads consecutive registers of a device with a register
+/* pointer write, a repeated start and an auto-increment read
+/* @params[in] address the 7 bit device address
+/* @params[in] reg the first register address
+/* @params[out] data buffer for length bytes
+/* @params[in] length the number of registers to read
+/* @returns the transaction status
+/************************************************************************/
+enum status_code I2C_read_regs(uint8_t address, uint8_t reg, uint8_t * data, uint8_t length)
+{
+	struct i2c_transaction transaction = {
+		.address = address,
+		.write_data = &reg,
+		.write_length = 1,
+		.read_data = data,
+		.read_length = length,
+		.callback = NULL,
+	};
+	
+	return I2C_transfer(&transaction);
+}
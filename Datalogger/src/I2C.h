@@ -0,0 +1,47 @@
+/************************************************************************/
+/* @file i2c.h
+/* @brief contains the transaction descriptor and prototype declarations for the
+/* interrupt driven I2C engine on SERCOM3
+/************************************************************************/
+
+#ifndef I2C_H_
+#define I2C_H_
+
+#include <asf.h>
+
+/* I2C engine defines */
+#define I2C_SERCOM			SERCOM3
+#define I2C_SERCOM_IRQn		SERCOM3_IRQn
+// Bus commands written to CTRLB.CMD
+#define I2C_CMD_REPEATED_START	1
+#define I2C_CMD_STOP			3
+// Most registers I2C_write_regs writes in one go
+#define I2C_WRITE_MAX			8
+
+/************************************************************************/
+/* @brief i2c_transaction describes one bus transaction. write_length bytes are
+/* written first, then if read_length is non zero a repeated start is issued and
+/* read_length bytes are read back. Either phase may be empty, but not both. The
+/* descriptor and its buffers must stay valid until status is no longer STATUS_BUSY.
+/************************************************************************/
+struct i2c_transaction {
+	uint8_t address;
+	uint8_t * write_data;
+	uint8_t write_length;
+	uint8_t * read_data;
+	uint8_t read_length;
+	// Called from the SERCOM3 interrupt when the transaction completes, may be NULL
+	void (*callback)(struct i2c_transaction * transaction);
+	volatile enum status_code status;
+	struct i2c_transaction * next;
+};
+
+/* I2C engine prototype definitions */
+void configure_I2C_engine(void);
+void I2C_submit(struct i2c_transaction * transaction);
+enum status_code I2C_transfer(struct i2c_transaction * transaction);
+enum status_code I2C_write_reg(uint8_t address, uint8_t reg, uint8_t value);
+enum status_code I2C_write_regs(uint8_t address, uint8_t reg, const uint8_t * data, uint8_t length);
+enum status_code I2C_read_regs(uint8_t address, uint8_t reg, uint8_t * data, uint8_t length);
+
+#endif /* I2C_H_ */
@@ -0,0 +1,221 @@
+/************************************************************************/
+/* @file Offload.c
+/* @brief The acquisition rings, their data sets, and the offload of the
+/* buffered data to the flash one record at a time
+/************************************************************************/
+#include "HAL.h"
+#include <asf.h>
+#include <string.h>
+
+/************************************************************************/
+/* @brief Initializes the accelerometer and temperature data buffers
+/* Only call at the start of execution, otherwise data will be lost
+/* @params none
+/* @returns none
+/************************************************************************/
+void configure_databuffers(void)
+{
+	ring_init(&temperature_ring, temperature_samples, sizeof(temperature_samples[0]), TEMP_RING_SIZE);
+	ring_init(&temperature_sets, temperature_set_buffer, sizeof(temperature_set_buffer[0]), DATA_SET_RING_SIZE);
+	ring_init(&accel_ring, accel_samples, ACCEL_SAMPLE_SIZE, ACCEL_RING_SIZE);
+	ring_init(&accel_sets, accel_set_buffer, sizeof(accel_set_buffer[0]), DATA_SET_RING_SIZE);
+	ring_init(&summary_ring, summary_buffer, sizeof(summary_buffer[0]), SUMMARY_RING_SIZE);
+	ring_init(&shock_ring, shock_buffer, sizeof(shock_buffer[0]), SHOCK_RING_SIZE);
+}
+
+/************************************************************************/
+/* @brief mark_data_set starts a new data set at the next sample. Producer side only.
+/* @params[in] samples the sample ring the data set belongs to
+/* @params[in] sets the data set ring for that sample ring
+/* @returns none
+/************************************************************************/
+void mark_data_set(struct ring * samples, struct ring * sets)
+{
+	struct data_set set;
+	
+	set.start = samples->head;
+	get_timestamp(set.timestamp);
+	ring_write(sets, &set, 1);
+}
+
+// A data set as written by offload_data
+struct data_set_extent {
+	uint16_t length;
+	uint8_t timestamp[4];
+	// Carries on the data set that was open at the last offload
+	bool continued;
+};
+
+// Timestamps of the data sets still open at the last offload
+static uint8_t temperature_open_timestamp[4];
+static uint8_t accel_open_timestamp[4];
+
+// The swapped out half being written by offload_step. Data sets are numbered temperature first, then accel
+static struct data_set_extent temperature_extents[DATA_SET_RING_SIZE + 1];
+static struct data_set_extent accel_extents[DATA_SET_RING_SIZE + 1];
+static uint8_t ucOffloadTemperatureSets;
+static uint8_t ucOffloadAccelerometerSets;
+static uint8_t ucOffloadSummaries;
+static uint8_t ucOffloadShocks;
+static uint8_t ucOffloadSet;
+static uint16_t uiOffloadSample;
+static bool bOffloadRunning;
+static struct record offload_record;
+static struct shock_event offload_shock;
+// Samples of one record, the codecs need the whole record to pick their bit widths
+static int16_t offload_samples[ACCEL_CODEC_MAX_SAMPLES * ACCEL_AXES];
+#if TEMPERATURE_CODEC_MAX_SAMPLES > ACCEL_CODEC_MAX_SAMPLES * ACCEL_AXES
+#error "offload_samples is too small for a temperature record"
+#endif
+
+/************************************************************************/
+/* @brief collect_data_sets splits the samples published so far into data sets.
+/* The samples before the first new mark continue the set that was open at the
+/* last offload, and are skipped if there are none. Consumer side only.
+/* @params[in] samples the sample ring
+/* @params[in] sets the data set ring for the sample ring
+/* @params[in,out] open_timestamp timestamp of the open data set, updated to the last set collected
+/* @params[out] extents room for DATA_SET_RING_SIZE + 1 data sets
+/* @returns the number of data sets collected
+/************************************************************************/
+static uint8_t collect_data_sets(struct ring * samples, struct ring * sets, uint8_t * open_timestamp, struct data_set_extent * extents)
+{
+	struct data_set set;
+	uint8_t count = 0;
+	// Whether extents[count] was started by a mark rather than continuing the open set
+	bool marked = false;
+	// Marks are snapshotted before the samples so every mark taken starts at or before the end
+	uint16_t marks = ring_count(sets);
+	uint16_t start = samples->tail;
+	uint16_t end = samples->head;
+	
+	memcpy(extents[0].timestamp, open_timestamp, 4);
+	extents[0].continued = true;
+	for(uint16_t i = 0; i < marks; i++){
+		ring_read(sets, &set, 1);
+		extents[count].length = set.start - start;
+		// Drop an empty continuation, but keep empty sets that were marked
+		if(marked || extents[count].length) count++;
+		memcpy(extents[count].timestamp, set.timestamp, 4);
+		extents[count].continued = false;
+		marked = true;
+		start = set.start;
+	}
+	extents[count].length = end - start;
+	if(marked || extents[count].length) count++;
+	if(count) memcpy(open_timestamp, extents[count - 1].timestamp, 4);
+	
+	return count;
+}
+
+/************************************************************************/
+/* @brief acquisition_half_full checks whether the filling half of any ring is full
+/* and should be swapped out to the storage writer
+/* @params none
+/* @returns true if offload_data should be called
+/************************************************************************/
+bool acquisition_half_full(void)
+{
+	// Nothing can be swapped out until the running offload is written
+	if(bOffloadRunning) return false;
+	return (ring_count(&accel_ring) >= ACCEL_RING_SIZE / 2) || (ring_count(&temperature_ring) >= TEMP_RING_SIZE / 2) ||
+		(ring_count(&accel_sets) >= DATA_SET_RING_SIZE / 2) || (ring_count(&temperature_sets) >= DATA_SET_RING_SIZE / 2) ||
+		(ring_count(&summary_ring) >= SUMMARY_RING_SIZE / 2) || (ring_count(&shock_ring) >= SHOCK_RING_SIZE / 2);
+}
+
+/************************************************************************/
+/* @brief offload_data swaps the buffered temperature and acceleration data out to
+/* the storage writer. Only the samples published when it starts are taken, new
+/* samples land in the other half of the rings. The records are written by offload_step.
+/* @params none
+/* @returns none
+/************************************************************************/
+void offload_data(void)
+{	
+	// The previous half is still being written
+	if(bOffloadRunning) return;
+	
+	ucOffloadTemperatureSets = collect_data_sets(&temperature_ring, &temperature_sets, temperature_open_timestamp, temperature_extents);
+	ucOffloadAccelerometerSets = collect_data_sets(&accel_ring, &accel_sets, accel_open_timestamp, accel_extents);
+	ucOffloadSummaries = ring_count(&summary_ring);
+	ucOffloadShocks = ring_count(&shock_ring);
+	if(!(ucOffloadTemperatureSets + ucOffloadAccelerometerSets + ucOffloadSummaries + ucOffloadShocks)) return;
+	
+	// All writes go through the page buffer, the flash only sees one page program per 256 bytes
+	S70FL01_write_begin();
+	ucOffloadSet = 0;
+	uiOffloadSample = 0;
+	bOffloadRunning = true;
+}
+
+/************************************************************************/
+/* @brief offload_step encodes and writes the next record (at most about a page)
+/* of the swapped out data. Called from the main loop, so the deferred sensor
+/* work runs between records instead of waiting for the whole offload.
+/* @params none
+/* @returns true while there is more to write straight away, false when done or waiting on a sector erase
+/************************************************************************/
+bool offload_step(void)
+{
+	struct data_set_extent * extent;
+	struct accel_summary summary;
+	uint16_t uiCount;
+	uint8_t ucEncoded;
+	bool bTemperature;
+	
+	if(!bOffloadRunning) return false;
+	// The next record would wait for a sector erase, carry on once the erase-ahead has got there rather than stall on it
+	if(S70FL01_busy(RECORD_MAX_SIZE)) return false;
+	
+	if(ucOffloadSet == ucOffloadTemperatureSets + ucOffloadAccelerometerSets + ucOffloadSummaries + ucOffloadShocks){
+		// Commit the last partial page and power the chip down
+		S70FL01_write_end();
+		bOffloadRunning = false;
+		return false;
+	}
+	if(ucOffloadSet >= ucOffloadTemperatureSets + ucOffloadAccelerometerSets){
+		// Each summary and shock is a record of its own, stamped with the start of its epoch or the shock
+		if(ucOffloadSet < ucOffloadTemperatureSets + ucOffloadAccelerometerSets + ucOffloadSummaries){
+			ring_read(&summary_ring, &summary, 1);
+			record_begin(&offload_record, RECORD_KIND_DATA_SET, RECORD_CHANNEL_ACCEL_SUMMARY, RECORD_ENCODING_ACCEL_SUMMARY, summary.timestamp);
+			offload_record.length = summary_encode(&summary, offload_record.payload);
+		}else{
+			ring_read(&shock_ring, &offload_shock, 1);
+			record_begin(&offload_record, RECORD_KIND_DATA_SET, RECORD_CHANNEL_ACCEL_SHOCK, RECORD_ENCODING_SHOCK_S16X3, offload_shock.timestamp);
+			offload_record.length = shock_encode(&offload_shock, offload_record.payload);
+		}
+		record_write(&offload_record);
+		ucOffloadSet++;
+		return true;
+	}
+	bTemperature = ucOffloadSet < ucOffloadTemperatureSets;
+	extent = bTemperature ? &temperature_extents[ucOffloadSet] : &accel_extents[ucOffloadSet - ucOffloadTemperatureSets];
+	
+	// Data sets too long for one record, or carried over from the last offload, go on in continue records
+	record_begin(&offload_record, (uiOffloadSample || extent->continued) ? RECORD_KIND_CONTINUE : RECORD_KIND_DATA_SET,
+		bTemperature ? RECORD_CHANNEL_TEMPERATURE : RECORD_CHANNEL_ACCEL, bTemperature ? RECORD_ENCODING_S16_DELTA_PACKED : RECORD_ENCODING_S16X3_RICE, extent->timestamp);
+	if(bTemperature){
+		// Temperature is delta coded, so the record is encoded in one go from the first sample on
+		uiCount = extent->length - uiOffloadSample;
+		if(uiCount > TEMPERATURE_CODEC_MAX_SAMPLES) uiCount = TEMPERATURE_CODEC_MAX_SAMPLES;
+		ring_read(&temperature_ring, offload_samples, uiCount);
+		offload_record.length = temperature_encode(offload_samples, uiCount, offload_record.payload);
+		uiOffloadSample += uiCount;
+	}else{
+		// Acceleration is Rice coded, samples that don't fit stay in the ring for the next record
+		uiCount = extent->length - uiOffloadSample;
+		if(uiCount > ACCEL_CODEC_MAX_SAMPLES) uiCount = ACCEL_CODEC_MAX_SAMPLES;
+		ring_peek(&accel_ring, offload_samples, uiCount);
+		offload_record.length = accel_encode(offload_samples, uiCount, offload_record.payload, RECORD_MAX_PAYLOAD, &ucEncoded);
+		ring_skip(&accel_ring, ucEncoded);
+		uiOffloadSample += ucEncoded;
+	}
+	record_write(&offload_record);
+	
+	if(uiOffloadSample == extent->length){
+		ucOffloadSet++;
+		uiOffloadSample = 0;
+	}
+	
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+/************************************************************************/
+/* @file offload.h
+/* @brief contains the acquisition ring and offload prototype declarations
+/************************************************************************/
+
+#ifndef OFFLOAD_H_
+#define OFFLOAD_H_
+
+#include <asf.h>
+#include "Ring.h"
+
+/* Offload prototype definitions */
+void configure_databuffers(void);
+void mark_data_set(struct ring * samples, struct ring * sets);
+bool acquisition_half_full(void);
+void offload_data(void);
+bool offload_step(void);
+
+#endif /* OFFLOAD_H_ */
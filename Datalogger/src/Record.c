@@ -0,0 +1,81 @@
+/************************************************************************/
+/* @file Record.c
+/* @brief Encoder for the flash record format described in Record.h. Records
+/* go through the S70FL01 page buffered writer.
+/************************************************************************/
+
+#include <asf.h>
+#include <string.h>
+#include "HAL.h"
+
+/************************************************************************/
+/* @brief record_begin starts a new record with an empty payload
+/* @params[in] record the record to start
+/* @params[in] kind the record kind (RECORD_KIND_*)
+/* @params[in] channel the channel the payload comes from (RECORD_CHANNEL_*)
+/* @params[in] encoding how the payload is packed (RECORD_ENCODING_*)
+/* @params[in] timestamp the 4 byte timestamp from get_timestamp
+/* @returns none
+/************************************************************************/
+void record_begin(struct record * record, uint8_t kind, uint8_t channel, uint8_t encoding, const uint8_t * timestamp)
+{
+	record->header[0] = RECORD_TYPE(kind);
+	record->header[1] = 0;
+	memcpy(&record->header[2], timestamp, 4);
+	record->header[6] = channel;
+	record->header[7] = encoding;
+	record->length = 0;
+}
+
+/************************************************************************/
+/* @brief record_space gives the payload bytes left in a record
+/* @params[in] record the record
+/* @returns the number of bytes that can still be appended
+/************************************************************************/
+uint8_t record_space(struct record * record)
+{
+	return RECORD_MAX_PAYLOAD - record->length;
+}
+
+/************************************************************************/
+/* @brief record_append adds bytes to the payload
+/* @params[in] record the record
+/* @params[in] data the bytes to add
+/* @params[in] length the number of bytes
+/* @returns 1 if they were added, 0 if they don't fit (nothing is added)
+/************************************************************************/
+uint8_t record_append(struct record * record, const void * data, uint8_t length)
+{
+	if(length > record_space(record)) return 0;
+	memcpy(&record->payload[record->length], data, length);
+	record->length += length;
+	return 1;
+}
+
+/************************************************************************/
+/* @brief record_write writes a finished record to flash with its CRC. A record that
+/* does not fit in the rest of the sector starts the next sector instead, so no record
+/* is split by a sector header. Must be called between S70FL01_write_begin and S70FL01_write_end.
+/* @params[in] record the record
+/* @returns the number of bytes written
+/************************************************************************/
+uint16_t record_write(struct record * record)
+{
+	uint8_t trailer[RECORD_TRAILER_SIZE];
+	uint16_t size = RECORD_HEADER_SIZE + record->length + RECORD_TRAILER_SIZE;
+	uint32_t crc;
+	
+	record->header[1] = record->length;
+	crc = checksum_update(CHECKSUM_SEED, record->header, RECORD_HEADER_SIZE);
+	crc = ~checksum_update(crc, record->payload, record->length);
+	trailer[0] = crc >> 24 & 0xFF;
+	trailer[1] = crc >> 16 & 0xFF;
+	trailer[2] = crc >> 8  & 0xFF;
+	trailer[3] = crc >> 0  & 0xFF;
+	
+	if(size > S70FL01_write_space()) S70FL01_write_next_sector();
+	S70FL01_write(record->header, RECORD_HEADER_SIZE);
+	S70FL01_write(record->payload, record->length);
+	S70FL01_write(trailer, RECORD_TRAILER_SIZE);
+	return size;
+}
@@ -0,0 +1,86 @@
+/************************************************************************/
+/* @file record.h
+/* @brief contains the flash record format and prototype declarations
+/*
+/* Data is stored as a stream of self describing records:
+/*   type       1 byte, format version in the upper nibble, record kind in the lower
+/*   length     1 byte, payload length
+/*   timestamp  4 bytes, RTC register value (big endian) at the start of the data set
+/*   channel    1 byte, which sensor the payload came from
+/*   encoding   1 byte, how the payload is packed
+/*   payload    length bytes
+/*   crc        4 bytes, CRC-32 of the header and payload (big endian), from version 2
+/* Readers skip records with an unknown version, kind, channel or encoding by their
+/* length, so new sensors and codecs don't break the format. A record whose crc does not
+/* match is corrupt.
+/*
+/* The stream is stored sector by sector (256 KB, see S70FL01.h). Each sector starts with
+/* a 6 byte sector header (magic "DL" then a 32 bit sequence number) that is not part of
+/* any record, readers skip it at every sector start. Records never cross a sector
+/* boundary: a record that does not fit in the rest of a sector goes at the start of
+/* the next one, and after a reset the writer also starts again at the next sector.
+/* The rest of such a sector is left erased, so a type of 0xFF is erased flash: the rest
+/* of the sector is unused and reading carries on at the start of the next sector. A
+/* sector that is erased from its start ends the stream.
+/************************************************************************/
+
+#ifndef RECORD_H_
+#define RECORD_H_
+
+#include <asf.h>
+#include "Checksum.h"
+
+/* Record format defines */
+#define RECORD_FORMAT_VERSION		2
+#define RECORD_TYPE(kind)			((RECORD_FORMAT_VERSION << 4) | (kind))
+#define RECORD_HEADER_SIZE			8
+#define RECORD_TRAILER_SIZE			CHECKSUM_SIZE
+#define RECORD_MAX_PAYLOAD			255
+#define RECORD_MAX_SIZE				(RECORD_HEADER_SIZE + RECORD_MAX_PAYLOAD + RECORD_TRAILER_SIZE)
+#define RECORD_ERASED				0xFF
+
+// Record kinds
+// First record of a data set, the timestamp is when the data set started
+#define RECORD_KIND_DATA_SET		0x1
+// More samples of the last data set on the same channel, same timestamp as that data set
+#define RECORD_KIND_CONTINUE		0x2
+
+// Channels
+#define RECORD_CHANNEL_TEMPERATURE	0x00
+#define RECORD_CHANNEL_ACCEL		0x01
+// Per epoch activity summaries of the accelerometer
+#define RECORD_CHANNEL_ACCEL_SUMMARY	0x02
+// Accelerometer samples around a shock
+#define RECORD_CHANNEL_ACCEL_SHOCK	0x03
+
+// Encodings
+// Little endian 16 bit samples
+#define RECORD_ENCODING_S16LE		0x00
+// 8 bit x, y, z samples
+#define RECORD_ENCODING_S8X3		0x01
+// Zigzag deltas of 16 bit samples in groups of adaptive bit width, see temperature_encode
+#define RECORD_ENCODING_S16_DELTA_PACKED	0x02
+// Rice coded deltas of 16 bit x, y, z samples, see accel_encode
+#define RECORD_ENCODING_S16X3_RICE	0x03
+// Little endian activity summary fields, see summary_encode
+#define RECORD_ENCODING_ACCEL_SUMMARY	0x04
+// Shock event header then raw 16 bit x, y, z samples, see shock_encode
+#define RECORD_ENCODING_SHOCK_S16X3	0x05
+
+/************************************************************************/
+/* @brief record is a record being encoded. The payload is built in RAM so the
+/* length is known before the header goes to flash.
+/************************************************************************/
+struct record {
+	uint8_t header[RECORD_HEADER_SIZE];
+	uint8_t payload[RECORD_MAX_PAYLOAD];
+	uint8_t length;
+};
+
+/* Record prototype definitions */
+void record_begin(struct record * record, uint8_t kind, uint8_t channel, uint8_t encoding, const uint8_t * timestamp);
+uint8_t record_space(struct record * record);
+uint8_t record_append(struct record * record, const void * data, uint8_t length);
+uint16_t record_write(struct record * record);
+
+#endif /* RECORD_H_ */
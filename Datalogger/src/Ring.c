@@ -0,0 +1,132 @@
+/************************************************************************/
+/* @file Ring.c
+/* @brief Single-producer/single-consumer ring buffers used to hand samples
+/* from the sensor handlers to the storage task without disabling interrupts.
+/************************************************************************/
+
+#include <asf.h>
+#include <string.h>
+#include "HAL.h"
+
+/************************************************************************/
+/* @brief ring_init sets up an empty ring over a caller supplied buffer.
+/* Not safe while the producer or consumer is running.
+/* @params[in] ring the ring to set up
+/* @params[in] buffer storage for capacity elements
+/* @params[in] element_size the size of one element in bytes
+/* @params[in] capacity the number of elements, must be a power of two
+/* @returns none
+/************************************************************************/
+void ring_init(struct ring * ring, void * buffer, uint16_t element_size, uint16_t capacity)
+{
+	ring->buffer = buffer;
+	ring->element_size = element_size;
+	ring->capacity = capacity;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->overruns = 0;
+}
+
+/************************************************************************/
+/* @brief ring_count gives the number of elements waiting to be read. Exact for
+/* the consumer, a lower bound for anyone else.
+/* @params[in] ring the ring
+/* @returns the number of elements in the ring
+/************************************************************************/
+uint16_t ring_count(struct ring * ring)
+{
+	return (uint16_t)(ring->head - ring->tail);
+}
+
+/************************************************************************/
+/* @brief ring_space gives the number of free elements. Exact for the producer,
+/* a lower bound for anyone else.
+/* @params[in] ring the ring
+/* @returns the number of elements that can be written
+/************************************************************************/
+uint16_t ring_space(struct ring * ring)
+{
+	return ring->capacity - ring_count(ring);
+}
+
+/************************************************************************/
+/* @brief ring_write copies elements in and then publishes them by moving head.
+/* Producer only. Elements that don't fit are dropped and counted as overruns.
+/* @params[in] ring the ring
+/* @params[in] elements count elements to copy in
+/* @params[in] count the number of elements
+/* @returns the number of elements written
+/************************************************************************/
+uint16_t ring_write(struct ring * ring, const void * elements, uint16_t count)
+{
+	const uint8_t * source = elements;
+	uint16_t head = ring->head;
+	uint16_t space = ring->capacity - (uint16_t)(head - ring->tail);
+	
+	if(count > space){
+		ring->overruns += count - space;
+		count = space;
+	}
+	for(uint16_t i = 0; i < count; i++){
+		memcpy(ring->buffer + ((head + i) & (ring->capacity - 1)) * ring->element_size, source, ring->element_size);
+		source += ring->element_size;
+	}
+	// The data has to be in place before the consumer can see the new head
+	__DMB();
+	ring->head = head + count;
+	
+	return count;
+}
+
+/************************************************************************/
+/* @brief ring_peek copies elements out without freeing them. Consumer only.
+/* @params[in] ring the ring
+/* @params[out] elements room for count elements
+/* @params[in] count the maximum number of elements to copy
+/* @returns the number of elements copied
+/************************************************************************/
+uint16_t ring_peek(struct ring * ring, void * elements, uint16_t count)
+{
+	uint8_t * destination = elements;
+	uint16_t tail = ring->tail;
+	uint16_t available = (uint16_t)(ring->head - tail);
+	
+	if(count > available) count = available;
+	// Don't read the data before the head that published it
+	__DMB();
+	for(uint16_t i = 0; i < count; i++){
+		memcpy(destination, ring->buffer + ((tail + i) & (ring->capacity - 1)) * ring->element_size, ring->element_size);
+		destination += ring->element_size;
+	}
+	
+	return count;
+}
+
+/************************************************************************/
+/* @brief ring_skip frees elements by moving tail. Consumer only.
+/* @params[in] ring the ring
+/* @params[in] count the number of elements, at most ring_count
+/* @returns none
+/************************************************************************/
+void ring_skip(struct ring * ring, uint16_t count)
+{
+	// The data has to be copied out before the producer can reuse the slots
+	__DMB();
+	ring->tail = ring->tail + count;
+}
+
+/************************************************************************/
+/* @brief ring_read copies elements out and then frees them by moving tail.
+/* Consumer only.
+/* @params[in] ring the ring
+/* @params[out] elements room for count elements
+/* @params[in] count the maximum number of elements to read
+/* @returns the number of elements read
+/************************************************************************/
+uint16_t ring_read(struct ring * ring, void * elements, uint16_t count)
+{
+	count = ring_peek(ring, elements, count);
+	ring_skip(ring, count);
+	
+	return count;
+}
@@ -0,0 +1,36 @@
+/************************************************************************/
+/* @file ring.h
+/* @brief contains the single-producer/single-consumer ring buffer and prototype declarations
+/************************************************************************/
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <asf.h>
+
+/************************************************************************/
+/* @brief ring is a lock free SPSC queue of fixed size elements. head is only
+/* written by the producer and tail only by the consumer. Both are free running
+/* 16 bit sequence numbers, which the M0+ loads and stores atomically, so neither
+/* side ever masks interrupts. capacity must be a power of two.
+/************************************************************************/
+struct ring {
+	uint8_t * buffer;
+	uint16_t element_size;
+	uint16_t capacity;
+	volatile uint16_t head;
+	volatile uint16_t tail;
+	// Elements the producer had to drop because the ring was full
+	volatile uint16_t overruns;
+};
+
+/* Ring prototype definitions */
+void ring_init(struct ring * ring, void * buffer, uint16_t element_size, uint16_t capacity);
+uint16_t ring_count(struct ring * ring);
+uint16_t ring_space(struct ring * ring);
+uint16_t ring_write(struct ring * ring, const void * elements, uint16_t count);
+uint16_t ring_peek(struct ring * ring, void * elements, uint16_t count);
+void ring_skip(struct ring * ring, uint16_t count);
+uint16_t ring_read(struct ring * ring, void * elements, uint16_t count);
+
+#endif /* RING_H_ */
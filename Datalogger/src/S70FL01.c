@@ -6,6 +6,45 @@
 #include "HAL.h"
 #include <asf.h>
 
+// Page buffers for the buffered writer. One fills with the bytes that will be programmed at S70FL01_address
+// while the page in the other one programs
+static uint8_t S70FL01_page_buffer[2][S70FL01_PAGE_SIZE];
+static struct S70FL01_job S70FL01_page_job[2];
+static uint8_t S70FL01_page_index;
+static uint16_t S70FL01_page_fill;
+static bool S70FL01_powered;
+// SERCOM2 configuration, kept so the clock can be switched
+static struct spi_config S70FL01_spi_config;
+// Sequence number written into the header of the next sector the writer enters
+static uint32_t S70FL01_sequence;
+
+// Streaming read session state
+static bool S70FL01_read_active;
+static uint8_t S70FL01_read_die;
+static uint32_t S70FL01_read_address;
+
+// Erase-ahead state. Sectors are numbered around the ring, see S70FL01_sector_die. Everything from the write head up to
+// S70FL01_erased_end (exclusive) is erased, it equals the head sector when the head sector itself is not
+static bool S70FL01_present;
+static bool S70FL01_writing;
+static struct S70FL01_job S70FL01_erase_job;
+static uint32_t S70FL01_erase_sector;
+static uint32_t S70FL01_erased_end;
+
+// Job queues, one per die. The job at the head of a queue is the one the die is running
+static struct S70FL01_job * S70FL01_job_head[S70FL01_DIE_COUNT];
+static struct S70FL01_job * S70FL01_job_tail[S70FL01_DIE_COUNT];
+static struct tc_module S70FL01_job_tc;
+
+// Verify policy state, see S70FL01_VERIFY_SAMPLE_PAGES
+static uint16_t S70FL01_verify_count;
+static uint16_t S70FL01_verify_pending;
+
+static void configure_S70FL01_jobs(void);
+static bool S70FL01_jobs_pending(void);
+static void S70FL01_probe(uint8_t die, uint32_t address, uint8_t *buffer, uint16_t length);
+static void S70FL01_job_complete(uint8_t die, enum status_code result);
+
 /************************************************************************/
 /* @brief configure_s70fl01 configures the memory module
 /* @params[in] die_cs, the die that should be configured in the S70FL01
@@ -16,7 +55,9 @@ uint8_t configure_S70FL01(uint8_t die_cs, bool erase_chip)
 {
 	S70FL01_active_die = 0;
 	S70FL01_address = 0;
-	static uint8_t rxBuffer[20];
+	S70FL01_die_size = S70FL01_MAX_ADDR;
+	static uint8_t rxBuffer[S70FL01_RDID_LENGTH];
+	uint8_t command = S70FL01_RDID;
 	struct spi_config config_spi_master;
 	struct spi_slave_inst_config slave_dev_config;
 	struct system_pinmux_config config_pinmux;
@@ -31,7 +72,7 @@ uint8_t configure_S70FL01(uint8_t die_cs, bool erase_chip)
 
 	// Setup CS1#
 	system_pinmux_pin_set_config(S70FL01_CS1, &config_pinmux);
-	port_pin_set_output_level(S70FL01_CS2, true);
+	port_pin_set_output_level(S70FL01_CS1, true);
 	
 	// Setup CS2#
 	system_pinmux_pin_set_config(S70FL01_CS2, &config_pinmux);
@@ -44,13 +85,13 @@ uint8_t configure_S70FL01(uint8_t die_cs, bool erase_chip)
 	/* Configure, initialize and enable SERCOM SPI module */
 	spi_get_config_defaults(&config_spi_master);
 	config_spi_master.run_in_standby = false;
-	config_spi_master.mode_specific.master.baudrate = 10000UL;
+	config_spi_master.mode_specific.master.baudrate = S70FL01_SPI_BAUD_SLOW;
 	config_spi_master.character_size = SPI_CHARACTER_SIZE_8BIT;
 	config_spi_master.data_order = SPI_DATA_ORDER_MSB;
 	config_spi_master.mode = SPI_MODE_MASTER;
 	config_spi_master.receiver_enable = true;
 	config_spi_master.master_slave_select_enable = false;
-	config_spi_master.generator_source = GCLK_GENERATOR_1;
+	config_spi_master.generator_source = S70FL01_SPI_GCLK_SLOW;
 	/** SPI MUX combination F. DOPO: 0x1 => SCK=PAD3, MOSI=PAD2, DIPO: 0x1 => MISO=PAD1 */
 	config_spi_master.mux_setting = SPI_SIGNAL_MUX_SETTING_F;
 	/* Configure pad 0 as unused */
@@ -65,47 +106,47 @@ uint8_t configure_S70FL01(uint8_t die_cs, bool erase_chip)
 	spi_init(&spi_master_instance, SERCOM2, &config_spi_master);
 	spi_enable(&spi_master_instance);
 	spi_enabled = true;
+	S70FL01_spi_config = config_spi_master;
+	configure_S70FL01_jobs();
 	
 	// Make sure our RXBuffer is empty
-	for(int i = 0; i < 20; i++){
+	for(int i = 0; i < S70FL01_RDID_LENGTH; i++){
 		rxBuffer[i] = 0;
 	}
 	
-	// Enable the chip now that its configured
+	// Enable the chip now that its configured, and give it tPU to come out of power on reset
 	port_pin_set_output_level(S70FL01_EN, true);
-	for(int i = 0; i < 65535; i++);
+	wait_us(S70FL01_TPU_US);
 	
 	// Select chip
 	port_pin_set_output_level(die_cs, false);
-	for(int i = 0; i < 1000; i++);
 	
-	// Wait for the module to be ready
-	while(!spi_is_ready_to_write(&spi_master_instance));
-	// Write the register
-	while((status = spi_write(&spi_master_instance, S70FL01_RDID)) != STATUS_OK);
-	// Read back the contents of the shift reg
-	while(!spi_is_ready_to_read(&spi_master_instance));
-	while((status = spi_read_buffer_wait(&spi_master_instance, rxBuffer, 20, 0xFF)) != STATUS_OK);
+	// Read the ID bytes and the CFI table that follows them
+	while((status = spi_write_buffer_wait(&spi_master_instance, &command, 1)) != STATUS_OK);
+	while((status = spi_read_buffer_wait(&spi_master_instance, rxBuffer, S70FL01_RDID_LENGTH, 0xFF)) != STATUS_OK);
 	
 	// See if we got anything back. If not, then just return
-	for(int i = 0; i < 20; i++){
+	for(int i = 0; i < S70FL01_RDID_LENGTH; i++){
 		if(rxBuffer[i]){
 			break;
-			}else if(i == 19){
+			}else if(i == S70FL01_RDID_LENGTH - 1){
 			port_pin_set_output_level(die_cs, true);
 			port_pin_set_output_level(S70FL01_EN, false);
 			return 0;
 		}
 	}
+	
+	// The CFI device size field is the per die capacity as a power of 2 (0x1A for the 64 MB dies)
+	// Only trust it if the "QRY" signature is in place and the size is sensible
+	if(rxBuffer[S70FL01_CFI_QRY_OFFSET + 0] == 'Q' && rxBuffer[S70FL01_CFI_QRY_OFFSET + 1] == 'R' && rxBuffer[S70FL01_CFI_QRY_OFFSET + 2] == 'Y'
+		&& rxBuffer[S70FL01_CFI_SIZE_OFFSET] >= 20 && rxBuffer[S70FL01_CFI_SIZE_OFFSET] <= 31){
+		S70FL01_die_size = 1UL << rxBuffer[S70FL01_CFI_SIZE_OFFSET];
+	}
 	rxBuffer[0] = 0;
 	
-	// We need to delay because the GPIO is faster than the serial out 100 is sufficient for 1 byte
-	// Then give it a second to stabilize
-	for(int i = 0; i < 100; i++);
+	// spi_read_buffer_wait only returns once the last byte is in, so CS# can be cycled straight away
 	port_pin_set_output_level(die_cs, true);
-	for(int i = 0; i < 100; i++);
 	port_pin_set_output_level(die_cs, false);
-	for(int i = 0; i < 100; i++);
 	
 	if(erase_chip){
 		// Wait for the module to be ready
@@ -125,191 +166,1076 @@ uint8_t configure_S70FL01(uint8_t die_cs, bool erase_chip)
 			while((status = spi_read_buffer_wait(&spi_master_instance, rxBuffer, 1, 0xFF)) != STATUS_OK);
 		}while(rxBuffer[0] & 0x01);
 	}
-	// We need to delay because the GPIO is faster than the serial out 100 is sufficient for 1 byte => we have no idea how long this may take so max it out
-	for(int i = 0; i < 65535; i++);
 	port_pin_set_output_level(die_cs, true);
 	port_pin_set_output_level(S70FL01_EN, false);
 	spi_disable(&spi_master_instance);
 	spi_enabled = false;
-	S70FL01_active_die = S70FL01_CS1;
+	S70FL01_powered = false;
+	S70FL01_active_die = 0;
 	S70FL01_address = 0;
+	S70FL01_page_fill = 0;
+	S70FL01_sequence = 0;
+	S70FL01_oldest_die = 0;
+	S70FL01_oldest_address = 0;
+	// Nothing is known to be erased unless the chip was just erased
+	S70FL01_present = true;
+	S70FL01_writing = false;
+	S70FL01_erase_job.status = STATUS_OK;
+	S70FL01_page_index = 0;
+	S70FL01_page_job[0].status = STATUS_OK;
+	S70FL01_page_job[1].status = STATUS_OK;
+	S70FL01_erased_end = erase_chip ? S70FL01_ERASE_AHEAD + 1 : 0;
+	S70FL01_erase_stalls = 0;
+	S70FL01_program_errors = 0;
+	S70FL01_erase_errors = 0;
+	S70FL01_verify_failures = 0;
+	S70FL01_verify_count = 0;
+	S70FL01_verify_pending = 0;
 	return 1;
 	
 }
 
 /************************************************************************/
-/* @brief s70fl01_verified_write writes a byte to the memory module
-/* @params[in] byte data element to write
-/* @params[in] die the die to write to in the memory module
-/* @params[in] address the address to write to in the given die
-/* @returns 0 if failure 1 if successful
+/* @brief S70FL01_spi_clock switches the generator and baud rate of SERCOM2.
+/* The SPI module must be disabled. Does nothing if the generator is already in use
+/* @params[in] generator the GCLK generator to run SERCOM2 from
+/* @params[in] baudrate the SPI clock in Hz, at most half of the generator
+/* @returns none
 /************************************************************************/
-uint8_t S70FL01_verified_write(uint8_t byte, uint8_t die, uint32_t address)
+static void S70FL01_spi_clock(enum gclk_generator generator, uint32_t baudrate)
+{
+	if(S70FL01_spi_config.generator_source == generator) return;
+	S70FL01_spi_config.generator_source = generator;
+	S70FL01_spi_config.mode_specific.master.baudrate = baudrate;
+	spi_init(&spi_master_instance, SERCOM2, &S70FL01_spi_config);
+}
+
+/************************************************************************/
+/* @brief S70FL01_power_up powers the memory module and enables the SPI module
+/* on the fast clock. Does nothing if the module is already powered
+/* @params none
+/* @returns none
+/************************************************************************/
+static void S70FL01_power_up(void)
 {
 	if(!spi_enabled)
 	{
+		S70FL01_spi_clock(S70FL01_SPI_GCLK_FAST, S70FL01_SPI_BAUD_FAST);
 		spi_enable(&spi_master_instance);
 		spi_enabled = true;
 	}
-	// Enable the chip
-	port_pin_set_output_level(S70FL01_EN, true);
-	for(int i = 0; i < 65535; i++);
+	if(!S70FL01_powered)
+	{
+		// Enable the chip and give it tPU to come out of power on reset
+		port_pin_set_output_level(S70FL01_EN, true);
+		wait_us(S70FL01_TPU_US);
+		S70FL01_powered = true;
+	}
+}
+
+/************************************************************************/
+/* @brief S70FL01_power_down removes power from the memory module and disables the SPI module
+/* SERCOM2 goes back to the slow clock so nothing keeps OSC16M requested. Does nothing while a job is queued
+/* @params none
+/* @returns none
+/************************************************************************/
+static void S70FL01_power_down(void)
+{
+	// A program or erase is running, the last job to complete powers the chip down
+	if(S70FL01_jobs_pending()) return;
+	port_pin_set_output_level(S70FL01_EN, false);
+	S70FL01_powered = false;
+	spi_disable(&spi_master_instance);
+	spi_enabled = false;
+	S70FL01_spi_clock(S70FL01_SPI_GCLK_SLOW, S70FL01_SPI_BAUD_SLOW);
+}
+
+/************************************************************************/
+/* @brief S70FL01_send_command clocks out an instruction followed by a 4 byte address
+/* Only use with the 4 byte address instructions (4READ, 4PP, 4SE), the 3 byte ones
+/* wrap at 16 MB. The die must already be selected. spi_write_buffer_wait returns once
+/* the last bit has been shifted out, so CS# can be raised immediately afterwards.
+/* @params[in] command the instruction to send
+/* @params[in] address the address that follows the instruction
+/* @returns none
+/************************************************************************/
+static void S70FL01_send_command(uint8_t command, uint32_t address)
+{
+	uint8_t cmdBuffer[5] = {command, (address>>24) & 0xFF, (address>>16) & 0xFF, (address>>8) & 0xFF, (address>>0) & 0xFF};
+	while(spi_write_buffer_wait(&spi_master_instance, cmdBuffer, 5) != STATUS_OK);
+}
+
+/************************************************************************/
+/* @brief S70FL01_write_enable issues WREN to the given die
+/* @params[in] die the die index (0 or 1)
+/* @returns none
+/************************************************************************/
+static void S70FL01_write_enable(uint8_t die)
+{
+	uint8_t command = S70FL01_WREN;
+	port_pin_set_output_level(S70FL01_DIE_CS(die), false);
+	while(spi_write_buffer_wait(&spi_master_instance, &command, 1) != STATUS_OK);
+	port_pin_set_output_level(S70FL01_DIE_CS(die), true);
+}
+
+/************************************************************************/
+/* @brief S70FL01_read_status reads the status register of a die once
+/* @params[in] die the die index (0 or 1)
+/* @returns the value of the status register
+/************************************************************************/
+static uint8_t S70FL01_read_status(uint8_t die)
+{
+	uint8_t command = S70FL01_RDSR;
+	uint8_t statusReg;
+	port_pin_set_output_level(S70FL01_DIE_CS(die), false);
+	while(spi_write_buffer_wait(&spi_master_instance, &command, 1) != STATUS_OK);
+	while(spi_read_buffer_wait(&spi_master_instance, &statusReg, 1, 0xFF) != STATUS_OK);
+	port_pin_set_output_level(S70FL01_DIE_CS(die), true);
+	return statusReg;
+}
+
+/************************************************************************/
+/* @brief S70FL01_clear_status clears P_ERR and E_ERR after a failed program or
+/* erase, which also ends the operation, and drops the write enable latch
+/* @params[in] die the die index (0 or 1)
+/* @returns none
+/************************************************************************/
+static void S70FL01_clear_status(uint8_t die)
+{
+	uint8_t command = S70FL01_CLSR;
+	port_pin_set_output_level(S70FL01_DIE_CS(die), false);
+	while(spi_write_buffer_wait(&spi_master_instance, &command, 1) != STATUS_OK);
+	port_pin_set_output_level(S70FL01_DIE_CS(die), true);
 	
-	uint8_t rxBuffer[20];
-	uint8_t wrBuffer[5] = {S70FL01_PP, (address>>16) & 0xFF, (address>>8) & 0xFF, (address>>0) & 0xFF, byte};
-	uint8_t vfyBuffer[4] = {S70FL01_READ, (address>>16) & 0xFF, (address>>8) & 0xFF, (address>>0) & 0xFF};
-		
-	// Make sure our RXBuffer is empty
-	for(int i = 0; i < 20; i++){
-		rxBuffer[i] = 0;
+	command = S70FL01_WRDI;
+	port_pin_set_output_level(S70FL01_DIE_CS(die), false);
+	while(spi_write_buffer_wait(&spi_master_instance, &command, 1) != STATUS_OK);
+	port_pin_set_output_level(S70FL01_DIE_CS(die), true);
+}
+
+/************************************************************************/
+/* @brief S70FL01_verify_due applies the verify policy to a page that has just
+/* programmed without P_ERR
+/* @params none
+/* @returns true if the page should be read back
+/************************************************************************/
+static bool S70FL01_verify_due(void)
+{
+#if S70FL01_VERIFY_BYTES
+	return true;
+#else
+	if(S70FL01_verify_pending){
+		S70FL01_verify_pending--;
+		return true;
+	}
+#if S70FL01_VERIFY_SAMPLE_PAGES
+	if(++S70FL01_verify_count >= S70FL01_VERIFY_SAMPLE_PAGES){
+		S70FL01_verify_count = 0;
+		return true;
 	}
+#endif
+	return false;
+#endif
+}
+
+/************************************************************************/
+/* @brief S70FL01_page_verify reads back a programmed page and checks it against
+/* the data of its job. The page is read in one go and compared by CRC, or a byte
+/* at a time with S70FL01_VERIFY_BYTES
+/* @params[in] job the completed program job, its data must still be in place
+/* @returns 1 if the flash holds the data 0 otherwise
+/************************************************************************/
+static uint8_t S70FL01_page_verify(struct S70FL01_job * job)
+{
+#if S70FL01_VERIFY_BYTES
+	uint8_t readback;
 	
-	// Select chip
-	port_pin_set_output_level(die, false);
-	for(int i = 0; i < 1000; i++);
-	
-	// Wait for the module to be ready
-	while(!spi_is_ready_to_write(&spi_master_instance));
-	// Set WREN so we can write to memory
-	while(spi_write(&spi_master_instance, S70FL01_WREN) != STATUS_OK);
-	
-	// We need to delay because the GPIO is faster than the serial out
-	// Then give it a second to stabilize
-	for(int i = 0; i < 1000; i++);
-	port_pin_set_output_level(die, true);
-	for(int i = 0; i < 100; i++);
-	port_pin_set_output_level(die, false);
-	for(int i = 0; i < 500; i++);
-	
-	// Wait for the peripheral to be ready
-	while(!spi_is_ready_to_write(&spi_master_instance));
-	// Write the register
-	while((status = spi_write(&spi_master_instance, S70FL01_RDSR)) != STATUS_OK);
-	for(int i = 0; i < 1000; i++);
-	// Wait for the peripheral to be ready
-	while(!spi_is_ready_to_read(&spi_master_instance));
-	// Read back the contents of the shift reg
-	// For some reason, if the buffer length is set to 1 the readout does not occur
-	while((status = spi_read_buffer_wait(&spi_master_instance, rxBuffer, 20, 0xFF)) != STATUS_OK);
-	
-	if(!(rxBuffer[0] & 0x02)){
-		// WREN didn't work, so we don't need to waste time doing the rest of the operations.
-	 	port_pin_set_output_level(die, true);
-	 	port_pin_set_output_level(S70FL01_EN, false);
-		return 0;
+	for(uint16_t i = 0; i < job->length; i++){
+		S70FL01_probe(job->die, job->address + i, &readback, 1);
+		if(readback != job->data[i]) return 0;
 	}
+	return 1;
+#else
+	uint8_t readback[S70FL01_VERIFY_CHUNK];
+	uint32_t crc = CHECKSUM_SEED;
+	uint16_t remaining = job->length;
+	uint16_t chunk;
 	
-	// We need to delay because the GPIO is faster than the serial out
-	// Then give it a second to stabilize
-	for(int i = 0; i < 1000; i++);
-	port_pin_set_output_level(die, true);
-	for(int i = 0; i < 100; i++);
-	port_pin_set_output_level(die, false);
-	for(int i = 0; i < 500; i++);
-	
-	
-	// Wait for the module to be ready -- maybe not necessary here
-	while(!spi_is_ready_to_write(&spi_master_instance));
-	// Perform write operation
-	while(spi_write_buffer_wait(&spi_master_instance, wrBuffer, 5) != STATUS_OK);
-	
-	// We need to delay because the GPIO is faster than the serial out
-	// Then give it a second to stabilize
-	for(int i = 0; i < 500; i++);
-	port_pin_set_output_level(die, true);
-	for(int i = 0; i < 100; i++);
-	port_pin_set_output_level(die, false);
-	for(int i = 0; i < 500; i++);
-	
-	// Wait until the write completes (Status Reg 0x01)
-	// Wait for the module to be ready
-	while(!spi_is_ready_to_write(&spi_master_instance));
-	// Write the buffer to read back written data
-	while(spi_write(&spi_master_instance, S70FL01_RDSR) != STATUS_OK);
-	do{
-		// Wait for the peripheral to be ready
-		while(!spi_is_ready_to_read(&spi_master_instance));
-		// Read back the contents of the shift reg
-		status = spi_read_buffer_wait(&spi_master_instance, rxBuffer, 20, 0xFF);
-	}while(rxBuffer[0] & 0x01);
-	
-	// We need to delay because the GPIO is faster than the serial out
-	// Then give it a second to stabilize
-	for(int i = 0; i < 65535; i++);
-	port_pin_set_output_level(die, true);
-	for(int i = 0; i < 100; i++);
-	port_pin_set_output_level(die, false);
-	for(int i = 0; i < 500; i++);
-	
-	
-	// Wait for the module to be ready
-	while(!spi_is_ready_to_write(&spi_master_instance));
-	// Write the buffer to read back written data
-	while(spi_write_buffer_wait(&spi_master_instance, vfyBuffer, 4) != STATUS_OK);
-	// Read back the contents of the shift reg
-	// Wait for the peripheral to be ready
-	while(!spi_is_ready_to_read(&spi_master_instance));
-	while((status = spi_read_buffer_wait(&spi_master_instance, rxBuffer, 20, 0xFF)) != STATUS_OK);
-	// We need to delay because the GPIO is faster than the serial out 100 is sufficient for 1 byte => 2000 should be good
-	for(int i = 0; i < 2000; i++);
-	port_pin_set_output_level(die, true);
-	port_pin_set_output_level(S70FL01_EN, false);
-	spi_disable(&spi_master_instance);
-	spi_enabled = false;
-	return rxBuffer[0] == byte ? 1 : 0;
+	port_pin_set_output_level(S70FL01_DIE_CS(job->die), false);
+	S70FL01_send_command(S70FL01_4READ, job->address);
+	while(remaining){
+		chunk = remaining > S70FL01_VERIFY_CHUNK ? S70FL01_VERIFY_CHUNK : remaining;
+		while(spi_read_buffer_wait(&spi_master_instance, readback, chunk, 0xFF) != STATUS_OK);
+		crc = checksum_update(crc, readback, chunk);
+		remaining -= chunk;
+	}
+	port_pin_set_output_level(S70FL01_DIE_CS(job->die), true);
+	return crc == checksum_update(CHECKSUM_SEED, job->data, job->length) ? 1 : 0;
+#endif
 }
 
 /************************************************************************/
-/* @brief @s70fl01_read_byte reads a byte from the memory module
-/* @params[in,out] byte pointer to a data value that is populated with the readout value
-/* @params[in] die the die from which to read
-/* @params[in] address the starting address to read from
-/* @params[in] length the number of bytes to read
+/* @brief S70FL01_jobs_pending checks both job queues
+/* @params none
+/* @returns true while any job is queued or running
 /************************************************************************/
-uint8_t S70FL01_read_byte(uint8_t *byte, uint8_t die, uint32_t address, uint8_t length)
+static bool S70FL01_jobs_pending(void)
 {
-	if(!spi_enabled)
-	{
-		spi_enable(&spi_master_instance);
-		spi_enabled = true;
+	for(uint8_t die = 0; die < S70FL01_DIE_COUNT; die++){
+		if(S70FL01_job_head[die]) return true;
 	}
-	// Power the chip, and wait for a bit
-	port_pin_set_output_level(S70FL01_EN, true);
+	return false;
+}
+
+/************************************************************************/
+/* @brief S70FL01_job_tick_callback runs when the job timer expires and
+/* defers the status polls to the work queue
+/* @params[in] module the job timer
+/* @returns none
+/************************************************************************/
+static void S70FL01_job_tick_callback(struct tc_module *const module)
+{
+	work_post(S70FL01_job_service);
+}
+
+/************************************************************************/
+/* @brief S70FL01_job_tick starts the job timer for the next status poll. The
+/* shortest poll interval of the running jobs is used
+/* @params none
+/* @returns none
+/************************************************************************/
+static void S70FL01_job_tick(void)
+{
+	uint16_t ticks = 0;
+	uint16_t interval;
 	
-	uint8_t rxBuffer[20];
-	uint8_t rdBuffer[4] = {S70FL01_READ, (address>>16) & 0xFF, (address>>8) & 0xFF, (address>>0) & 0xFF};
+	for(uint8_t die = 0; die < S70FL01_DIE_COUNT; die++){
+		if(!S70FL01_job_head[die]) continue;
+		interval = (S70FL01_job_head[die]->type == S70FL01_JOB_ERASE) ? S70FL01_ERASE_POLL_TICKS : S70FL01_PROGRAM_POLL_TICKS;
+		if(!ticks || interval < ticks) ticks = interval;
+	}
+	if(!ticks) return;
+	
+	tc_set_compare_value(&S70FL01_job_tc, TC_COMPARE_CAPTURE_CHANNEL_0, ticks);
+	tc_start_counter(&S70FL01_job_tc);
+}
+
+/************************************************************************/
+/* @brief configure_S70FL01_jobs empties the job queues and sets up the job
+/* timer. It runs from the 32.768 kHz clock, so it wakes the core from STANDBY
+/* @params none
+/* @returns none
+/************************************************************************/
+static void configure_S70FL01_jobs(void)
+{
+	struct tc_config config_tc_job;
+	
+	for(uint8_t die = 0; die < S70FL01_DIE_COUNT; die++){
+		S70FL01_job_head[die] = NULL;
+		S70FL01_job_tail[die] = NULL;
+	}
+	
+	// One-shot, counts up to CC0 and stops until the next tick is started
+	tc_get_config_defaults(&config_tc_job);
+	config_tc_job.clock_source = S70FL01_JOB_GCLK;
+	config_tc_job.clock_prescaler = TC_CLOCK_PRESCALER_DIV1;
+	config_tc_job.counter_size = TC_COUNTER_SIZE_16BIT;
+	config_tc_job.wave_generation = TC_WAVE_GENERATION_MATCH_FREQ;
+	config_tc_job.oneshot = true;
+	config_tc_job.run_in_standby = true;
+	config_tc_job.counter_16_bit.compare_capture_channel[TC_COMPARE_CAPTURE_CHANNEL_0] = S70FL01_PROGRAM_POLL_TICKS;
+	tc_init(&S70FL01_job_tc, S70FL01_JOB_TC, &config_tc_job);
+	tc_register_callback(&S70FL01_job_tc, S70FL01_job_tick_callback, TC_CALLBACK_CC_CHANNEL0);
+	tc_enable_callback(&S70FL01_job_tc, TC_CALLBACK_CC_CHANNEL0);
+	tc_enable(&S70FL01_job_tc);
+	tc_stop_counter(&S70FL01_job_tc);
+}
+
+/************************************************************************/
+/* @brief S70FL01_job_issue sends the job at the head of a die's queue. Programs
+/* and erases are left running on the die, a read is done straight away
+/* @params[in] die the die index (0 or 1)
+/* @returns none
+/************************************************************************/
+static void S70FL01_job_issue(uint8_t die)
+{
+	struct S70FL01_job * job = S70FL01_job_head[die];
+	
+	S70FL01_power_up();
+	switch(job->type){
+	case S70FL01_JOB_PROGRAM:
+		// Instruction, address and the whole page are sent under a single CS# assertion
+		S70FL01_write_enable(die);
+		port_pin_set_output_level(S70FL01_DIE_CS(die), false);
+		S70FL01_send_command(S70FL01_4PP, job->address);
+		while(spi_write_buffer_wait(&spi_master_instance, job->data, job->length) != STATUS_OK);
+		port_pin_set_output_level(S70FL01_DIE_CS(die), true);
+		S70FL01_job_tick();
+		break;
+	case S70FL01_JOB_ERASE:
+		S70FL01_write_enable(die);
+		port_pin_set_output_level(S70FL01_DIE_CS(die), false);
+		S70FL01_send_command(S70FL01_4SE, job->address & ~(S70FL01_SECTOR_SIZE - 1));
+		port_pin_set_output_level(S70FL01_DIE_CS(die), true);
+		S70FL01_job_tick();
+		break;
+	case S70FL01_JOB_READ:
+		port_pin_set_output_level(S70FL01_DIE_CS(die), false);
+		S70FL01_send_command(S70FL01_4READ, job->address);
+		while(spi_read_buffer_wait(&spi_master_instance, job->data, job->length, 0xFF) != STATUS_OK);
+		port_pin_set_output_level(S70FL01_DIE_CS(die), true);
+		S70FL01_job_complete(die, STATUS_OK);
+		break;
+	}
+}
+
+/************************************************************************/
+/* @brief S70FL01_job_complete retires the job at the head of a die's queue,
+/* issues the next one and calls back. The chip is powered down once nothing
+/* is using it
+/* @params[in] die the die index (0 or 1)
+/* @params[in] result the status to complete the job with
+/* @returns none
+/************************************************************************/
+static void S70FL01_job_complete(uint8_t die, enum status_code result)
+{
+	struct S70FL01_job * job = S70FL01_job_head[die];
+	
+	S70FL01_job_head[die] = job->next;
+	if(!S70FL01_job_head[die]) S70FL01_job_tail[die] = NULL;
+	job->status = result;
+	
+	if(S70FL01_job_head[die]) S70FL01_job_issue(die);
+	if(job->callback) job->callback(job);
+	if(!S70FL01_writing && !S70FL01_read_active) S70FL01_power_down();
+}
+
+/************************************************************************/
+/* @brief S70FL01_job_poll reads the status of a die once and completes the
+/* running job if the die is done with it. The error flags are checked on every
+/* job, a page is only read back when the verify policy asks for it
+/* @params[in] die the die index (0 or 1)
+/* @returns none
+/************************************************************************/
+static void S70FL01_job_poll(uint8_t die)
+{
+	struct S70FL01_job * job = S70FL01_job_head[die];
+	uint8_t statusReg;
+	if(!job) return;
+	
+	// A failed program or erase sets P_ERR or E_ERR and keeps WIP set until the flags are cleared
+	statusReg = S70FL01_read_status(die);
+	if(statusReg & (S70FL01_SR_P_ERR | S70FL01_SR_E_ERR)){
+		S70FL01_clear_status(die);
+		if(job->type == S70FL01_JOB_ERASE){
+			S70FL01_erase_errors++;
+		}else{
+			S70FL01_program_errors++;
+		}
+		S70FL01_verify_pending = S70FL01_VERIFY_ERROR_PAGES;
+		S70FL01_job_complete(die, STATUS_ERR_IO);
+		return;
+	}
+	if(statusReg & S70FL01_SR_WIP) return;
+	
+	if(job->type == S70FL01_JOB_PROGRAM && S70FL01_verify_due() && !S70FL01_page_verify(job)){
+		S70FL01_verify_failures++;
+		S70FL01_verify_pending = S70FL01_VERIFY_ERROR_PAGES;
+		S70FL01_job_complete(die, STATUS_ERR_BAD_DATA);
+		return;
+	}
+	S70FL01_job_complete(die, STATUS_OK);
+}
+
+/************************************************************************/
+/* @brief S70FL01_job_service polls the busy dies and starts the timer again
+/* while there is still a job running. Posted by the job timer
+/* @params none
+/* @returns none
+/************************************************************************/
+void S70FL01_job_service(void)
+{
+	for(uint8_t die = 0; die < S70FL01_DIE_COUNT; die++){
+		S70FL01_job_poll(die);
+	}
+	S70FL01_job_tick();
+}
+
+/************************************************************************/
+/* @brief S70FL01_job_wait blocks until a job completes, for the paths that
+/* need the result straight away. The core sleeps between status polls
+/* @params[in] job the job to wait for
+/* @returns none
+/************************************************************************/
+static void S70FL01_job_wait(struct S70FL01_job * job)
+{
+	while(job->status == STATUS_BUSY){
+		if(S70FL01_job_head[job->die]->type == S70FL01_JOB_ERASE){
+			wait_ms(S70FL01_ERASE_POLL_MS);
+		}else{
+			wait_us(S70FL01_PROGRAM_POLL_US);
+		}
+		S70FL01_job_poll(job->die);
+	}
+}
+
+/************************************************************************/
+/* @brief S70FL01_die_wait blocks until the jobs queued on a die are done, before
+/* the die is used directly. The other die carries on meanwhile
+/* @params[in] die the die index (0 or 1)
+/* @returns none
+/************************************************************************/
+static void S70FL01_die_wait(uint8_t die)
+{
+	if(S70FL01_job_head[die]) S70FL01_job_wait(S70FL01_job_tail[die]);
+}
+
+/************************************************************************/
+/* @brief S70FL01_jobs_wait blocks until the jobs queued on both dies are done
+/* @params none
+/* @returns none
+/************************************************************************/
+static void S70FL01_jobs_wait(void)
+{
+	for(uint8_t die = 0; die < S70FL01_DIE_COUNT; die++){
+		S70FL01_die_wait(die);
+	}
+}
+
+/************************************************************************/
+/* @brief S70FL01_submit queues a page program, sector erase or read on its die.
+/* The dies run their queues independently. A program or erase runs while the core
+/* sleeps and completes from the work queue, a read completes before this returns.
+/* The job and its buffer must stay valid until status is no longer STATUS_BUSY.
+/* Not for use from ISRs.
+/* @params[in] job the job to run, a program must not cross a page boundary
+/* @returns none
+/************************************************************************/
+void S70FL01_submit(struct S70FL01_job * job)
+{
+	uint8_t die = job->die;
+	
+	job->next = NULL;
+	if(die >= S70FL01_DIE_COUNT || job->address >= S70FL01_die_size || (job->type != S70FL01_JOB_ERASE
+		&& (!job->length || (job->type == S70FL01_JOB_PROGRAM && job->length > S70FL01_PAGE_SIZE - (job->address & (S70FL01_PAGE_SIZE - 1)))))){
+		job->status = STATUS_ERR_INVALID_ARG;
+		if(job->callback) job->callback(job);
+		return;
+	}
+	
+	job->status = STATUS_BUSY;
+	if(S70FL01_job_head[die]){
+		S70FL01_job_tail[die]->next = job;
+		S70FL01_job_tail[die] = job;
+		return;
+	}
+	S70FL01_job_head[die] = job;
+	S70FL01_job_tail[die] = job;
+	S70FL01_job_issue(die);
+}
+
+/************************************************************************/
+/* @brief S70FL01_sector_count gives the number of sectors in the ring
+/* @params none
+/* @returns the sector count of both dies
+/************************************************************************/
+static uint32_t S70FL01_sector_count(void)
+{
+	return S70FL01_DIE_COUNT * (S70FL01_die_size / S70FL01_SECTOR_SIZE);
+}
+
+/************************************************************************/
+/* @brief S70FL01_sector_die gives the die a ring sector is on. Ring sectors
+/* alternate between the dies, so while one sector is written the next one
+/* can be erased on the other die
+/* @params[in] sector the sector number in the ring
+/* @returns the die index (0 or 1)
+/************************************************************************/
+static uint8_t S70FL01_sector_die(uint32_t sector)
+{
+	return sector % S70FL01_DIE_COUNT;
+}
+
+/************************************************************************/
+/* @brief S70FL01_sector_address gives the start address of a ring sector in its die
+/* @params[in] sector the sector number in the ring
+/* @returns the address of the first byte of the sector
+/************************************************************************/
+static uint32_t S70FL01_sector_address(uint32_t sector)
+{
+	return (sector / S70FL01_DIE_COUNT) * S70FL01_SECTOR_SIZE;
+}
+
+/************************************************************************/
+/* @brief S70FL01_ring_sector gives the ring sector that holds an address
+/* @params[in] die the die index (0 or 1)
+/* @params[in] address any address inside the sector
+/* @returns the sector number in the ring
+/************************************************************************/
+static uint32_t S70FL01_ring_sector(uint8_t die, uint32_t address)
+{
+	return (address / S70FL01_SECTOR_SIZE) * S70FL01_DIE_COUNT + die;
+}
+
+/************************************************************************/
+/* @brief S70FL01_head_sector gives the ring sector the write head is in
+/* @params none
+/* @returns the sector number in the ring
+/************************************************************************/
+static uint32_t S70FL01_head_sector(void)
+{
+	return S70FL01_ring_sector(S70FL01_active_die, S70FL01_address);
+}
+
+/************************************************************************/
+/* @brief S70FL01_erased_ahead counts the erased sectors from the one the
+/* write head is in
+/* @params none
+/* @returns 0 if the head sector is not erased, otherwise the head sector and the erased sectors after it
+/************************************************************************/
+static uint32_t S70FL01_erased_ahead(void)
+{
+	uint32_t sectorCount = S70FL01_sector_count();
+	return (S70FL01_erased_end + sectorCount - S70FL01_head_sector()) % sectorCount;
+}
+
+/************************************************************************/
+/* @brief S70FL01_erase_done records a completed erase-ahead job
+/* @params[in] job the erase job
+/* @returns none
+/************************************************************************/
+static void S70FL01_erase_done(struct S70FL01_job * job)
+{
+	if(job->status == STATUS_OK) S70FL01_erased_end = (S70FL01_erase_sector + 1) % S70FL01_sector_count();
+}
+
+/************************************************************************/
+/* @brief S70FL01_erase_start submits the erase of a ring sector on the erase job.
+/* If the sector holds the oldest data the oldest record moves on to the next sector,
+/* unless the oldest record is at the write head, which means the ring is empty.
+/* The erase job must not be running
+/* @params[in] sector the sector number in the ring
+/* @returns none
+/************************************************************************/
+static void S70FL01_erase_start(uint32_t sector)
+{
+	uint32_t next;
+	
+	if(S70FL01_ring_sector(S70FL01_oldest_die, S70FL01_oldest_address) == sector
+		&& !(S70FL01_oldest_die == S70FL01_active_die && S70FL01_oldest_address == S70FL01_address)){
+		next = (sector + 1) % S70FL01_sector_count();
+		S70FL01_oldest_die = S70FL01_sector_die(next);
+		S70FL01_oldest_address = S70FL01_sector_address(next) + S70FL01_SECTOR_HEADER_SIZE;
+	}
+	
+	S70FL01_erase_sector = sector;
+	S70FL01_erase_job.type = S70FL01_JOB_ERASE;
+	S70FL01_erase_job.die = S70FL01_sector_die(sector);
+	S70FL01_erase_job.address = S70FL01_sector_address(sector);
+	S70FL01_erase_job.data = NULL;
+	S70FL01_erase_job.length = 0;
+	S70FL01_erase_job.callback = S70FL01_erase_done;
+	S70FL01_submit(&S70FL01_erase_job);
+}
+
+/************************************************************************/
+/* @brief S70FL01_erase_ahead starts the erase of the next sector ahead of the
+/* write head if fewer than S70FL01_ERASE_AHEAD are erased. Only the die the head
+/* is not on is erased, so the writer carries on meanwhile, unless the head sector
+/* itself is not erased and the writer has to wait for it anyway. S70FL01_busy holds
+/* the writer off if it reaches the erasing die before the erase completes
+/* @params none
+/* @returns none
+/************************************************************************/
+void S70FL01_erase_ahead(void)
+{
+	if(!S70FL01_present || S70FL01_erase_job.status == STATUS_BUSY || S70FL01_read_active) return;
+	if(S70FL01_erased_ahead() > S70FL01_ERASE_AHEAD) return;
+	// The head sector itself is erased whatever die it is on, the writer is waiting for it
+	if(S70FL01_sector_die(S70FL01_erased_end) == S70FL01_active_die && S70FL01_erased_end != S70FL01_head_sector()) return;
+	
+	S70FL01_erase_start(S70FL01_erased_end);
+}
+
+/************************************************************************/
+/* @brief S70FL01_busy checks whether writing length bytes now would have to wait
+/* for a sector erase: the sectors the bytes go into are not erased yet, or one of
+/* their dies is erasing. The writer should come back later rather than stall on it
+/* @params[in] length the number of bytes about to be written, kept in one sector
+/* @returns true while the write would wait
+/************************************************************************/
+bool S70FL01_busy(uint16_t length)
+{
+	uint32_t sector = S70FL01_head_sector();
+	uint32_t needed = 1;
+	
+	// Too long for the rest of this sector, it goes to the start of the next one
+	if(length > S70FL01_write_space()){
+		sector = (sector + 1) % S70FL01_sector_count();
+		needed = 2;
+	}
+	if(S70FL01_erased_ahead() < needed) return true;
+	return S70FL01_erase_job.status == STATUS_BUSY
+		&& (S70FL01_erase_job.die == S70FL01_active_die || S70FL01_erase_job.die == S70FL01_sector_die(sector));
+}
+
+/************************************************************************/
+/* @brief S70FL01_page_program programs up to one page of data with a single
+/* Page Program instruction and waits for it. The data must not cross a page
+/* boundary. Use S70FL01_submit to carry on while the page programs.
+/* @params[in] die the die index (0 or 1)
+/* @params[in] address the address of the first byte to program
+/* @params[in] data pointer to the data to program
+/* @params[in] length the number of bytes to program (1 to S70FL01_PAGE_SIZE)
+/* @returns 0 if failure 1 if success
+/************************************************************************/
+uint8_t S70FL01_page_program(uint8_t die, uint32_t address, const uint8_t *data, uint16_t length)
+{
+	struct S70FL01_job job = {
+		.type = S70FL01_JOB_PROGRAM,
+		.die = die,
+		.address = address,
+		.data = (uint8_t *)data,
+		.length = length,
+		.callback = NULL,
+	};
+	
+	S70FL01_submit(&job);
+	S70FL01_job_wait(&job);
+	return job.status == STATUS_OK ? 1 : 0;
+}
+
+/************************************************************************/
+/* @brief S70FL01_sector_erase erases the sector that contains the given address
+/* and waits for it. Use S70FL01_submit to carry on while the sector erases.
+/* @params[in] die the die index (0 or 1)
+/* @params[in] address any address inside the sector to erase
+/* @returns 0 if failure 1 if success
+/************************************************************************/
+uint8_t S70FL01_sector_erase(uint8_t die, uint32_t address)
+{
+	struct S70FL01_job job = {
+		.type = S70FL01_JOB_ERASE,
+		.die = die,
+		.address = address,
+		.data = NULL,
+		.length = 0,
+		.callback = NULL,
+	};
+	
+	S70FL01_submit(&job);
+	S70FL01_job_wait(&job);
+	return job.status == STATUS_OK ? 1 : 0;
+}
+
+/************************************************************************/
+/* @brief S70FL01_write_begin starts a buffered write session at the current
+/* write head (S70FL01_active_die, S70FL01_address). The chip stays powered
+/* until S70FL01_write_end is called.
+/* @params none
+/* @returns none
+/************************************************************************/
+void S70FL01_write_begin(void)
+{
+	S70FL01_page_fill = 0;
+	S70FL01_writing = true;
+	S70FL01_power_up();
+}
+
+/************************************************************************/
+/* @brief S70FL01_write appends data to the page buffer. Every time the buffer
+/* reaches a page boundary it is committed with one Page Program.
+/* @params[in] data pointer to the data to write
+/* @params[in] length the number of bytes to write
+/* @returns 0 if any page program failed 1 if success
+/************************************************************************/
+uint8_t S70FL01_write(const uint8_t *data, uint16_t length)
+{
+	uint8_t * page = S70FL01_page_buffer[S70FL01_page_index];
+	uint8_t success = 1;
+	while(length--){
+		// Every sector starts with a header carrying its sequence number so S70FL01_mount can find the write head
+		if(!S70FL01_page_fill && !(S70FL01_address & (S70FL01_SECTOR_SIZE - 1))){
+			page[S70FL01_page_fill++] = S70FL01_SECTOR_MAGIC >> 8 & 0xFF;
+			page[S70FL01_page_fill++] = S70FL01_SECTOR_MAGIC >> 0 & 0xFF;
+			page[S70FL01_page_fill++] = S70FL01_sequence >> 24 & 0xFF;
+			page[S70FL01_page_fill++] = S70FL01_sequence >> 16 & 0xFF;
+			page[S70FL01_page_fill++] = S70FL01_sequence >> 8  & 0xFF;
+			page[S70FL01_page_fill++] = S70FL01_sequence >> 0  & 0xFF;
+			S70FL01_sequence++;
+		}
+		page[S70FL01_page_fill++] = *data++;
+		// Commit as soon as the buffered data reaches the end of the current page
+		if(S70FL01_page_fill >= S70FL01_PAGE_SIZE - (S70FL01_address & (S70FL01_PAGE_SIZE - 1))){
+			success &= S70FL01_write_flush();
+			page = S70FL01_page_buffer[S70FL01_page_index];
+		}
+	}
+	return success;
+}
+
+/************************************************************************/
+/* @brief S70FL01_write_flush submits whatever is in the page buffer and advances
+/* the write head. The page programs while the other buffer fills. When the end of
+/* a sector is reached the head moves to the next sector of the ring, which is on
+/* the other die. A failed page is reported by the flush that reuses its buffer.
+/* @params none
+/* @returns 0 if failure 1 if success
+/************************************************************************/
+uint8_t S70FL01_write_flush(void)
+{
+	struct S70FL01_job * job = &S70FL01_page_job[S70FL01_page_index];
+	uint32_t sector;
+	if(!S70FL01_page_fill) return 1;
+	// Entering a sector the erase-ahead has not got to yet, it has to be erased here. Writers that
+	// check S70FL01_busy first never get here, this is the fallback for those that don't
+	if(!S70FL01_erased_ahead()){
+		// The erase-ahead may be on this very sector, and only one erase is tracked at a time
+		S70FL01_job_wait(&S70FL01_erase_job);
+		if(!S70FL01_erased_ahead()){
+			S70FL01_erase_start(S70FL01_head_sector());
+			S70FL01_job_wait(&S70FL01_erase_job);
+			S70FL01_erase_stalls++;
+		}
+	}
+	sector = S70FL01_head_sector();
+	job->type = S70FL01_JOB_PROGRAM;
+	job->die = S70FL01_active_die;
+	job->address = S70FL01_address;
+	job->data = S70FL01_page_buffer[S70FL01_page_index];
+	job->length = S70FL01_page_fill;
+	job->callback = NULL;
+	S70FL01_submit(job);
+	
+	S70FL01_address += S70FL01_page_fill;
+	S70FL01_page_fill = 0;
+	// At the end of a sector move on to the next sector of the ring, on the other die
+	// After the last sector we restart at the beginning of the first die
+	if(!(S70FL01_address & (S70FL01_SECTOR_SIZE - 1))){
+		sector = (sector + 1) % S70FL01_sector_count();
+		S70FL01_active_die = S70FL01_sector_die(sector);
+		S70FL01_address = S70FL01_sector_address(sector);
+	}
+	
+	// Fill the other buffer next, once its page is programmed
+	S70FL01_page_index ^= 1;
+	S70FL01_job_wait(&S70FL01_page_job[S70FL01_page_index]);
+	return (job->status != STATUS_ERR_INVALID_ARG && S70FL01_page_job[S70FL01_page_index].status == STATUS_OK) ? 1 : 0;
+}
+
+/************************************************************************/
+/* @brief S70FL01_write_space gives the bytes that still fit in the sector the
+/* write head is in, after the sector header if that is still to be written
+/* @params none
+/* @returns the number of bytes
+/************************************************************************/
+uint32_t S70FL01_write_space(void)
+{
+	uint32_t offset = (S70FL01_address & (S70FL01_SECTOR_SIZE - 1)) + S70FL01_page_fill;
+	if(!offset) offset = S70FL01_SECTOR_HEADER_SIZE;
+	return S70FL01_SECTOR_SIZE - offset;
+}
+
+/************************************************************************/
+/* @brief S70FL01_write_next_sector flushes the page buffer and moves the write head
+/* to the start of the next sector of the ring. The rest of the current sector is left
+/* erased. Does nothing if nothing has been written to the current sector yet
+/* @params none
+/* @returns 0 if failure 1 if success
+/************************************************************************/
+uint8_t S70FL01_write_next_sector(void)
+{
+	uint8_t success = S70FL01_write_flush();
+	uint32_t sector;
+	
+	if(!(S70FL01_address & (S70FL01_SECTOR_SIZE - 1))) return success;
+	sector = (S70FL01_head_sector() + 1) % S70FL01_sector_count();
+	S70FL01_active_die = S70FL01_sector_die(sector);
+	S70FL01_address = S70FL01_sector_address(sector);
+	return success;
+}
+
+/************************************************************************/
+/* @brief S70FL01_write_end flushes the page buffer. The chip powers down once
+/* the last page is programmed
+/* @params none
+/* @returns 0 if failure 1 if success
+/************************************************************************/
+uint8_t S70FL01_write_end(void)
+{
+	uint8_t success = S70FL01_write_flush();
+	S70FL01_writing = false;
+	S70FL01_power_down();
+	return success;
+}
+
+/************************************************************************/
+/* @brief s70fl01_verified_write writes a byte to the memory module and checks it
+/* This is slow (one page program per byte), use the buffered writer for bulk data.
+/* The P_ERR flag is the check, with S70FL01_VERIFY_BYTES a read is queued behind
+/* the program as well. The core sleeps until the jobs are done
+/* @params[in] byte data element to write
+/* @params[in] die the die index (0 or 1) to write to in the memory module
+/* @params[in] address the address to write to in the given die
+/* @returns 0 if failure 1 if successful
+/************************************************************************/
+uint8_t S70FL01_verified_write(uint8_t byte, uint8_t die, uint32_t address)
+{
+	struct S70FL01_job program = {
+		.type = S70FL01_JOB_PROGRAM,
+		.die = die,
+		.address = address,
+		.data = &byte,
+		.length = 1,
+		.callback = NULL,
+	};
+#if S70FL01_VERIFY_BYTES
+	uint8_t readback = ~byte;
+	struct S70FL01_job read = {
+		.type = S70FL01_JOB_READ,
+		.die = die,
+		.address = address,
+		.data = &readback,
+		.length = 1,
+		.callback = NULL,
+	};
+	
+	S70FL01_submit(&program);
+	S70FL01_submit(&read);
+	S70FL01_job_wait(&read);
+	return (program.status == STATUS_OK && read.status == STATUS_OK && readback == byte) ? 1 : 0;
+#else
+	S70FL01_submit(&program);
+	S70FL01_job_wait(&program);
+	return program.status == STATUS_OK ? 1 : 0;
+#endif
+}
+
+/************************************************************************/
+/* @brief S70FL01_read_open starts a streaming read session. CS# stays low and the
+/* address auto-increments for as long as the session is open, so any amount of
+/* data can be read without re-issuing the read instruction. The jobs on both dies
+/* are finished first, the status polls would clash with the open read.
+/* @params[in] die the die index (0 or 1) to start reading from
+/* @params[in] address the address to start reading from
+/* @returns 0 if failure 1 if success
+/************************************************************************/
+uint8_t S70FL01_read_open(uint8_t die, uint32_t address)
+{
+	if(S70FL01_read_active || die >= S70FL01_DIE_COUNT || address >= S70FL01_die_size) return 0;
+	S70FL01_jobs_wait();
+	S70FL01_power_up();
+	
+	S70FL01_read_die = die;
+	S70FL01_read_address = address;
+	S70FL01_read_active = true;
+	
+	port_pin_set_output_level(S70FL01_DIE_CS(die), false);
+	S70FL01_send_command(S70FL01_4READ, address);
+	return 1;
+}
+
+/************************************************************************/
+/* @brief S70FL01_read clocks the next length bytes of the open session into buffer
+/* When the end of a sector is reached the read continues in the next sector of the ring, on the other die.
+/* @params[in,out] buffer pointer to the buffer that receives the data
+/* @params[in] length the number of bytes to read
+/* @returns 0 if no session is open 1 if success
+/************************************************************************/
+uint8_t S70FL01_read(uint8_t *buffer, uint32_t length)
+{
+	uint32_t chunk, sector;
+	if(!S70FL01_read_active) return 0;
+	
+	while(length){
+		// Don't read past the end of the sector, and stay within the 16 bit length of the SPI driver
+		sector = S70FL01_ring_sector(S70FL01_read_die, S70FL01_read_address);
+		chunk = S70FL01_SECTOR_SIZE - (S70FL01_read_address & (S70FL01_SECTOR_SIZE - 1));
+		if(chunk > length) chunk = length;
+		if(chunk > 0xFFFF) chunk = 0xFFFF;
 		
-	for(int i = 0; i < 20; i++)
-	{
-		rxBuffer[i] = 0;
+		while(spi_read_buffer_wait(&spi_master_instance, buffer, chunk, 0xFF) != STATUS_OK);
+		buffer += chunk;
+		length -= chunk;
+		S70FL01_read_address += chunk;
+		
+		// Crossed into the next sector of the ring, restart the read there on the other die
+		if(!(S70FL01_read_address & (S70FL01_SECTOR_SIZE - 1))){
+			port_pin_set_output_level(S70FL01_DIE_CS(S70FL01_read_die), true);
+			sector = (sector + 1) % S70FL01_sector_count();
+			S70FL01_read_die = S70FL01_sector_die(sector);
+			S70FL01_read_address = S70FL01_sector_address(sector);
+			// A job queued on the new die since the session opened has to finish before its CS# goes low
+			S70FL01_die_wait(S70FL01_read_die);
+			port_pin_set_output_level(S70FL01_DIE_CS(S70FL01_read_die), false);
+			S70FL01_send_command(S70FL01_4READ, S70FL01_read_address);
+		}
 	}
+	return 1;
+}
+
+/************************************************************************/
+/* @brief S70FL01_read_stream reads length bytes from the open session and hands
+/* them to callback in S70FL01_STREAM_CHUNK sized pieces. Lets SP1ML_transmit_flash,
+/* or any other offload path, move megabytes without a buffer the size of the transfer.
+/* @params[in] length the number of bytes to read
+/* @params[in] callback function that consumes each piece of data
+/* @returns 0 if no session is open 1 if success
+/************************************************************************/
+uint8_t S70FL01_read_stream(uint32_t length, void (*callback)(const uint8_t *data, uint16_t length))
+{
+	static uint8_t chunkBuffer[S70FL01_STREAM_CHUNK];
+	uint16_t chunk;
+	if(!S70FL01_read_active) return 0;
 	
-	// Power the chip, and wait for a bit
-	port_pin_set_output_level(S70FL01_EN, true);
-	for(int i = 0; i < 1000; i++);
+	while(length){
+		chunk = length > S70FL01_STREAM_CHUNK ? S70FL01_STREAM_CHUNK : length;
+		S70FL01_read(chunkBuffer, chunk);
+		callback(chunkBuffer, chunk);
+		length -= chunk;
+	}
+	return 1;
+}
+
+/************************************************************************/
+/* @brief S70FL01_read_close ends the streaming read session and powers the chip down
+/* @params none
+/* @returns none
+/************************************************************************/
+void S70FL01_read_close(void)
+{
+	if(!S70FL01_read_active) return;
+	port_pin_set_output_level(S70FL01_DIE_CS(S70FL01_read_die), true);
+	S70FL01_read_active = false;
+	S70FL01_power_down();
+}
+
+/************************************************************************/
+/* @brief @s70fl01_read_byte reads a few bytes from the memory module
+/* Convenience wrapper around a single read session
+/* @params[in,out] byte pointer to a data value that is populated with the readout value
+/* @params[in] die the die index (0 or 1) from which to read
+/* @params[in] address the starting address to read from
+/* @params[in] length the number of bytes to read
+/* @returns 0 if failure 1 if success
+/************************************************************************/
+uint8_t S70FL01_read_byte(uint8_t *byte, uint8_t die, uint32_t address, uint8_t length)
+{
+	if(!S70FL01_read_open(die, address)) return 0;
+	S70FL01_read(byte, length);
+	S70FL01_read_close();
+	return 1;
+}
+
+/************************************************************************/
+/* @brief S70FL01_probe reads a few bytes without opening a session
+/* The chip must already be powered
+/* @params[in] die the die index (0 or 1)
+/* @params[in] address the address to read from
+/* @params[in,out] buffer pointer to the buffer that receives the data
+/* @params[in] length the number of bytes to read
+/* @returns none
+/************************************************************************/
+static void S70FL01_probe(uint8_t die, uint32_t address, uint8_t *buffer, uint16_t length)
+{
+	port_pin_set_output_level(S70FL01_DIE_CS(die), false);
+	S70FL01_send_command(S70FL01_4READ, address);
+	while(spi_read_buffer_wait(&spi_master_instance, buffer, length, 0xFF) != STATUS_OK);
+	port_pin_set_output_level(S70FL01_DIE_CS(die), true);
+}
+
+/************************************************************************/
+/* @brief S70FL01_sector_sequence reads the header of a sector in the ring
+/* Sectors are numbered around the ring, alternating between the dies
+/* @params[in] sector the sector number in the ring
+/* @params[in,out] sequence populated with the sequence number of the sector
+/* @returns 0 if the sector has no valid header (erased) 1 if valid
+/************************************************************************/
+static uint8_t S70FL01_sector_sequence(uint32_t sector, uint32_t *sequence)
+{
+	uint8_t header[S70FL01_SECTOR_HEADER_SIZE];
 	
-	// Give it a second to stabilize
-	port_pin_set_output_level(die, false);
-	for(int i = 0; i < 1000; i++);
+	S70FL01_probe(S70FL01_sector_die(sector), S70FL01_sector_address(sector), header, S70FL01_SECTOR_HEADER_SIZE);
+	if(((uint16_t)header[0] << 8 | header[1]) != S70FL01_SECTOR_MAGIC) return 0;
+	*sequence = (uint32_t)header[2] << 24 | (uint32_t)header[3] << 16 | (uint32_t)header[4] << 8 | header[5];
+	return 1;
+}
+
+/************************************************************************/
+/* @brief S70FL01_mount recovers the write head and the oldest record after a reset
+/* Sector headers carry increasing sequence numbers, so going around the ring they
+/* increase up to the last written sector and are erased or older after it. That
+/* boundary is found with a binary search over the sector headers, which takes about
+/* 10 reads instead of a scan of both dies. Writing resumes at the start of the next
+/* sector, the end of the data in the last one is not reliable after a reset (a page
+/* may have been cut short) so it is left as it is. Must be called after configure_S70FL01.
+/* @params none
+/* @returns 0 if the memory is blank 1 if existing data was found
+/************************************************************************/
+uint8_t S70FL01_mount(void)
+{
+	uint32_t sectorCount = S70FL01_sector_count();
+	uint32_t first, low, high, mid, oldest, sector;
+	uint32_t headSequence = 0, sequence;
+	uint8_t found = 0;
+	
+	S70FL01_jobs_wait();
+	S70FL01_power_up();
 	
+	// Find a reference sector, the ones at the start of the ring may be erased if the ring has wrapped
+	for(first = 0; first < S70FL01_MOUNT_PROBES; first++){
+		if(S70FL01_sector_sequence(first, &headSequence)){
+			found = 1;
+			break;
+		}
+	}
+	if(!found){
+		// Blank memory, start at the beginning of the first die
+		S70FL01_active_die = 0;
+		S70FL01_address = 0;
+		S70FL01_sequence = 0;
+		S70FL01_oldest_die = 0;
+		S70FL01_oldest_address = 0;
+		S70FL01_erased_end = 0;
+		S70FL01_power_down();
+		return 0;
+	}
 	
-	// Wait for the module to be ready
-	while(!spi_is_ready_to_write(&spi_master_instance));
-	// Write the buffer to read back written data
-	while(spi_write_buffer_wait(&spi_master_instance, rdBuffer, 4) != STATUS_OK);
-	// Read back the contents of the shift reg
-	// Wait for the peripheral to be ready
-	while(!spi_is_ready_to_read(&spi_master_instance));
-	while((status = spi_read_buffer_wait(&spi_master_instance, rxBuffer, 20, 0xFF)) != STATUS_OK);
+	// Binary search for the last sector that is newer than the reference, that is the last written sector
+	low = first;
+	high = sectorCount;
+	while(high - low > 1){
+		mid = low + (high - low) / 2;
+		if(S70FL01_sector_sequence(mid, &sequence) && sequence >= headSequence){
+			low = mid;
+			headSequence = sequence;
+		}else{
+			high = mid;
+		}
+	}
 	
-	for(int i = 0; i < length; i++){
-		byte[i] = rxBuffer[i];	
+	// The oldest data is in the first valid sector after the head, if there is none the ring has not wrapped yet
+	oldest = first;
+	for(uint32_t i = 1; i <= S70FL01_MOUNT_PROBES; i++){
+		sector = (low + i) % sectorCount;
+		if(S70FL01_sector_sequence(sector, &sequence) && sequence < headSequence){
+			oldest = sector;
+			break;
+		}
 	}
-	// We need to delay because the GPIO is faster than the serial out 100 is sufficient for 1 byte => 2000 should be good
-	for(int i = 0; i < 65535; i++);
-	port_pin_set_output_level(die, true);
-	port_pin_set_output_level(S70FL01_EN, false);
-	spi_disable(&spi_master_instance);
-	spi_enabled = false;
+	S70FL01_oldest_die = S70FL01_sector_die(oldest);
+	S70FL01_oldest_address = S70FL01_sector_address(oldest) + S70FL01_SECTOR_HEADER_SIZE;
+	
+	// Resume at the start of the next sector. The rest of the last written sector stays erased, readers move on to
+	// the next sector when they reach erased flash (see Record.h)
+	sector = (low + 1) % sectorCount;
+	S70FL01_active_die = S70FL01_sector_die(sector);
+	S70FL01_address = S70FL01_sector_address(sector);
+	S70FL01_sequence = headSequence + 1;
+	S70FL01_page_fill = 0;
+	// The new head sector may still hold the oldest data, nothing is known to be erased
+	S70FL01_erased_end = sector;
+	
+	S70FL01_power_down();
 	return 1;
 }
\ No newline at end of file
@@ -16,18 +16,128 @@
 #define S70FL01_READ		0x03
 #define S70FL01_RDID		0x9F
 #define S70FL01_SE			0xD8
+#define S70FL01_4READ		0x13
+#define S70FL01_4PP			0x12
+#define S70FL01_4SE			0xDC
 #define S70FL01_BE			0xC7
 #define S70FL01_PP			0x02
 #define S70FL01_DP			0xB9
 #define S70FL01_RES			0xAB
+#define S70FL01_CLSR		0x30
 #define S70FL01_EN			PIN_PA18
 #define S70FL01_CS1			PIN_PA05
 #define S70FL01_CS2			PIN_PA04
-#define S70FL01_MAX_ADDR	(1<<29)
+// Per die capacity in bytes if the CFI query fails, the real size is read into S70FL01_die_size
+#define S70FL01_MAX_ADDR	(1UL<<26)
+
+/* Timing */
+#define S70FL01_TPU_US		300
+
+/* SPI clocks */
+// While the chip is powered SERCOM2 runs from the 4 MHz OSC16M generator, the SPI clock is at most half of it.
+// Configuration and the power off state use XOSC32K
+#define S70FL01_SPI_GCLK_FAST	GCLK_GENERATOR_2
+#define S70FL01_SPI_BAUD_FAST	2000000UL
+#define S70FL01_SPI_GCLK_SLOW	GCLK_GENERATOR_1
+#define S70FL01_SPI_BAUD_SLOW	10000UL
+
+/* Status register bits */
+#define S70FL01_SR_WIP		0x01
+#define S70FL01_SR_WEL		0x02
+#define S70FL01_SR_E_ERR	0x20
+#define S70FL01_SR_P_ERR	0x40
+
+/* RDID response layout (ID bytes followed by the CFI table) */
+#define S70FL01_RDID_LENGTH		0x28
+#define S70FL01_CFI_QRY_OFFSET	0x10
+#define S70FL01_CFI_SIZE_OFFSET	0x27
+
+/* Geometry. The ring is laid out sector by sector alternating between the dies */
+#define S70FL01_PAGE_SIZE	256
+#define S70FL01_SECTOR_SIZE	(1UL<<18)
+
+/* Sector header written at the start of every sector: magic (2 bytes) then sequence number (4 bytes) */
+#define S70FL01_SECTOR_MAGIC		0x444C
+#define S70FL01_SECTOR_HEADER_SIZE	6
+// Number of erased sectors S70FL01_mount will step over when looking for the start and end of the ring
+#define S70FL01_MOUNT_PROBES		8
+// Sectors kept erased ahead of the one the write head is in. The erased gap has to stay within the mount probes.
+// Sectors alternate dies and only the die the head is not on is erased, so more than 1 is never reached
+#define S70FL01_ERASE_AHEAD			1
+#if S70FL01_ERASE_AHEAD >= S70FL01_MOUNT_PROBES
+#error S70FL01_ERASE_AHEAD must be less than S70FL01_MOUNT_PROBES
+#endif
+// Job timer, one-shot on the 32.768 kHz clock so it keeps running while the core is in STANDBY
+#define S70FL01_JOB_TC		TC0
+#define S70FL01_JOB_GCLK	GCLK_GENERATOR_3
+// Status poll intervals while a page programs (tPP 0.25 ms typical) and while a sector erases (tSE 0.5 s typical, 2 s max)
+#define S70FL01_PROGRAM_POLL_US		500
+#define S70FL01_ERASE_POLL_MS		50
+#define S70FL01_PROGRAM_POLL_TICKS	((S70FL01_PROGRAM_POLL_US * 32768UL + 999999UL) / 1000000UL)
+#define S70FL01_ERASE_POLL_TICKS	((S70FL01_ERASE_POLL_MS * 32768UL) / 1000UL)
+// Verify policy. Every program and erase is checked with the P_ERR/E_ERR status flags. On top of that one page in
+// S70FL01_VERIFY_SAMPLE_PAGES (0 for none) is read back and checked by CRC, and so are the S70FL01_VERIFY_ERROR_PAGES
+// pages after a failure
+#define S70FL01_VERIFY_SAMPLE_PAGES	64
+#define S70FL01_VERIFY_ERROR_PAGES	16
+#define S70FL01_VERIFY_CHUNK		32
+// Set to 1 to read back every programmed byte with its own read instruction, for debugging the flash path only
+#define S70FL01_VERIFY_BYTES		0
+
+#define S70FL01_DIE_COUNT	2
+#define S70FL01_DIE_CS(die)	((die) ? S70FL01_CS2 : S70FL01_CS1)
+
+enum S70FL01_job_type {
+	S70FL01_JOB_PROGRAM,
+	S70FL01_JOB_ERASE,
+	S70FL01_JOB_READ,
+};
+
+/************************************************************************/
+/* A flash operation queued with S70FL01_submit
+/*	type - page program, sector erase or read
+/*	die - the die index (0 or 1)
+/*	address - the first byte to program or read, or any address in the sector to erase
+/*	data - the bytes to program or the buffer to read into, unused for an erase
+/*	length - the number of bytes, a program must not cross a page boundary
+/*	callback - called from the main loop when the job completes, may be NULL
+/*	status - STATUS_BUSY until the job completes, then STATUS_OK, STATUS_ERR_INVALID_ARG,
+/*		STATUS_ERR_IO if the flash flagged a failure or STATUS_ERR_BAD_DATA if the readback did not match
+/*	next - used by the driver to queue the job
+/************************************************************************/
+struct S70FL01_job {
+	enum S70FL01_job_type type;
+	uint8_t die;
+	uint32_t address;
+	uint8_t * data;
+	uint16_t length;
+	void (*callback)(struct S70FL01_job * job);
+	volatile enum status_code status;
+	struct S70FL01_job * next;
+};
 
 uint8_t configure_S70FL01(uint8_t die_cs, bool erase_chip);
 uint8_t S70FL01_verified_write(uint8_t byte, uint8_t die, uint32_t address);
 uint8_t S70FL01_read_byte(uint8_t *byte, uint8_t die, uint32_t address, uint8_t length);
+/* Read sessions. S70FL01_read_stream hands the data to its callback in S70FL01_STREAM_CHUNK sized pieces */
+#define S70FL01_STREAM_CHUNK	64
+uint8_t S70FL01_read_open(uint8_t die, uint32_t address);
+uint8_t S70FL01_read(uint8_t *buffer, uint32_t length);
+uint8_t S70FL01_read_stream(uint32_t length, void (*callback)(const uint8_t *data, uint16_t length));
+void S70FL01_read_close(void);
+uint8_t S70FL01_mount(void);
+uint8_t S70FL01_sector_erase(uint8_t die, uint32_t address);
+void S70FL01_erase_ahead(void);
+bool S70FL01_busy(uint16_t length);
+void S70FL01_submit(struct S70FL01_job * job);
+void S70FL01_job_service(void);
+uint8_t S70FL01_page_program(uint8_t die, uint32_t address, const uint8_t *data, uint16_t length);
+void S70FL01_write_begin(void);
+uint8_t S70FL01_write(const uint8_t *data, uint16_t length);
+uint8_t S70FL01_write_flush(void);
+uint32_t S70FL01_write_space(void);
+uint8_t S70FL01_write_next_sector(void);
+uint8_t S70FL01_write_end(void);
 
 
 #endif /* S70FL01_H_ */
\ No newline at end of file
@@ -6,6 +6,20 @@
 #include "HAL.h"
 #include <asf.h>
 
+// CRC of the flash transfer being sent, built up a chunk at a time
+static uint32_t SP1ML_crc;
+
+/************************************************************************/
+/* @brief SP1ML_transmit_crc sends a CRC as the big endian trailer of a transfer
+/* @params [in] crc, the finished CRC-32
+/* @returns none
+/************************************************************************/
+static void SP1ML_transmit_crc(uint32_t crc)
+{
+	uint8_t trailer[CHECKSUM_SIZE] = {crc >> 24 & 0xFF, crc >> 16 & 0xFF, crc >> 8 & 0xFF, crc >> 0 & 0xFF};
+	status = usart_write_buffer_wait(&usart_instance, trailer, CHECKSUM_SIZE);
+}
+
 /************************************************************************/
 /* @brief configure_SP1ML configures the sp1ml radio module including the SAM L21 USART module
 /* @params none
@@ -83,8 +97,8 @@ uint8_t SP1ML_set_baud(uint32_t rate)
 	// Turn the radio on
 	port_pin_set_output_level(SP1ML_EN_PIN, true);
 	
-	// Give the part some time to stabilize. This is a busy wait and is not energy efficient. Change me
-	for(int i = 0; i < 65535; i++);
+	// Give the part some time to stabilize, the core sleeps while we wait
+	wait_ms(SP1ML_SETTLE_MS);
 	// Zero out the entire buffer
 	for(int i = 0; i < 24; i++)
 	{
@@ -100,14 +114,14 @@ uint8_t SP1ML_set_baud(uint32_t rate)
 	// Set up the string that contains the baudrate
 	sprintf(ucRateStr, "ATS00=%+06d\r", rate);
 	
-	for(int i = 0; i < 65535; i++);
+	wait_ms(SP1ML_SETTLE_MS);
 	
 	status = usart_write_buffer_wait(&usart_instance, ucRateStr, 13);
 	
 	// Now that the rate has changed, we also need to shut down the SAM L21 buffer, set the new baudrate, then restart it
-	for(int i = 0; i < 65535; i++);
+	wait_ms(SP1ML_SETTLE_MS);
 	usart_disable(&usart_instance);
-	for(int i = 0; i < 65535; i++);
+	wait_ms(SP1ML_SETTLE_MS);
 	config_usart.baudrate = rate;
 	while ((status = usart_init(&usart_instance, SERCOM0, &config_usart)) != STATUS_OK);
 	usart_enable(&usart_instance);
@@ -147,7 +161,7 @@ uint8_t SP1ML_set_output_power(int8_t power)
 	// When the baudrate is not changed the SAM L21 cannot interpret the packets from the SP1ML
 	// Also handles waking up and correct mode.
 	SP1ML_set_baud(9600);
-	for(int i = 0; i < 65535; i++);
+	wait_ms(SP1ML_SETTLE_MS);
 	
 	// Zero out the buffer
 	for(int i = 0; i < 24; i++){
@@ -160,7 +174,7 @@ uint8_t SP1ML_set_output_power(int8_t power)
 	status = usart_write_buffer_wait(&usart_instance, ucPwrStr, 10);
 	status = usart_read_buffer_wait(&usart_instance, recv_buff, 24);
 	
-	for(int i = 0; i < 65535; i++);
+	wait_ms(SP1ML_SETTLE_MS);
 	
 	status = usart_write_buffer_wait(&usart_instance, ucTransmitPowerQuery, 7);
 	status = usart_read_buffer_wait(&usart_instance, recv_buff, 24);
@@ -171,7 +185,7 @@ uint8_t SP1ML_set_output_power(int8_t power)
 }
 
 /************************************************************************/
-/* @brief SP1ML_transmit_data transmits data via the SP1ML
+/* @brief SP1ML_transmit_data transmits data via the SP1ML followed by its CRC-32
 /* @params [in] data, a pointer to an array of characters to transmit
 /* @params [in] length, the number of characters to transmit
 /* @returns none
@@ -191,8 +205,61 @@ void SP1ML_transmit_data(uint8_t * data, uint16_t length)
 	SP1ML_enter_op_mode();
 	
 	// While in operating mode, the radio will broadcast anything that it receives over USART
-	for(int i = 0; i < length; i++){
-		status = usart_write_buffer_wait(&usart_instance, (data + i), 8);	
+	status = usart_write_buffer_wait(&usart_instance, data, length);
+	SP1ML_transmit_crc(checksum_crc32(data, length));
+	
+	// Turn the radio off
+	port_pin_set_output_level(SP1ML_EN_PIN, false);
+	
+	// Disable the usart again to save power
+	usart_disable(&usart_instance);
+	usart_enabled = false;
+	
+}
+
+/************************************************************************/
+/* @brief SP1ML_transmit_chunk S70FL01_read_stream callback that sends a chunk over the air
+/* @params [in] data, pointer to the chunk read from flash
+/* @params [in] length, the number of bytes in the chunk
+/* @returns none
+/************************************************************************/
+static void SP1ML_transmit_chunk(const uint8_t * data, uint16_t length)
+{
+	SP1ML_crc = checksum_update(SP1ML_crc, data, length);
+	status = usart_write_buffer_wait(&usart_instance, data, length);
+}
+
+/************************************************************************/
+/* @brief SP1ML_transmit_flash streams a region of the S70FL01 straight out over the radio
+/* followed by the CRC-32 of the region. The radio and the flash are each powered once
+/* for the whole transfer
+/* @params [in] die, the die index (0 or 1) to start reading from
+/* @params [in] address, the address to start reading from
+/* @params [in] length, the number of bytes to transmit
+/* @returns 0 if failure 1 if success
+/************************************************************************/
+uint8_t SP1ML_transmit_flash(uint8_t die, uint32_t address, uint32_t length)
+{
+	// If the usart is disable then enable it
+	if(!usart_enabled){
+		while ((status = usart_init(&usart_instance, SERCOM0, &config_usart)) != STATUS_OK);
+		usart_enable(&usart_instance);
+		usart_enabled = true;
+	}
+	
+	// Turn the radio on
+	port_pin_set_output_level(SP1ML_EN_PIN, true);
+	// Enter operating mode -- Handles waking up.
+	SP1ML_enter_op_mode();
+	
+	// One continuous read, handed to the USART a chunk at a time
+	if(S70FL01_read_open(die, address)){
+		SP1ML_crc = CHECKSUM_SEED;
+		S70FL01_read_stream(length, SP1ML_transmit_chunk);
+		S70FL01_read_close();
+		SP1ML_transmit_crc(~SP1ML_crc);
+	}else{
+		length = 0;
 	}
 	
 	// Turn the radio off
@@ -202,6 +269,7 @@ void SP1ML_transmit_data(uint8_t * data, uint16_t length)
 	usart_disable(&usart_instance);
 	usart_enabled = false;
 	
+	return length ? 1 : 0;
 }
 
 /************************************************************************/
@@ -224,7 +292,7 @@ void SP1ML_transmit_debug(void)
 	
 	// The output power that seems to broadcast the most powerfully is 7 dBm
 	SP1ML_set_output_power(7);
-	for(int i = 0; i < 65535; i++);
+	wait_ms(SP1ML_SETTLE_MS);
 	
 	for(int i = 0; i < 24; i++){
 		recv_buff[i] = 0;
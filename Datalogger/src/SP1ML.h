@@ -15,6 +15,9 @@
 #define SP1ML_SHDN_PIN	PIN_PA02
 #define SP1ML_EN_PIN	PIN_PA27
 
+// Time given to the module between power up and AT commands
+#define SP1ML_SETTLE_MS	100
+
 /* SP1ML prototype definitions */
 void configure_SP1ML(void);
 uint8_t SP1ML_set_baud(uint32_t rate);
@@ -23,5 +26,6 @@ void SP1ML_enter_op_mode(void);
 void SP1ML_enter_cmd_mode(void);
 void SP1ML_transmit_debug(void);
 void SP1ML_transmit_data(uint8_t * data, uint16_t length);
+uint8_t SP1ML_transmit_flash(uint8_t die, uint32_t address, uint32_t length);
 
 #endif /* SP1ML_H_ */
\ No newline at end of file
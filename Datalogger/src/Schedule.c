@@ -0,0 +1,207 @@
+/************************************************************************/
+/* @file Schedule.c
+/* @brief Task scheduler on RTC ALARM0. Every task has an absolute deadline,
+/* the alarm is set to the next wake and the due tasks run from the work
+/* queue. Deadlines that fall within the slack of each other share one wake.
+/************************************************************************/
+
+#include <asf.h>
+#include "HAL.h"
+
+static struct schedule_entry schedule[SCHEDULE_TASKS];
+
+// Days before the first of each month in a common year
+static const uint16_t schedule_month_days[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+/************************************************************************/
+/* @brief schedule_to_seconds converts a calendar time to seconds since the epoch.
+/* Every fourth year is a leap year over the years the RTC calendar can hold
+/* @params[in] time the calendar time, 24 hour
+/* @returns the seconds since SCHEDULE_EPOCH_YEAR
+/************************************************************************/
+static uint32_t schedule_to_seconds(const struct rtc_calendar_time * time)
+{
+	uint16_t years = time->year - SCHEDULE_EPOCH_YEAR;
+	uint32_t days;
+	
+	// The epoch year is a leap year, so (years + 3) / 4 leap days went before this year
+	days = years * 365UL + (years + 3) / 4 + schedule_month_days[time->month - 1] + time->day - 1;
+	if(time->month > 2 && !(years & 3)) days++;
+	
+	return ((days * 24 + time->hour) * 60 + time->minute) * 60 + time->second;
+}
+
+/************************************************************************/
+/* @brief schedule_from_seconds converts seconds since the epoch to a calendar time
+/* @params[in] seconds the seconds since SCHEDULE_EPOCH_YEAR
+/* @params[out] time the calendar time, 24 hour
+/* @returns none
+/************************************************************************/
+static void schedule_from_seconds(uint32_t seconds, struct rtc_calendar_time * time)
+{
+	uint32_t days = seconds / 86400UL;
+	uint16_t year_days;
+	uint8_t month;
+	bool leap;
+	
+	seconds %= 86400UL;
+	time->second = seconds % 60;
+	time->minute = (seconds / 60) % 60;
+	time->hour = seconds / 3600;
+	time->pm = 0;
+	
+	time->year = SCHEDULE_EPOCH_YEAR;
+	year_days = 366;
+	while(days >= year_days){
+		days -= year_days;
+		time->year++;
+		year_days = (time->year & 3) ? 365 : 366;
+	}
+	
+	// days is now the day of the year, find the last month that starts on or before it
+	leap = !(time->year & 3);
+	for(month = 11; (uint32_t)schedule_month_days[month] + (leap && month >= 2) > days; month--);
+	time->month = month + 1;
+	time->day = days - schedule_month_days[month] - (leap && month >= 2) + 1;
+}
+
+/************************************************************************/
+/* @brief schedule_arm sets ALARM0 to the next wake. The wake is put off from the
+/* earliest deadline to the last deadline that still keeps every task within its
+/* slack, so all tasks due by then run in the one wake
+/* @params none
+/* @returns none
+/************************************************************************/
+static void schedule_arm(void)
+{
+	struct rtc_calendar_alarm_time alarm;
+	uint32_t wake = UINT32_MAX;
+	uint32_t limit = UINT32_MAX;
+	uint8_t task;
+	
+	for(task = 0; task < SCHEDULE_TASKS; task++){
+		if(!schedule[task].armed) continue;
+		if(schedule[task].deadline < wake) wake = schedule[task].deadline;
+		if(schedule[task].deadline + schedule[task].slack < limit) limit = schedule[task].deadline + schedule[task].slack;
+	}
+	// Nothing to wake for. A stale alarm only runs an empty service
+	if(wake == UINT32_MAX) return;
+	
+	for(task = 0; task < SCHEDULE_TASKS; task++){
+		if(schedule[task].armed && schedule[task].deadline <= limit && schedule[task].deadline > wake) wake = schedule[task].deadline;
+	}
+	
+	// Match on the full date and time, the alarm fires once
+	schedule_from_seconds(wake, &alarm.time);
+	alarm.mask = RTC_CALENDAR_ALARM_MASK_YEAR;
+	rtc_calendar_set_alarm(&rtc_instance, &alarm, RTC_CALENDAR_ALARM_0);
+	
+	// A wake that is already due, or went by while the alarm was written, never matches
+	if(schedule_now() >= wake) work_post(schedule_service);
+}
+
+/************************************************************************/
+/* @brief configure_schedule empties the task table and clears the statistics.
+/* Call after configure_rtc
+/* @params none
+/* @returns none
+/************************************************************************/
+void configure_schedule(void)
+{
+	uint8_t task;
+	
+	for(task = 0; task < SCHEDULE_TASKS; task++){
+		schedule[task].armed = false;
+	}
+	schedule_wakes = 0;
+	schedule_runs = 0;
+	schedule_missed = 0;
+}
+
+/************************************************************************/
+/* @brief schedule_now reads the RTC
+/* @params none
+/* @returns the current time in seconds since SCHEDULE_EPOCH_YEAR
+/************************************************************************/
+uint32_t schedule_now(void)
+{
+	struct rtc_calendar_time time;
+	rtc_calendar_get_time(&rtc_instance, &time);
+	return schedule_to_seconds(&time);
+}
+
+/************************************************************************/
+/* @brief schedule_at (re)starts a task. Not for use from ISRs
+/* @params[in] task the task slot
+/* @params[in] deadline the first deadline, seconds since SCHEDULE_EPOCH_YEAR
+/* @params[in] period the seconds between deadlines, 0 to run once
+/* @params[in] slack the seconds the task may run late to share a wake
+/* @params[in] handler the function to run, from the work queue
+/* @returns none
+/************************************************************************/
+void schedule_at(enum schedule_task task, uint32_t deadline, uint32_t period, uint16_t slack, void (*handler)(void))
+{
+	schedule[task].handler = handler;
+	schedule[task].deadline = deadline;
+	schedule[task].period = period;
+	schedule[task].slack = slack;
+	schedule[task].armed = true;
+	schedule_arm();
+}
+
+/************************************************************************/
+/* @brief schedule_set_period changes the period of a periodic task. Called from
+/* the task's own handler it already sets the deadline that follows this run
+/* @params[in] task the task slot
+/* @params[in] period the seconds between deadlines
+/* @returns none
+/************************************************************************/
+void schedule_set_period(enum schedule_task task, uint32_t period)
+{
+	schedule[task].period = period;
+}
+
+/************************************************************************/
+/* @brief schedule_cancel stops a task
+/* @params[in] task the task slot
+/* @returns none
+/************************************************************************/
+void schedule_cancel(enum schedule_task task)
+{
+	schedule[task].armed = false;
+}
+
+/************************************************************************/
+/* @brief schedule_service runs the due tasks and sets the next wake. Posted to
+/* the work queue by the ALARM0 callback
+/* @params none
+/* @returns none
+/************************************************************************/
+void schedule_service(void)
+{
+	struct schedule_entry * entry;
+	uint32_t now = schedule_now();
+	uint32_t deadline;
+	uint8_t task;
+	
+	schedule_wakes++;
+	for(task = 0; task < SCHEDULE_TASKS; task++){
+		entry = &schedule[task];
+		if(!entry->armed || entry->deadline > now) continue;
+		
+		deadline = entry->deadline;
+		if(!entry->period) entry->armed = false;
+		entry->handler();
+		schedule_runs++;
+		
+		// Step a periodic task on from its own deadline, unless the handler moved it
+		if(entry->armed && entry->period && entry->deadline == deadline){
+			entry->deadline += entry->period;
+			while(entry->deadline <= now){
+				entry->deadline += entry->period;
+				schedule_missed++;
+			}
+		}
+	}
+	schedule_arm();
+}
@@ -0,0 +1,52 @@
+/************************************************************************/
+/* @file schedule.h
+/* @brief contains the task table of the RTC alarm scheduler and prototype declarations
+/************************************************************************/
+
+#ifndef SCHEDULE_H_
+#define SCHEDULE_H_
+
+#include <asf.h>
+
+/* Scheduler defines */
+// Times are seconds since 2000-01-01 00:00:00, the first year of the RTC calendar
+#define SCHEDULE_EPOCH_YEAR	2000
+
+// One slot per task, the slot number is the task's fixed id
+enum schedule_task {
+	SCHEDULE_TEMPERATURE,
+	SCHEDULE_OFFLOAD_CHECK,
+	SCHEDULE_SHOCK_WINDOW,
+	SCHEDULE_TASKS,
+};
+
+/************************************************************************/
+/* @brief schedule_entry is one task on the RTC alarm. A periodic task's next
+/* deadline is its last deadline plus the period, never the time it ran plus
+/* the period, so late wakes do not add up to drift
+/************************************************************************/
+struct schedule_entry {
+	void (*handler)(void);
+	uint32_t deadline;
+	// Seconds between deadlines, 0 for a one-shot task
+	uint32_t period;
+	// Seconds the task may run late so that it can share a wake with another task
+	uint16_t slack;
+	bool armed;
+};
+
+// Scheduler statistics for sizing
+uint32_t schedule_wakes;
+uint32_t schedule_runs;
+// Periods skipped because a wake came more than a whole period late
+uint16_t schedule_missed;
+
+/* Scheduler prototype definitions */
+void configure_schedule(void);
+uint32_t schedule_now(void);
+void schedule_at(enum schedule_task task, uint32_t deadline, uint32_t period, uint16_t slack, void (*handler)(void));
+void schedule_set_period(enum schedule_task task, uint32_t period);
+void schedule_cancel(enum schedule_task task);
+void schedule_service(void);
+
+#endif /* SCHEDULE_H_ */
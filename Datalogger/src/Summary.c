@@ -0,0 +1,176 @@
+/************************************************************************/
+/* @file Summary.c
+/* @brief Per epoch activity summaries (dynamic body acceleration, mean,
+/* variance and peak magnitude) computed on the fly in q15 with CMSIS-DSP.
+/* Samples are raw ADXL375 counts (49 mg) taken as q15, so all results
+/* are in counts too.
+/************************************************************************/
+
+#include <asf.h>
+#include <arm_math.h>
+#include <string.h>
+#include "HAL.h"
+
+// The epoch being accumulated
+static struct accel_summary epoch;
+static int32_t epoch_sums[ACCEL_AXES];
+// Sums of squared counts, arm_power_q15 gives them as 34.30 which is the plain integer sum
+static q63_t epoch_squares[ACCEL_AXES];
+static uint32_t epoch_odba;
+static uint32_t epoch_vedba;
+// Largest squared magnitude, the root is only taken when the epoch closes
+static uint32_t epoch_peak;
+
+/************************************************************************/
+/* @brief magnitude takes the root of a sum of squared counts
+/* @params[in] squares the sum of squares, below 2^30
+/* @returns the magnitude in counts
+/************************************************************************/
+static uint16_t magnitude(uint32_t squares)
+{
+	q31_t root = 0;
+	
+	// sqrt(2s / 2^31) * 2^31 is sqrt(s) * 2^16
+	arm_sqrt_q31(squares << 1, &root);
+	
+	return root >> 16;
+}
+
+/************************************************************************/
+/* @brief summary_add adds a block of samples to the open epoch, closing it
+/* and queueing its summary in summary_ring every SUMMARY_EPOCH_SAMPLES samples.
+/* The static (gravity) part of each axis is the mean over the block, about 2 s
+/* for a watermark's worth, and the dynamic part is what is left. Runs from the deferred work queue.
+/* @params[in] samples x, y, z per sample
+/* @params[in] count the number of samples, at most ADXL375_FIFO_DEPTH
+/* @returns none
+/************************************************************************/
+void summary_add(const int16_t * samples, uint8_t count)
+{
+	q15_t axes[ACCEL_AXES][ADXL375_FIFO_DEPTH];
+	q15_t dynamic[ACCEL_AXES][ADXL375_FIFO_DEPTH];
+	q15_t odba[ADXL375_FIFO_DEPTH];
+	q15_t absolute[ADXL375_FIFO_DEPTH];
+	q15_t gravity;
+	q63_t power;
+	uint32_t squares;
+	uint16_t length;
+	
+	if(!count) return;
+	if(count > ADXL375_FIFO_DEPTH) count = ADXL375_FIFO_DEPTH;
+	
+	// CMSIS works on one axis at a time
+	for(uint8_t i = 0; i < count; i++){
+		for(uint8_t axis = 0; axis < ACCEL_AXES; axis++) axes[axis][i] = samples[i * ACCEL_AXES + axis];
+	}
+	for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+		arm_mean_q15(axes[axis], count, &gravity);
+		arm_offset_q15(axes[axis], -gravity, dynamic[axis], count);
+	}
+	
+	// ODBA is the sum of the absolute dynamic acceleration over the axes
+	arm_abs_q15(dynamic[0], odba, count);
+	for(uint8_t axis = 1; axis < ACCEL_AXES; axis++){
+		arm_abs_q15(dynamic[axis], absolute, count);
+		arm_add_q15(odba, absolute, odba, count);
+	}
+	
+	// The block is split where an epoch closes
+	for(uint8_t i = 0; i < count; i += length){
+		if(!epoch.samples) get_timestamp(epoch.timestamp);
+		length = count - i;
+		if(length > SUMMARY_EPOCH_SAMPLES - epoch.samples) length = SUMMARY_EPOCH_SAMPLES - epoch.samples;
+		
+		for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+			arm_power_q15(&axes[axis][i], length, &power);
+			epoch_squares[axis] += power;
+		}
+		for(uint8_t j = i; j < i + length; j++){
+			// VeDBA is the vector length of the dynamic acceleration
+			squares = 0;
+			for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+				epoch_sums[axis] += axes[axis][j];
+				squares += dynamic[axis][j] * dynamic[axis][j];
+			}
+			epoch_vedba += magnitude(squares);
+			epoch_odba += odba[j];
+			
+			squares = 0;
+			for(uint8_t axis = 0; axis < ACCEL_AXES; axis++) squares += axes[axis][j] * axes[axis][j];
+			if(squares > epoch_peak) epoch_peak = squares;
+		}
+		
+		epoch.samples += length;
+		if(epoch.samples == SUMMARY_EPOCH_SAMPLES) summary_flush();
+	}
+}
+
+/************************************************************************/
+/* @brief summary_flush closes the open epoch, if it has any samples, and queues
+/* its summary in summary_ring. Called when an epoch fills and when sampling stops,
+/* so a short burst still gets a summary.
+/* @params none
+/* @returns none
+/************************************************************************/
+void summary_flush(void)
+{
+	if(!epoch.samples) return;
+	
+	for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+		epoch.mean[axis] = epoch_sums[axis] / (int32_t)epoch.samples;
+		// Sum of squares less the square of the sum over n, over n
+		epoch.variance[axis] = (epoch_squares[axis] - (int64_t)epoch_sums[axis] * epoch_sums[axis] / epoch.samples) / epoch.samples;
+	}
+	epoch.odba = epoch_odba / epoch.samples;
+	epoch.vedba = epoch_vedba / epoch.samples;
+	epoch.peak = magnitude(epoch_peak);
+	
+	// Summaries that don't fit are dropped and counted as ring overruns
+	ring_write(&summary_ring, &epoch, 1);
+	
+	memset(&epoch, 0, sizeof(epoch));
+	memset(epoch_sums, 0, sizeof(epoch_sums));
+	memset(epoch_squares, 0, sizeof(epoch_squares));
+	epoch_odba = 0;
+	epoch_vedba = 0;
+	epoch_peak = 0;
+}
+
+/************************************************************************/
+/* @brief summary_encode packs a summary (RECORD_ENCODING_ACCEL_SUMMARY), all
+/* little endian and in ADXL375 counts:
+/*   samples      2 bytes, samples in the epoch
+/*   mean         3 x 2 bytes, x, y, z
+/*   variance     3 x 4 bytes, x, y, z in counts squared
+/*   odba         2 bytes, mean overall dynamic body acceleration
+/*   vedba        2 bytes, mean vectorial dynamic body acceleration
+/*   peak         2 bytes, largest magnitude
+/* @params[in] summary the summary
+/* @params[out] out room for SUMMARY_PAYLOAD_SIZE bytes
+/* @returns the number of bytes written
+/************************************************************************/
+uint8_t summary_encode(const struct accel_summary * summary, uint8_t * out)
+{
+	uint8_t length = 0;
+	
+	out[length++] = summary->samples >> 0 & 0xFF;
+	out[length++] = summary->samples >> 8 & 0xFF;
+	for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+		out[length++] = summary->mean[axis] >> 0 & 0xFF;
+		out[length++] = summary->mean[axis] >> 8 & 0xFF;
+	}
+	for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+		out[length++] = summary->variance[axis] >> 0  & 0xFF;
+		out[length++] = summary->variance[axis] >> 8  & 0xFF;
+		out[length++] = summary->variance[axis] >> 16 & 0xFF;
+		out[length++] = summary->variance[axis] >> 24 & 0xFF;
+	}
+	out[length++] = summary->odba >> 0 & 0xFF;
+	out[length++] = summary->odba >> 8 & 0xFF;
+	out[length++] = summary->vedba >> 0 & 0xFF;
+	out[length++] = summary->vedba >> 8 & 0xFF;
+	out[length++] = summary->peak >> 0 & 0xFF;
+	out[length++] = summary->peak >> 8 & 0xFF;
+	
+	return length;
+}
@@ -0,0 +1,27 @@
+/************************************************************************/
+/* @file summary.h
+/* @brief contains the activity summary defines and prototype declarations
+/************************************************************************/
+
+#ifndef SUMMARY_H_
+#define SUMMARY_H_
+
+#include <asf.h>
+
+/* Activity summary defines */
+// Samples per epoch at 12.5 Hz: 12 for about 1 s, 125 for 10 s, 750 for 60 s. A summary record
+// takes 38 bytes with its header and checksum, at 1 s that is more than the Rice coded samples
+// of a logger at rest, at 10 s it is 4 to 11 times less (test_summary)
+#define SUMMARY_EPOCH_SAMPLES		125
+// Bytes in an encoded summary record payload
+#define SUMMARY_PAYLOAD_SIZE		26
+
+/* Activity summary prototype definitions */
+// Defined in hal.h with the other buffered data
+struct accel_summary;
+
+void summary_add(const int16_t * samples, uint8_t count);
+void summary_flush(void);
+uint8_t summary_encode(const struct accel_summary * summary, uint8_t * out);
+
+#endif /* SUMMARY_H_ */
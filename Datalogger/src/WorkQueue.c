@@ -0,0 +1,93 @@
+/************************************************************************/
+/* @file WorkQueue.c
+/* @brief Deferred work queue. ISRs only post a small record, the handlers
+/* (I2C traffic, FIFO drains, timestamps) run from the main loop before it
+/* goes back to sleep, so no wake source is blocked behind a long ISR.
+/************************************************************************/
+
+#include <asf.h>
+#include "HAL.h"
+
+static struct work_item work_queue[WORK_QUEUE_SIZE];
+// Free running indices, the difference is the queue depth
+static volatile uint8_t work_head;
+static volatile uint8_t work_tail;
+
+/************************************************************************/
+/* @brief configure_work_queue empties the queue and clears the statistics
+/* @params none
+/* @returns none
+/************************************************************************/
+void configure_work_queue(void)
+{
+	work_head = 0;
+	work_tail = 0;
+	work_max_depth = 0;
+	work_dropped = 0;
+	work_max_latency = 0;
+	work_max_run = 0;
+}
+
+/************************************************************************/
+/* @brief work_post queues a handler to run from the main loop. Safe to call
+/* from any ISR, interrupts are only masked while the record is written.
+/* @params[in] handler the function to run
+/* @returns 1 if the record was queued, 0 if the queue was full
+/************************************************************************/
+uint8_t work_post(void (*handler)(void))
+{
+	irqflags_t flags;
+	uint8_t depth;
+	
+	flags = cpu_irq_save();
+	depth = work_head - work_tail;
+	if(depth >= WORK_QUEUE_SIZE){
+		work_dropped++;
+		cpu_irq_restore(flags);
+		return 0;
+	}
+	work_queue[work_head & (WORK_QUEUE_SIZE - 1)].handler = handler;
+	work_queue[work_head & (WORK_QUEUE_SIZE - 1)].posted = cycle_count();
+	work_head++;
+	if(++depth > work_max_depth) work_max_depth = depth;
+	cpu_irq_restore(flags);
+	
+	return 1;
+}
+
+/************************************************************************/
+/* @brief work_pending checks for queued work. Call with interrupts masked
+/* before sleeping so a record posted in between is not missed.
+/* @params none
+/* @returns true if there is work queued
+/************************************************************************/
+bool work_pending(void)
+{
+	return work_head != work_tail;
+}
+
+/************************************************************************/
+/* @brief work_run runs queued handlers in order until the queue is empty,
+/* including anything posted while they run. Main loop only.
+/* @params none
+/* @returns none
+/************************************************************************/
+void work_run(void)
+{
+	struct work_item item;
+	uint32_t cycles;
+	
+	while(work_pending()){
+		// The slot is not reused until the tail moves past it
+		item = work_queue[work_tail & (WORK_QUEUE_SIZE - 1)];
+		work_tail++;
+		
+		cycles = cycles_since(item.posted);
+		if(cycles > work_max_latency) work_max_latency = cycles;
+		
+		cycles = cycle_count();
+		item.handler();
+		cycles = cycles_since(cycles);
+		if(cycles > work_max_run) work_max_run = cycles;
+	}
+}
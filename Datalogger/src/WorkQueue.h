@@ -0,0 +1,36 @@
+/************************************************************************/
+/* @file workqueue.h
+/* @brief contains the deferred work queue record and prototype declarations
+/************************************************************************/
+
+#ifndef WORKQUEUE_H_
+#define WORKQUEUE_H_
+
+#include <asf.h>
+
+/* Work queue defines */
+// Number of records, must be a power of two
+#define WORK_QUEUE_SIZE		16
+
+/************************************************************************/
+/* @brief work_item is posted by an ISR and run later from the main loop
+/************************************************************************/
+struct work_item {
+	void (*handler)(void);
+	// cycle_count() when the record was posted
+	uint32_t posted;
+};
+
+// Queue statistics for sizing. Cycles are active core cycles from the SysTick cycle counter
+uint8_t work_max_depth;
+uint16_t work_dropped;
+uint32_t work_max_latency;
+uint32_t work_max_run;
+
+/* Work queue prototype definitions */
+void configure_work_queue(void);
+uint8_t work_post(void (*handler)(void));
+bool work_pending(void);
+void work_run(void);
+
+#endif /* WORKQUEUE_H_ */
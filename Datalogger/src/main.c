@@ -34,47 +34,57 @@ int main (void)
 {
 	system_init();
 	system_interrupt_enable_global();
+	configure_cycle_counter();
+	configure_work_queue();
+	configure_checksum();
 	
 	
 	/* Configure various sensors and their associated peripherals */
   	configure_i2c();
   	
  	configure_mag_sw_int(extint_callback);
-  	configure_S70FL01(S70FL01_CS1, false);
+  	if(configure_S70FL01(S70FL01_CS1, false)){
+  		// Pick up where we left off before the reset instead of overwriting the oldest data
+  		S70FL01_mount();
+  	}
   	configure_SP1ML();
   	configure_ADXL375(); 	
  	configure_sleepmode();
   	configure_rtc();
 	port_pin_set_output_level(SP1ML_EN_PIN,true);
-	configure_ADT7420();
-	configure_databuffers();
 	
 	// Assume that we are in active mode during stationary period
 	ucActiveInactive_Mode = ACTIVE_MODE;
 	ucMotion_State = STATIONARY_MODE;
 	
 	// Per Dr. Buck, 30C is the pivot point -- These don't necessarily have to be the same, they can build in some hysteresis depending upon the subject
+	// Set before configure_ADT7420, which programs them into the sensor for the threshold interrupt
 	ucActivityTemperatureThreshold = 30;
 	ucInactivityTemperatureThreshold = 30;
 	
+	configure_ADT7420();
+	configure_databuffers();
+	configure_tasks();
+	
+#if ACQUISITION_BURST_TEST
+	// Worst case activity: the accelerometer samples continuously from boot
+	ADXL375_begin_sampling();
+#endif
+	
 	while(true)
 	{	
-		if((uiAccelerometerMatrixPtr > (300 - 32)) || (ucTemperatureArrayPtr > 71)){
-			// Accelerometer total buffer size minus the ADXL375 internal FIFO size
-			// If either buffer is full enough that another set of samples cannot be stored, trigger an offload
+		// Run the sensor work that the interrupts deferred
+		work_run();
+		// Keep the flash erased ahead of the write head, the erase runs on the die the writer is not on
+		S70FL01_erase_ahead();
+		// Write the next slice of a running offload and come straight back, the sensor work runs between slices
+		if(offload_step()) continue;
+		if(acquisition_half_full()){
+			// Swap the full half out to the storage writer, new samples land in the other half meanwhile
 			offload_data();
-			uiAccelerometerMatrixPtr = 0;
-			ucTemperatureArrayPtr = 0;
-		}
-		// If we are at the end of the die, then switch die and reset the address pointer
-		// If we hit the end of the second die, then we restart at the beginning of the first die (ring buffer)
-		if(S70FL01_address >= S70FL01_MAX_ADDR){
-			S70FL01_active_die++;
-			S70FL01_active_die %= 2;
-			S70FL01_address = 0;
+			continue;
 		}
-		ADT7420_read_temp();
-		// Housekeeping done -- go back to sleep
+		// Housekeeping done -- go back to sleep, sleep() returns straight away if more work was posted
 		sleep();
 	}
 }
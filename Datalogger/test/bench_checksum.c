@@ -0,0 +1,112 @@
+/************************************************************************/
+/* @file bench_checksum.c
+/* @brief checks the CRC-32 service against a bitwise reference and times the
+/* table driven software CRC against that reference on the host. Checksum.c is
+/* built with CHECKSUM_DSU here, so the word aligned middles go through the DSU
+/* model and are chained with the software CRC at both ends, the way they are
+/* on the target
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include "dsu_model.h"
+#include <time.h>
+
+#define BENCH_LENGTH	300
+#define BENCH_RUNS		20000
+
+static uint8_t bench_data[BENCH_LENGTH + 4] __attribute__((aligned(4)));
+
+/************************************************************************/
+/* @brief reference_update is the bitwise CRC-32 the table replaced
+/* @params[in] crc the CRC so far
+/* @params[in] data pointer to the data
+/* @params[in] length the number of bytes
+/* @returns the updated CRC, not inverted
+/************************************************************************/
+static uint32_t reference_update(uint32_t crc, const uint8_t * data, uint32_t length)
+{
+	while(length--){
+		crc ^= *data++;
+		for(uint8_t bit = 0; bit < 8; bit++){
+			crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 1));
+		}
+	}
+	return crc;
+}
+
+/************************************************************************/
+/* @brief bench_ns gives a monotonic time for the timing loops
+/* @params none
+/* @returns nanoseconds
+/************************************************************************/
+static uint64_t bench_ns(void)
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+int main(void)
+{
+	volatile uint32_t sink = 0;
+	uint32_t expected, crc;
+	uint64_t start, table_ns, bitwise_ns;
+	
+	dsu_model_reset();
+	configure_checksum();
+	
+	// The check value of the CRC-32, too short for the DSU, then four times over, word
+	// aligned, which the DSU does all of
+	HOST_CHECK_EQUAL(checksum_crc32("123456789", 9), 0xCBF43926UL);
+	HOST_CHECK_EQUAL(dsu_model_stats.runs, 0);
+	for(uint8_t i = 0; i < 36; i++) bench_data[i] = "123456789"[i % 9];
+	HOST_CHECK_EQUAL(checksum_crc32(bench_data, 36), 0x3E29169CUL);
+	HOST_CHECK_EQUAL(dsu_model_stats.runs, 1);
+	HOST_CHECK_EQUAL(dsu_model_stats.words, 9);
+	// Through the DSU it must come out as the software CRC does
+	HOST_CHECK_EQUAL(checksum_crc32(bench_data, 36), ~checksum_software(CHECKSUM_SEED, bench_data, 36));
+	
+	for(uint16_t i = 0; i < sizeof(bench_data); i++) bench_data[i] = (uint8_t)(i * 31 + 17);
+	
+	// Every length at every alignment, whole and split in two at every point
+	for(uint8_t offset = 0; offset < 4; offset++){
+		for(uint16_t length = 0; length < BENCH_LENGTH; length++){
+			expected = ~reference_update(CHECKSUM_SEED, &bench_data[offset], length);
+			HOST_CHECK_EQUAL(checksum_crc32(&bench_data[offset], length), expected);
+			HOST_CHECK_EQUAL(checksum_bytes, length);
+			for(uint16_t split = 0; split <= length; split++){
+				crc = checksum_update(CHECKSUM_SEED, &bench_data[offset], split);
+				crc = checksum_update(crc, &bench_data[offset + split], length - split);
+				if(~crc != expected){
+					HOST_CHECK_EQUAL(~crc, expected);
+					break;
+				}
+			}
+		}
+	}
+	HOST_CHECK(dsu_model_stats.runs > 0);
+	HOST_CHECK_EQUAL(dsu_model_stats.protected_runs, 0);
+	
+	// A bus error leaves the words to the software CRC
+	dsu_model_bus_error = true;
+	crc = dsu_model_stats.runs;
+	HOST_CHECK_EQUAL(checksum_crc32(&bench_data[1], BENCH_LENGTH), ~reference_update(CHECKSUM_SEED, &bench_data[1], BENCH_LENGTH));
+	HOST_CHECK_EQUAL(dsu_model_stats.runs, crc);
+	dsu_model_bus_error = false;
+	
+	// A full size record
+	start = bench_ns();
+	for(uint32_t i = 0; i < BENCH_RUNS; i++) sink += checksum_software(CHECKSUM_SEED + i, bench_data, RECORD_MAX_SIZE);
+	table_ns = bench_ns() - start;
+	start = bench_ns();
+	for(uint32_t i = 0; i < BENCH_RUNS; i++) sink += reference_update(CHECKSUM_SEED + i, bench_data, RECORD_MAX_SIZE);
+	bitwise_ns = bench_ns() - start;
+	
+	printf("software CRC-32 of a %u byte record on the host, table against bitwise, ns per byte\n", RECORD_MAX_SIZE);
+	printf("table %.2f, bitwise %.2f, table %.1fx faster\n", (double)table_ns / BENCH_RUNS / RECORD_MAX_SIZE,
+		(double)bitwise_ns / BENCH_RUNS / RECORD_MAX_SIZE, (double)bitwise_ns / table_ns);
+	
+	return host_result("bench_checksum");
+}
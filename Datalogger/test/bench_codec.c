@@ -0,0 +1,335 @@
+/************************************************************************/
+/* @file bench_codec.c
+/* @brief round trip and size of the sample codecs on synthetic traces. Each trace
+/* is cut into records the way offload_step does, encoded, decoded again with the
+/* reader's rules written from the format description, and compared sample for
+/* sample. The size is reported per sample, with and without the record header
+/* and CRC around each payload, with the encode time per sample on the host
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include <math.h>
+#include <time.h>
+
+#define BENCH_TEMPERATURE_SAMPLES	1440
+#define BENCH_ACCEL_SAMPLES			1500
+// Times each trace is encoded again for the timing, clock() is too coarse for one pass
+#define BENCH_REPEAT				200
+
+// 49 mg per LSB
+#define BENCH_G						20.4
+
+// A 13 bit reading is the temperature in 1/16 C shifted up over the 3 flag bits
+#define BENCH_CELSIUS(c)	((int16_t)((c) * 16) << 3)
+
+/************************************************************************/
+/* @brief bit_reader takes values MSB first out of a payload
+/************************************************************************/
+struct bit_reader {
+	const uint8_t * data;
+	uint16_t length;
+	uint32_t position;
+	bool overrun;
+};
+
+static uint32_t bench_random_state = 2463534242UL;
+
+/************************************************************************/
+/* @brief bench_random gives the next value of a xorshift generator, so every
+/* run sees the same traces
+/* @params none
+/* @returns 32 random bits
+/************************************************************************/
+static uint32_t bench_random(void)
+{
+	bench_random_state ^= bench_random_state << 13;
+	bench_random_state ^= bench_random_state >> 17;
+	bench_random_state ^= bench_random_state << 5;
+	return bench_random_state;
+}
+
+/************************************************************************/
+/* @brief bench_ns gives the host time per sample of BENCH_REPEAT passes
+/* @params[in] start clock() before the first pass
+/* @params[in] count the samples in one pass
+/* @returns ns per sample
+/************************************************************************/
+static double bench_ns(clock_t start, uint32_t count)
+{
+	return (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / BENCH_REPEAT / count;
+}
+
+/************************************************************************/
+/* @brief bits_get takes width bits, reading past the end sets overrun
+/* @params[in] reader the bit reader
+/* @params[in] width the number of bits, at most 16
+/* @returns the value
+/************************************************************************/
+static uint16_t bits_get(struct bit_reader * reader, uint8_t width)
+{
+	uint16_t value = 0;
+	
+	while(width--){
+		if(reader->position >= 8UL * reader->length){
+			reader->overrun = true;
+			return 0;
+		}
+		value = value << 1 | (reader->data[reader->position / 8] >> (7 - reader->position % 8) & 1);
+		reader->position++;
+	}
+	return value;
+}
+
+/************************************************************************/
+/* @brief unzigzag16 undoes the codec's zigzag mapping
+/* @params[in] code the zigzag code
+/* @returns the signed value
+/************************************************************************/
+static int16_t unzigzag16(uint16_t code)
+{
+	return (int16_t)((code >> 1) ^ -(code & 1));
+}
+
+/************************************************************************/
+/* @brief temperature_decode reads a RECORD_ENCODING_S16_DELTA_PACKED payload
+/* @params[in] payload the payload
+/* @params[in] length the payload length
+/* @params[out] samples room for TEMPERATURE_CODEC_MAX_SAMPLES readings
+/* @params[out] bits the bits of the groups, without the header and the padding
+/* @returns the number of readings, 0 if the payload is malformed
+/************************************************************************/
+static uint8_t temperature_decode(const uint8_t * payload, uint8_t length, int16_t * samples, uint32_t * bits)
+{
+	struct bit_reader reader = {payload, length, 32, false};
+	uint8_t count, shift, width, group;
+	
+	if(length < 4) return 0;
+	count = payload[0];
+	shift = payload[1];
+	samples[0] = (int16_t)(payload[2] | payload[3] << 8);
+	
+	for(uint8_t i = 1; i < count; i += group){
+		group = (count - i < TEMPERATURE_CODEC_GROUP) ? count - i : TEMPERATURE_CODEC_GROUP;
+		width = bits_get(&reader, 4);
+		if(width == 15) width = 16;
+		for(uint8_t j = 0; j < group; j++){
+			samples[i+j] = samples[i+j-1] + (int16_t)(unzigzag16(bits_get(&reader, width)) << shift);
+		}
+	}
+	// Only the zero padding may be left
+	if(reader.overrun || (reader.position + 7) / 8 != length) return 0;
+	*bits = reader.position - 32;
+	return count;
+}
+
+/************************************************************************/
+/* @brief bench_temperature encodes a trace in full records and decodes it again
+/* @params[in] name the trace
+/* @params[in] trace the readings
+/* @params[in] count the number of readings
+/* @returns the bits per delta in the groups, without the record's header and padding
+/************************************************************************/
+static double bench_temperature(const char * name, const int16_t * trace, uint16_t count)
+{
+	static uint8_t payload[RECORD_MAX_PAYLOAD];
+	static int16_t decoded[TEMPERATURE_CODEC_MAX_SAMPLES];
+	uint32_t bytes = 0, records = 0, bits = 0, group_bits = 0;
+	uint8_t length, chunk;
+	clock_t start;
+	
+	for(uint16_t done = 0; done < count; done += chunk){
+		chunk = (count - done < TEMPERATURE_CODEC_MAX_SAMPLES) ? count - done : TEMPERATURE_CODEC_MAX_SAMPLES;
+		length = temperature_encode(&trace[done], chunk, payload);
+		HOST_CHECK(length <= RECORD_MAX_PAYLOAD);
+		HOST_CHECK_EQUAL(temperature_decode(payload, length, decoded, &bits), chunk);
+		HOST_CHECK(memcmp(decoded, &trace[done], chunk * sizeof(int16_t)) == 0);
+		bytes += length;
+		group_bits += bits;
+		records++;
+	}
+	
+	start = clock();
+	for(uint16_t repeat = 0; repeat < BENCH_REPEAT; repeat++){
+		for(uint16_t done = 0; done < count; done += chunk){
+			chunk = (count - done < TEMPERATURE_CODEC_MAX_SAMPLES) ? count - done : TEMPERATURE_CODEC_MAX_SAMPLES;
+			temperature_encode(&trace[done], chunk, payload);
+		}
+	}
+	printf("%-28s %8.2f %8.2f %8.2f %8.1f\n", name, (double)group_bits / (count - records), 8.0 * bytes / count,
+		8.0 * (bytes + records * (RECORD_HEADER_SIZE + RECORD_TRAILER_SIZE)) / count, bench_ns(start, count));
+	return (double)group_bits / (count - records);
+}
+
+/************************************************************************/
+/* @brief accel_decode reads a RECORD_ENCODING_S16X3_RICE payload
+/* @params[in] payload the payload
+/* @params[in] length the payload length
+/* @params[out] samples room for ACCEL_CODEC_MAX_SAMPLES x, y, z samples
+/* @returns the number of samples, 0 if the payload is malformed
+/************************************************************************/
+static uint8_t accel_decode(const uint8_t * payload, uint8_t length, int16_t * samples)
+{
+	struct bit_reader reader = {payload, length, 8 * (1 + 2 * ACCEL_AXES), false};
+	uint8_t count, block, k, ones;
+	uint16_t code;
+	int16_t * sample;
+	
+	if(length < 1 + 2 * ACCEL_AXES) return 0;
+	count = payload[0];
+	for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+		samples[axis] = (int16_t)(payload[1 + 2 * axis] | payload[2 + 2 * axis] << 8);
+	}
+	
+	for(uint8_t done = 1; done < count; done += block){
+		block = (count - done < ACCEL_CODEC_BLOCK) ? count - done : ACCEL_CODEC_BLOCK;
+		for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+			k = bits_get(&reader, 4);
+			for(uint8_t i = 0; i < block; i++){
+				ones = 0;
+				while(ones < ACCEL_CODEC_ESCAPE && bits_get(&reader, 1)) ones++;
+				code = (ones < ACCEL_CODEC_ESCAPE) ? (uint16_t)(ones << k | bits_get(&reader, k)) : bits_get(&reader, 16);
+				sample = &samples[(done + i) * ACCEL_AXES + axis];
+				sample[0] = sample[-ACCEL_AXES] + unzigzag16(code);
+			}
+		}
+	}
+	if(reader.overrun || (reader.position + 7) / 8 != length) return 0;
+	return count;
+}
+
+/************************************************************************/
+/* @brief bench_accel encodes a trace in records the way offload_step does, so the
+/* samples that don't fit a record start the next one, and decodes it again
+/* @params[in] name the trace
+/* @params[in] trace x, y, z per sample
+/* @params[in] count the number of samples
+/* @returns the payload bits per sample
+/************************************************************************/
+static double bench_accel(const char * name, const int16_t * trace, uint16_t count)
+{
+	static uint8_t payload[RECORD_MAX_PAYLOAD];
+	static int16_t decoded[ACCEL_CODEC_MAX_SAMPLES * ACCEL_AXES];
+	uint32_t bytes = 0, records = 0;
+	uint8_t length, chunk, encoded;
+	clock_t start;
+	
+	for(uint16_t done = 0; done < count; done += encoded){
+		chunk = (count - done < ACCEL_CODEC_MAX_SAMPLES) ? count - done : ACCEL_CODEC_MAX_SAMPLES;
+		length = accel_encode(&trace[done * ACCEL_AXES], chunk, payload, RECORD_MAX_PAYLOAD, &encoded);
+		HOST_CHECK(length <= RECORD_MAX_PAYLOAD);
+		if(!encoded){
+			HOST_CHECK(!"a record with no samples");
+			break;
+		}
+		HOST_CHECK_EQUAL(accel_decode(payload, length, decoded), encoded);
+		HOST_CHECK(memcmp(decoded, &trace[done * ACCEL_AXES], encoded * ACCEL_SAMPLE_SIZE) == 0);
+		bytes += length;
+		records++;
+	}
+	
+	start = clock();
+	for(uint16_t repeat = 0; repeat < BENCH_REPEAT; repeat++){
+		for(uint16_t done = 0; done < count; done += encoded){
+			chunk = (count - done < ACCEL_CODEC_MAX_SAMPLES) ? count - done : ACCEL_CODEC_MAX_SAMPLES;
+			accel_encode(&trace[done * ACCEL_AXES], chunk, payload, RECORD_MAX_PAYLOAD, &encoded);
+			if(!encoded) break;
+		}
+	}
+	printf("%-28s %8.2f %8.2f %8.1f\n", name, 8.0 * bytes / count,
+		8.0 * (bytes + records * (RECORD_HEADER_SIZE + RECORD_TRAILER_SIZE)) / count, bench_ns(start, count));
+	return 8.0 * bytes / count;
+}
+
+/************************************************************************/
+/* @brief bench_motion fills an accel trace with gravity on z, a swing on all three
+/* axes and noise on every axis
+/* @params[out] trace x, y, z per sample
+/* @params[in] swing the amplitude of the swing in g
+/* @params[in] period the period of the swing in samples
+/* @params[in] noise the noise, +-LSB
+/* @returns none
+/************************************************************************/
+static void bench_motion(int16_t * trace, double swing, double period, uint8_t noise)
+{
+	double phase;
+	
+	for(uint16_t i = 0; i < BENCH_ACCEL_SAMPLES; i++){
+		phase = 2 * M_PI * i / period;
+		trace[i * ACCEL_AXES + 0] = (int16_t)lround(swing * BENCH_G * sin(phase));
+		trace[i * ACCEL_AXES + 1] = (int16_t)lround(swing * BENCH_G * 0.5 * sin(phase + 1));
+		trace[i * ACCEL_AXES + 2] = (int16_t)lround(BENCH_G + swing * BENCH_G * 0.3 * cos(2 * phase));
+		for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+			trace[i * ACCEL_AXES + axis] += (int16_t)(bench_random() % (2 * noise + 1)) - noise;
+		}
+	}
+}
+
+int main(void)
+{
+	static int16_t trace[BENCH_TEMPERATURE_SAMPLES];
+	static int16_t accel_trace[BENCH_ACCEL_SAMPLES * ACCEL_AXES];
+	// The old format stored 3 bytes per sample, 85 to a record
+	const double old_bits = 24 + 8.0 * (RECORD_HEADER_SIZE + RECORD_TRAILER_SIZE) / (RECORD_MAX_PAYLOAD / 3);
+	// The 119 deltas of a record end in a short group, whose 4 bit width code is spread over fewer deltas
+	const double short_group = 4.0 / (TEMPERATURE_CODEC_MAX_SAMPLES - 1);
+	double bits;
+	
+	// A day at one reading a minute. delta is the cost of the groups, what the Codec.c comment quotes
+	printf("temperature, %u readings in records of %u, encode time on this host\n", BENCH_TEMPERATURE_SAMPLES, TEMPERATURE_CODEC_MAX_SAMPLES);
+	printf("%-28s %8s %8s %8s %8s\n", "trace", "delta", "bits", "+record", "ns");
+	
+	for(uint16_t i = 0; i < BENCH_TEMPERATURE_SAMPLES; i++) trace[i] = BENCH_CELSIUS(38);
+	bits = bench_temperature("steady", trace, BENCH_TEMPERATURE_SAMPLES);
+	HOST_CHECK(bits >= 0.5 && bits <= 0.5 + short_group);
+	
+	// Every delta 0 or +-1 LSB, the case the format is built for
+	trace[0] = BENCH_CELSIUS(38);
+	for(uint16_t i = 1; i < BENCH_TEMPERATURE_SAMPLES; i++){
+		trace[i] = trace[i-1] + (int16_t)(((int32_t)(bench_random() % 3) - 1) << 3);
+	}
+	bits = bench_temperature("random walk, +-1 LSB steps", trace, BENCH_TEMPERATURE_SAMPLES);
+	HOST_CHECK(bits <= 2.5 + short_group);
+	
+	// Half a degree over the day, with the last bit dithering
+	for(uint16_t i = 0; i < BENCH_TEMPERATURE_SAMPLES; i++){
+		trace[i] = BENCH_CELSIUS(38) + (int16_t)((i * 8 / 180 + (int32_t)(bench_random() % 3) - 1) << 3);
+	}
+	bits = bench_temperature("slow drift, +-1 LSB noise", trace, BENCH_TEMPERATURE_SAMPLES);
+	HOST_CHECK(bits <= 4.0);
+	
+	for(uint16_t i = 0; i < BENCH_TEMPERATURE_SAMPLES; i++){
+		trace[i] = (int16_t)lround(16 * (38 + sin(2 * M_PI * i / BENCH_TEMPERATURE_SAMPLES))) << 3;
+	}
+	bits = bench_temperature("diurnal sine, +-1 C", trace, BENCH_TEMPERATURE_SAMPLES);
+	HOST_CHECK(bits <= 4.0);
+	
+	// The worst case, every delta needs 16 bits and still fits a record
+	for(uint16_t i = 0; i < BENCH_TEMPERATURE_SAMPLES; i++) trace[i] = (int16_t)bench_random();
+	bench_temperature("random 16 bit", trace, BENCH_TEMPERATURE_SAMPLES);
+	
+	// Two minutes at 12.5 Hz
+	printf("\nacceleration, %u x, y, z samples, the old 8 bit format kept 24 bits per sample, %.2f with the record\n",
+		BENCH_ACCEL_SAMPLES, old_bits);
+	printf("%-28s %8s %8s %8s\n", "trace", "bits", "+record", "ns");
+	
+	bench_motion(accel_trace, 0, 1, 1);
+	bits = bench_accel("rest, +-1 LSB noise", accel_trace, BENCH_ACCEL_SAMPLES);
+	HOST_CHECK(bits < 24);
+	
+	// About 2 steps a second
+	bench_motion(accel_trace, 1, 6, 2);
+	bench_accel("1 g walking sway", accel_trace, BENCH_ACCEL_SAMPLES);
+	
+	// About 4 strides a second
+	// Costs more than the old clipped bytes did, see accel_encode, but less than raw 13 bit samples
+	bench_motion(accel_trace, 4, 3, 4);
+	bits = bench_accel("4 g running", accel_trace, BENCH_ACCEL_SAMPLES);
+	HOST_CHECK(bits > 24 && bits < 39);
+	
+	// The worst case, escapes everywhere
+	for(uint16_t i = 0; i < BENCH_ACCEL_SAMPLES * ACCEL_AXES; i++) accel_trace[i] = (int16_t)(bench_random() % 8192) - 4096;
+	bench_accel("random 13 bit", accel_trace, BENCH_ACCEL_SAMPLES);
+	
+	return host_result("bench_codec");
+}
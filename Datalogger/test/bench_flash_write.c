@@ -0,0 +1,114 @@
+/************************************************************************/
+/* @file bench_flash_write.c
+/* @brief SPI traffic of the two ways to put data in the flash, on the RAM flash
+/* model. A KB is written a byte at a time with S70FL01_verified_write, as
+/* offload_data used to, and then through the page-buffered writer. Both must
+/* land in the flash intact, the buffered writer must need far fewer transactions
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include "flash_model.h"
+
+#define BENCH_LENGTH	1024
+
+struct bench_run {
+	uint32_t transactions;
+	uint32_t bytes;
+	uint32_t programs;
+	uint32_t status_reads;
+	uint64_t elapsed_ns;
+};
+
+static uint8_t bench_data[BENCH_LENGTH];
+
+/************************************************************************/
+/* @brief bench_start takes a snapshot of the model's counters
+/* @params[out] run the snapshot
+/* @returns none
+/************************************************************************/
+static void bench_start(struct bench_run * run)
+{
+	run->transactions = flash_model_stats.transactions;
+	run->bytes = flash_model_stats.bytes;
+	run->programs = flash_model_stats.programs;
+	run->status_reads = flash_model_stats.status_reads;
+	run->elapsed_ns = host_time_ns;
+}
+
+/************************************************************************/
+/* @brief bench_stop turns a snapshot into the traffic since it was taken
+/* @params[in,out] run the snapshot, then the totals
+/* @returns none
+/************************************************************************/
+static void bench_stop(struct bench_run * run)
+{
+	run->transactions = flash_model_stats.transactions - run->transactions;
+	run->bytes = flash_model_stats.bytes - run->bytes;
+	run->programs = flash_model_stats.programs - run->programs;
+	run->status_reads = flash_model_stats.status_reads - run->status_reads;
+	run->elapsed_ns = host_time_ns - run->elapsed_ns;
+}
+
+/************************************************************************/
+/* @brief bench_print prints one line of the table
+/* @params[in] name the write path
+/* @params[in] run the totals
+/* @returns none
+/************************************************************************/
+static void bench_print(const char * name, const struct bench_run * run)
+{
+	printf("%-16s %12u %12u %10u %12u %12.1f\n", name, (unsigned)run->transactions, (unsigned)run->bytes,
+		(unsigned)run->programs, (unsigned)run->status_reads, run->elapsed_ns / 1e6);
+}
+
+int main(void)
+{
+	struct bench_run bytewise, buffered;
+	uint32_t address;
+	uint8_t die;
+	
+	for(uint16_t i = 0; i < BENCH_LENGTH; i++) bench_data[i] = (uint8_t)(i * 7 + 3);
+	
+	flash_model_erase();
+	host_reset();
+	HOST_CHECK(configure_S70FL01(S70FL01_CS1, false));
+	S70FL01_mount();
+	
+	// A byte at a time, into the blank second die where the writer does not go
+	bench_start(&bytewise);
+	for(uint16_t i = 0; i < BENCH_LENGTH; i++){
+		HOST_CHECK(S70FL01_verified_write(bench_data[i], 1, i));
+	}
+	bench_stop(&bytewise);
+	HOST_CHECK(memcmp(&flash_model_memory[1][0], bench_data, BENCH_LENGTH) == 0);
+	
+	// Through the page buffer, once the head sector is erased
+	S70FL01_write_begin();
+	for(;;){
+		host_run_work();
+		S70FL01_erase_ahead();
+		if(!S70FL01_busy(BENCH_LENGTH) || !host_sleep()) break;
+	}
+	die = S70FL01_active_die;
+	// The writer starts the sector with its header
+	address = S70FL01_address + S70FL01_SECTOR_HEADER_SIZE;
+	bench_start(&buffered);
+	HOST_CHECK(S70FL01_write(bench_data, BENCH_LENGTH));
+	HOST_CHECK(S70FL01_write_flush());
+	bench_stop(&buffered);
+	S70FL01_write_end();
+	HOST_CHECK(memcmp(&flash_model_memory[die][address], bench_data, BENCH_LENGTH) == 0);
+	
+	printf("SPI traffic to write %u bytes at %u Hz\n", BENCH_LENGTH, (unsigned)flash_model_spi_baudrate());
+	printf("%-16s %12s %12s %10s %12s %12s\n", "path", "transactions", "bus bytes", "programs", "status reads", "ms");
+	bench_print("verified_write", &bytewise);
+	bench_print("page buffer", &buffered);
+	
+	HOST_CHECK_EQUAL(buffered.programs, (S70FL01_SECTOR_HEADER_SIZE + BENCH_LENGTH + S70FL01_PAGE_SIZE - 1) / S70FL01_PAGE_SIZE);
+	HOST_CHECK_EQUAL(S70FL01_erase_stalls, 0);
+	HOST_CHECK(buffered.transactions * 100 < bytewise.transactions);
+	HOST_CHECK_EQUAL(flash_model_stats.busy_violations, 0);
+	HOST_CHECK_EQUAL(flash_model_stats.dirty_programs, 0);
+	return host_result("bench_flash_write");
+}
@@ -0,0 +1,163 @@
+/************************************************************************/
+/* @file bench_i2c.c
+/* @brief I2C traffic of the sensor reads on the bus model. Each read is run
+/* through its driver and the result checked, then the traffic is compared with
+/* the transactions the old driver code put on the bus, replayed on the same model.
+/* What is measured is the bus: its time, the SERCOM3 interrupts the engine takes
+/* and how often the driver calls the engine and sleeps waiting for it. The time
+/* the core spends in the handler is not, that needs the cycle counter on the target
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include "i2c_model.h"
+
+// 38 C as a 13 bit reading
+#define BENCH_TEMPERATURE	(38 * ADT7420_LSB_PER_C)
+
+/* The firmware services the drivers call, not part of this test */
+
+void mark_data_set(struct ring * samples, struct ring * sets)
+{
+}
+
+uint32_t schedule_now(void)
+{
+	return host_time_ns / 1000000000ULL;
+}
+
+void schedule_at(enum schedule_task task, uint32_t deadline, uint32_t period, uint16_t slack, void (*handler)(void))
+{
+}
+
+void schedule_cancel(enum schedule_task task)
+{
+}
+
+/************************************************************************/
+/* @brief bench_transfer runs one transaction the way the old ASF packet calls did,
+/* a write or a read, or a write without STOP and a read after a repeated start
+/* @params[in] address the 7 bit device address
+/* @params[in] write the bytes written
+/* @params[in] write_length the number of bytes written
+/* @params[out] read the bytes read
+/* @params[in] read_length the number of bytes read
+/* @returns none
+/************************************************************************/
+static void bench_transfer(uint8_t address, uint8_t * write, uint8_t write_length, uint8_t * read, uint8_t read_length)
+{
+	struct i2c_transaction transaction = {
+		.address = address,
+		.write_data = write,
+		.write_length = write_length,
+		.read_data = read,
+		.read_length = read_length,
+	};
+	
+	HOST_CHECK_EQUAL(I2C_transfer(&transaction), STATUS_OK);
+}
+
+/************************************************************************/
+/* @brief bench_print prints one line of the table
+/* @params[in] name the read
+/* @params[in] stats the traffic
+/* @returns none
+/************************************************************************/
+static void bench_print(const char * name, const struct i2c_model_stats * stats)
+{
+	printf("%-28s %12u %8u %10u %10.2f %10u %6u %6u\n", name, (unsigned)stats->transactions, (unsigned)stats->starts,
+		(unsigned)stats->bytes, i2c_model_bus_ns(stats) / 1e6, (unsigned)stats->interrupts, (unsigned)stats->submits,
+		(unsigned)stats->waits);
+}
+
+/************************************************************************/
+/* @brief bench_fill puts a watermark's worth of samples in the ADXL375 FIFO
+/* @params[out] samples the samples, x, y, z
+/* @returns none
+/************************************************************************/
+static void bench_fill(int16_t * samples)
+{
+	for(uint8_t i = 0; i < ADXL375_FIFO_DEPTH; i++){
+		samples[i * ACCEL_AXES + 0] = 3 * i - 40;
+		samples[i * ACCEL_AXES + 1] = -7 * i + 300;
+		samples[i * ACCEL_AXES + 2] = 20 + (i & 3);
+		HOST_CHECK(i2c_model_fifo_push(&samples[i * ACCEL_AXES]));
+	}
+}
+
+int main(void)
+{
+	static int16_t samples[ADXL375_FIFO_DEPTH * ACCEL_AXES];
+	static int16_t read[ADXL375_FIFO_DEPTH * ACCEL_AXES];
+	struct i2c_model_stats old_drain, drain, old_temperature, temperature;
+	uint8_t registers[ADXL375_SAMPLE_SIZE];
+	uint8_t data[ADXL375_SAMPLE_SIZE];
+	int16_t reading;
+	
+	// The old drain wrote the six data register addresses and read six bytes back, per entry
+	i2c_model_reset();
+	bench_fill(samples);
+	for(uint8_t i = 0; i < ADXL375_SAMPLE_SIZE; i++) registers[i] = ADXL375_DATAX0 + i;
+	for(uint8_t i = 0; i < ADXL375_FIFO_DEPTH; i++){
+		bench_transfer(ADXL375_ADDR, registers, ADXL375_SAMPLE_SIZE, NULL, 0);
+		bench_transfer(ADXL375_ADDR, NULL, 0, data, ADXL375_SAMPLE_SIZE);
+	}
+	old_drain = i2c_model_stats;
+	
+	i2c_model_reset();
+	bench_fill(samples);
+	HOST_CHECK_EQUAL(ADXL375_read_samples(read, ADXL375_FIFO_DEPTH), ADXL375_FIFO_DEPTH);
+	drain = i2c_model_stats;
+	HOST_CHECK(memcmp(read, samples, sizeof(samples)) == 0);
+	HOST_CHECK_EQUAL(i2c_model_fifo_count(), 0);
+	HOST_CHECK_EQUAL(ADXL375_drain_bytes, drain.bytes);
+	HOST_CHECK_EQUAL(drain.naks, 0);
+	
+	// The old temperature read: the one-shot config write, a pointer write and a read
+	// for the MS byte, then a pointer write and a read after a repeated start for the LS byte
+	i2c_model_reset();
+	i2c_model_set_temperature(BENCH_TEMPERATURE);
+	port_pin_set_output_level(ADT7420_EN_PIN, true);
+	registers[0] = TEMP_SENSOR_CONFIG_ADDR;
+	registers[1] = TEMP_SENSOR_CONFIG_OP_MODE_OS;
+	bench_transfer(TEMP_SENSOR_ADDRESS, registers, 2, NULL, 0);
+	registers[0] = TEMP_SENSOR_TEMP_REG_MS_ADDR;
+	bench_transfer(TEMP_SENSOR_ADDRESS, registers, 1, NULL, 0);
+	bench_transfer(TEMP_SENSOR_ADDRESS, NULL, 0, &data[0], 1);
+	registers[0] = TEMP_SENSOR_TEMP_REG_LS_ADDR;
+	bench_transfer(TEMP_SENSOR_ADDRESS, registers, 1, &data[1], 1);
+	port_pin_set_output_level(ADT7420_EN_PIN, false);
+	old_temperature = i2c_model_stats;
+	HOST_CHECK_EQUAL(data[0] << 8 | data[1], BENCH_TEMPERATURE);
+	
+	// Between the thresholds, so the reading doesn't change the mode
+	ucInactivityTemperatureThreshold = 30;
+	ucActivityTemperatureThreshold = 40;
+	ring_init(&temperature_ring, temperature_samples, sizeof(temperature_samples[0]), TEMP_RING_SIZE);
+	i2c_model_reset();
+	i2c_model_set_temperature(BENCH_TEMPERATURE);
+	ADT7420_read_temp();
+	temperature = i2c_model_stats;
+	HOST_CHECK_EQUAL(ring_read(&temperature_ring, &reading, 1), 1);
+	HOST_CHECK_EQUAL((uint16_t)reading, BENCH_TEMPERATURE);
+	HOST_CHECK_EQUAL(temperature.naks, 0);
+	// The sensor is switched off again
+	HOST_CHECK_EQUAL(I2C_read_regs(TEMP_SENSOR_ADDRESS, TEMP_SENSOR_TEMP_REG_MS_ADDR, data, 2), STATUS_ERR_BAD_ADDRESS);
+	
+	printf("I2C traffic at %u kHz\n", (unsigned)(I2C_MODEL_CLOCK / 1000));
+	printf("%-28s %12s %8s %10s %10s %10s %6s %6s\n", "read", "transactions", "starts", "bus bytes", "bus ms",
+		"interrupts", "calls", "waits");
+	bench_print("ADXL375 full FIFO, old", &old_drain);
+	bench_print("ADXL375 full FIFO", &drain);
+	bench_print("ADT7420 reading, old", &old_temperature);
+	bench_print("ADT7420 reading", &temperature);
+	HOST_CHECK(drain.bytes < old_drain.bytes);
+	HOST_CHECK(drain.interrupts < old_drain.interrupts);
+	// FIFO_STATUS, then the entries queued behind each other with one wait for the last
+	HOST_CHECK_EQUAL(drain.waits, 2);
+	HOST_CHECK(temperature.transactions < old_temperature.transactions);
+	HOST_CHECK(temperature.interrupts < old_temperature.interrupts);
+	HOST_CHECK(temperature.waits < old_temperature.waits);
+	
+	return host_result("bench_i2c");
+}
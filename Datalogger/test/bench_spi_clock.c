@@ -0,0 +1,124 @@
+/************************************************************************/
+/* @file bench_spi_clock.c
+/* @brief flash throughput against the SPI clock on the RAM flash model. A byte
+/* costs 8 SCK periods plus the ASF driver loop around it (FLASH_MODEL_BYTE_CYCLES
+/* at the 4 MHz core clock), the same model test_flash_timing runs on. Pages are
+/* written through the page-buffered writer and read back with a read session
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include "flash_model.h"
+
+#define BENCH_LENGTH	(16 * 1024UL)
+
+struct bench_clock {
+	uint32_t clock;
+	// Write and read KB/s, with the driver loop and on the SPI clock alone
+	double write;
+	double read;
+	double write_spi;
+	// Time to write 4 KB
+	double write_4k_ms;
+};
+
+static uint8_t bench_data[BENCH_LENGTH];
+
+/************************************************************************/
+/* @brief bench_write writes BENCH_LENGTH bytes into the erased head sector
+/* @params[in] length the number of bytes
+/* @returns the simulated time it took in ns
+/************************************************************************/
+static uint64_t bench_write(uint32_t length)
+{
+	uint64_t start;
+	
+	flash_model_erase();
+	host_reset();
+	HOST_CHECK(configure_S70FL01(S70FL01_CS1, false));
+	S70FL01_mount();
+	S70FL01_write_begin();
+	// The head sector is erased before the clock starts, erasing is not what is measured
+	for(;;){
+		host_run_work();
+		S70FL01_erase_ahead();
+		if(!S70FL01_busy(RECORD_MAX_SIZE) || !host_sleep()) break;
+	}
+	start = host_time_ns;
+	HOST_CHECK(S70FL01_write(bench_data, length));
+	HOST_CHECK(S70FL01_write_flush());
+	S70FL01_write_end();
+	return host_time_ns - start;
+}
+
+/************************************************************************/
+/* @brief bench_read reads BENCH_LENGTH bytes back in one read session, once the
+/* erase started ahead on the other die is over so the read does not wait for it
+/* @params none
+/* @returns the simulated time it took in ns
+/************************************************************************/
+static uint64_t bench_read(void)
+{
+	static uint8_t buffer[BENCH_LENGTH];
+	uint64_t start;
+	
+	while(flash_model_erasing(0) || flash_model_erasing(1)) host_advance_ns(1000000);
+	start = host_time_ns;
+	HOST_CHECK(S70FL01_read_open(0, S70FL01_SECTOR_HEADER_SIZE));
+	HOST_CHECK(S70FL01_read(buffer, BENCH_LENGTH));
+	S70FL01_read_close();
+	HOST_CHECK(memcmp(buffer, bench_data, BENCH_LENGTH) == 0);
+	return host_time_ns - start;
+}
+
+/************************************************************************/
+/* @brief bench_run measures one SPI clock
+/* @params[out] run the results, clock set by the caller
+/* @returns none
+/************************************************************************/
+static void bench_run(struct bench_clock * run)
+{
+	flash_model_clock = run->clock;
+	flash_model_byte_cycles = FLASH_MODEL_BYTE_CYCLES;
+	run->write = BENCH_LENGTH / 1.024 / bench_write(BENCH_LENGTH) * 1e6;
+	run->read = BENCH_LENGTH / 1.024 / bench_read() * 1e6;
+	run->write_4k_ms = bench_write(4096) / 1e6;
+	flash_model_byte_cycles = 0;
+	run->write_spi = BENCH_LENGTH / 1.024 / bench_write(BENCH_LENGTH) * 1e6;
+	flash_model_byte_cycles = FLASH_MODEL_BYTE_CYCLES;
+}
+
+int main(void)
+{
+	// Above 2 MHz the SPI would need a generator faster than the 4 MHz OSC16M, shown for comparison
+	static struct bench_clock runs[] = {{10000}, {100000}, {500000}, {1000000}, {S70FL01_SPI_BAUD_FAST}, {4000000}, {8000000}};
+	const uint8_t count = sizeof(runs) / sizeof(runs[0]);
+	struct bench_clock * fast = NULL;
+	
+	for(uint32_t i = 0; i < BENCH_LENGTH; i++) bench_data[i] = (uint8_t)(i * 13 + 5);
+	
+	printf("flash throughput, %u cycles of driver loop per byte at %u MHz, tPP %u us\n", FLASH_MODEL_BYTE_CYCLES,
+		(unsigned)(FLASH_MODEL_CORE_HZ / 1000000), (unsigned)(flash_model_tpp_ns / 1000));
+	printf("%10s %12s %12s %14s %12s %8s\n", "SPI Hz", "write KB/s", "read KB/s", "SPI only KB/s", "4 KB write", "loop");
+	for(uint8_t i = 0; i < count; i++){
+		bench_run(&runs[i]);
+		if(runs[i].clock == S70FL01_SPI_BAUD_FAST) fast = &runs[i];
+		printf("%10u %12.2f %12.2f %14.2f %9.1f ms %7.0f%%%s\n", (unsigned)runs[i].clock, runs[i].write, runs[i].read,
+			runs[i].write_spi, runs[i].write_4k_ms,
+			100.0 * FLASH_MODEL_BYTE_CYCLES / FLASH_MODEL_CORE_HZ / (8.0 / runs[i].clock + (double)FLASH_MODEL_BYTE_CYCLES / FLASH_MODEL_CORE_HZ),
+			runs[i].clock > S70FL01_SPI_BAUD_FAST ? "  needs a faster generator" : "");
+		// A faster clock is always faster, and the driver loop only ever slows it down
+		if(i) HOST_CHECK(runs[i].write > runs[i-1].write && runs[i].read > runs[i-1].read);
+		HOST_CHECK(runs[i].write < runs[i].write_spi);
+	}
+	
+	// The SPI clock can be at most half of its generator, OSC16M runs at the core clock
+	HOST_CHECK(S70FL01_SPI_BAUD_FAST <= FLASH_MODEL_CORE_HZ / 2);
+	HOST_CHECK(fast != NULL);
+	if(fast){
+		HOST_CHECK(fast->write > 40 * runs[0].write);
+	}
+	HOST_CHECK_EQUAL(flash_model_stats.busy_violations, 0);
+	HOST_CHECK_EQUAL(flash_model_stats.dirty_programs, 0);
+	return host_result("bench_spi_clock");
+}
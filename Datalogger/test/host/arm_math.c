@@ -0,0 +1,69 @@
+/************************************************************************/
+/* @file arm_math.c
+/* @brief host versions of the CMSIS-DSP routines Summary.c uses. Same results as
+/* the reference C code: 16 bit results saturate, sums are kept wide. The square
+/* root is exact, the CMSIS one may be an LSB off
+/************************************************************************/
+
+#include "arm_math.h"
+
+/************************************************************************/
+/* @brief ssat16 saturates to 16 bits, as __SSAT(x, 16)
+/* @params[in] value the value
+/* @returns the saturated value
+/************************************************************************/
+static q15_t ssat16(int32_t value)
+{
+	if(value > INT16_MAX) return INT16_MAX;
+	if(value < INT16_MIN) return INT16_MIN;
+	return (q15_t)value;
+}
+
+void arm_mean_q15(const q15_t * pSrc, uint32_t blockSize, q15_t * pResult)
+{
+	q31_t sum = 0;
+	
+	for(uint32_t i = 0; i < blockSize; i++) sum += pSrc[i];
+	*pResult = (q15_t)(sum / (int32_t)blockSize);
+}
+
+void arm_offset_q15(const q15_t * pSrc, q15_t offset, q15_t * pDst, uint32_t blockSize)
+{
+	for(uint32_t i = 0; i < blockSize; i++) pDst[i] = ssat16((int32_t)pSrc[i] + offset);
+}
+
+void arm_abs_q15(const q15_t * pSrc, q15_t * pDst, uint32_t blockSize)
+{
+	for(uint32_t i = 0; i < blockSize; i++) pDst[i] = (pSrc[i] > 0) ? pSrc[i] : ssat16(-(int32_t)pSrc[i]);
+}
+
+void arm_add_q15(const q15_t * pSrcA, const q15_t * pSrcB, q15_t * pDst, uint32_t blockSize)
+{
+	for(uint32_t i = 0; i < blockSize; i++) pDst[i] = ssat16((int32_t)pSrcA[i] + pSrcB[i]);
+}
+
+void arm_power_q15(const q15_t * pSrc, uint32_t blockSize, q63_t * pResult)
+{
+	q63_t sum = 0;
+	
+	// The 2.30 products are summed as 34.30, which for whole counts is the plain sum of squares
+	for(uint32_t i = 0; i < blockSize; i++) sum += (q31_t)pSrc[i] * pSrc[i];
+	*pResult = sum;
+}
+
+arm_status arm_sqrt_q31(q31_t in, q31_t * pOut)
+{
+	// sqrt(in / 2^31) * 2^31 is sqrt(in * 2^31), the largest root whose square fits under it
+	uint64_t square = (uint64_t)in << 31;
+	uint64_t root = 0;
+	
+	if(in <= 0){
+		*pOut = 0;
+		return ARM_MATH_ARGUMENT_ERROR;
+	}
+	for(uint64_t bit = 1ULL << 31; bit; bit >>= 1){
+		if((root | bit) * (root | bit) <= square) root |= bit;
+	}
+	*pOut = (q31_t)(root > INT32_MAX ? INT32_MAX : root);
+	return ARM_MATH_SUCCESS;
+}
@@ -0,0 +1,28 @@
+/************************************************************************/
+/* @file arm_math.h
+/* @brief host stand-in for the CMSIS-DSP header. Just the q15 and q31 routines
+/* Summary.c uses, written from the CMSIS reference C code in arm_math.c
+/************************************************************************/
+
+#ifndef HOST_ARM_MATH_H_
+#define HOST_ARM_MATH_H_
+
+#include <stdint.h>
+
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+typedef int64_t q63_t;
+
+typedef enum {
+	ARM_MATH_SUCCESS = 0,
+	ARM_MATH_ARGUMENT_ERROR = -1,
+} arm_status;
+
+void arm_mean_q15(const q15_t * pSrc, uint32_t blockSize, q15_t * pResult);
+void arm_offset_q15(const q15_t * pSrc, q15_t offset, q15_t * pDst, uint32_t blockSize);
+void arm_abs_q15(const q15_t * pSrc, q15_t * pDst, uint32_t blockSize);
+void arm_add_q15(const q15_t * pSrcA, const q15_t * pSrcB, q15_t * pDst, uint32_t blockSize);
+void arm_power_q15(const q15_t * pSrc, uint32_t blockSize, q63_t * pResult);
+arm_status arm_sqrt_q31(q31_t in, q31_t * pOut);
+
+#endif /* HOST_ARM_MATH_H_ */
@@ -0,0 +1,288 @@
+/************************************************************************/
+/* @file asf.h
+/* @brief host stand-in for the ASF include file. Just the types, constants and
+/* driver prototypes the modules under test use, so they build with the host
+/* compiler. The drivers themselves are in host.c, backed by the models
+/************************************************************************/
+
+#ifndef HOST_ASF_H_
+#define HOST_ASF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* compiler.h */
+#define __DMB()		__sync_synchronize()
+#define Assert(expr)	((void)0)
+typedef uint32_t irqflags_t;
+
+/* status_codes.h */
+enum status_code {
+	STATUS_OK						= 0x00,
+	STATUS_VALID_DATA				= 0x01,
+	STATUS_NO_CHANGE				= 0x02,
+	STATUS_ABORTED					= 0x04,
+	STATUS_BUSY						= 0x05,
+	STATUS_SUSPEND					= 0x06,
+	STATUS_ERR_IO					= 0x10,
+	STATUS_ERR_REQ_FLUSHED			= 0x11,
+	STATUS_ERR_TIMEOUT				= 0x12,
+	STATUS_ERR_BAD_DATA				= 0x13,
+	STATUS_ERR_NOT_FOUND			= 0x14,
+	STATUS_ERR_UNSUPPORTED_DEV		= 0x15,
+	STATUS_ERR_NO_MEMORY			= 0x16,
+	STATUS_ERR_INVALID_ARG			= 0x17,
+	STATUS_ERR_BAD_ADDRESS			= 0x18,
+	STATUS_ERR_BAD_FORMAT			= 0x1A,
+	STATUS_ERR_DENIED				= 0x1C,
+	STATUS_ERR_OVERFLOW				= 0x1E,
+	STATUS_ERR_NOT_INITIALIZED		= 0x1F,
+	STATUS_ERR_PROTOCOL				= 0x24,
+};
+
+/* Peripheral instances, only ever passed through to the drivers */
+typedef struct { uint8_t id; } Sercom;
+typedef struct { uint8_t id; } Tc;
+extern Sercom host_sercom[6];
+extern Tc host_tc[5];
+#define SERCOM0		(&host_sercom[0])
+#define SERCOM2		(&host_sercom[2])
+#define SERCOM3		(&host_sercom[3])
+#define TC0			(&host_tc[0])
+#define TC4			(&host_tc[4])
+#define TC4_IRQn	21
+
+/* Pins, PIN_PAnn is nn as on the part */
+#define PIN_PA04	4
+#define PIN_PA05	5
+#define PIN_PA08	8
+#define PIN_PA09	9
+#define PIN_PA15	15
+#define PIN_PA16	16
+#define PIN_PA17	17
+#define PIN_PA18	18
+#define PIN_PA19	19
+#define PIN_PA22	22
+#define PIN_PA23	23
+#define PINMUX_UNUSED					0xFFFFFFFF
+#define PINMUX_PA09D_SERCOM2_PAD1		((PIN_PA09 << 16) | 3)
+#define PINMUX_PA10D_SERCOM2_PAD2		((10 << 16) | 3)
+#define PINMUX_PA11D_SERCOM2_PAD3		((11 << 16) | 3)
+#define PINMUX_PA16A_EIC_EXTINT0		((PIN_PA16 << 16) | 0)
+#define PINMUX_PA19A_EIC_EXTINT3		((PIN_PA19 << 16) | 0)
+
+/* gclk.h */
+enum gclk_generator {
+	GCLK_GENERATOR_0,
+	GCLK_GENERATOR_1,
+	GCLK_GENERATOR_2,
+	GCLK_GENERATOR_3,
+	GCLK_GENERATOR_4,
+};
+
+/* pinmux.h */
+#define SYSTEM_PINMUX_GPIO	(1 << 7)
+enum system_pinmux_pin_dir {
+	SYSTEM_PINMUX_PIN_DIR_INPUT,
+	SYSTEM_PINMUX_PIN_DIR_OUTPUT,
+	SYSTEM_PINMUX_PIN_DIR_OUTPUT_WITH_READBACK,
+};
+enum system_pinmux_pin_pull {
+	SYSTEM_PINMUX_PIN_PULL_NONE,
+	SYSTEM_PINMUX_PIN_PULL_UP,
+	SYSTEM_PINMUX_PIN_PULL_DOWN,
+};
+struct system_pinmux_config {
+	uint8_t mux_position;
+	enum system_pinmux_pin_dir direction;
+	enum system_pinmux_pin_pull input_pull;
+	bool powersave;
+};
+enum system_pinmux_pin_sample {
+	SYSTEM_PINMUX_PIN_SAMPLE_CONTINUOUS,
+	SYSTEM_PINMUX_PIN_SAMPLE_ONDEMAND,
+};
+void system_pinmux_get_config_defaults(struct system_pinmux_config *const config);
+void system_pinmux_pin_set_config(const uint8_t gpio_pin, const struct system_pinmux_config *const config);
+void system_pinmux_pin_set_input_sample_mode(const uint8_t gpio_pin, const enum system_pinmux_pin_sample mode);
+
+/* port.h */
+void port_pin_set_output_level(const uint8_t gpio_pin, const bool level);
+bool port_pin_get_input_level(const uint8_t gpio_pin);
+
+/* EIC registers, plain memory on the host */
+extern volatile uint32_t host_eic[5];
+#define REG_EIC_CTRLA		host_eic[0]
+#define REG_EIC_SYNCBUSY	host_eic[1]
+#define REG_EIC_INTENSET	host_eic[2]
+#define REG_EIC_CONFIG0		host_eic[3]
+#define REG_EIC_ASYNCH		host_eic[4]
+
+/* extint.h */
+enum extint_callback_type {
+	EXTINT_CALLBACK_TYPE_DETECT,
+};
+typedef void (*extint_callback_t)(void);
+enum status_code extint_register_callback(const extint_callback_t callback, const uint8_t channel, const enum extint_callback_type type);
+
+/* spi.h */
+enum spi_mode {
+	SPI_MODE_MASTER,
+	SPI_MODE_SLAVE,
+};
+enum spi_character_size {
+	SPI_CHARACTER_SIZE_8BIT,
+	SPI_CHARACTER_SIZE_9BIT,
+};
+enum spi_data_order {
+	SPI_DATA_ORDER_MSB,
+	SPI_DATA_ORDER_LSB,
+};
+enum spi_signal_mux_setting {
+	SPI_SIGNAL_MUX_SETTING_E,
+	SPI_SIGNAL_MUX_SETTING_F,
+};
+struct spi_module {
+	Sercom *hw;
+	uint32_t baudrate;
+};
+struct spi_slave_inst {
+	uint8_t ss_pin;
+};
+struct spi_slave_inst_config {
+	uint8_t ss_pin;
+	bool address_enabled;
+	uint8_t address;
+};
+struct spi_master_config {
+	uint32_t baudrate;
+};
+union spi_specific_config {
+	struct spi_master_config master;
+};
+struct spi_config {
+	enum spi_mode mode;
+	enum spi_data_order data_order;
+	enum spi_character_size character_size;
+	enum spi_signal_mux_setting mux_setting;
+	bool run_in_standby;
+	bool receiver_enable;
+	bool master_slave_select_enable;
+	union spi_specific_config mode_specific;
+	enum gclk_generator generator_source;
+	uint32_t pinmux_pad0;
+	uint32_t pinmux_pad1;
+	uint32_t pinmux_pad2;
+	uint32_t pinmux_pad3;
+};
+void spi_get_config_defaults(struct spi_config *const config);
+void spi_slave_inst_get_config_defaults(struct spi_slave_inst_config *const config);
+void spi_attach_slave(struct spi_slave_inst *const slave, const struct spi_slave_inst_config *const config);
+enum status_code spi_init(struct spi_module *const module, Sercom *const hw, const struct spi_config *const config);
+void spi_enable(struct spi_module *const module);
+void spi_disable(struct spi_module *const module);
+bool spi_is_ready_to_write(struct spi_module *const module);
+bool spi_is_ready_to_read(struct spi_module *const module);
+enum status_code spi_write(struct spi_module *module, uint16_t tx_data);
+enum status_code spi_write_buffer_wait(struct spi_module *const module, const uint8_t *tx_data, uint16_t length);
+enum status_code spi_read_buffer_wait(struct spi_module *const module, uint8_t *rx_data, uint16_t length, uint16_t dummy);
+
+/* tc.h */
+enum tc_clock_prescaler {
+	TC_CLOCK_PRESCALER_DIV1,
+};
+enum tc_counter_size {
+	TC_COUNTER_SIZE_8BIT,
+	TC_COUNTER_SIZE_16BIT,
+	TC_COUNTER_SIZE_32BIT,
+};
+enum tc_wave_generation {
+	TC_WAVE_GENERATION_NORMAL_FREQ,
+	TC_WAVE_GENERATION_MATCH_FREQ,
+};
+enum tc_compare_capture_channel {
+	TC_COMPARE_CAPTURE_CHANNEL_0,
+	TC_COMPARE_CAPTURE_CHANNEL_1,
+};
+enum tc_callback {
+	TC_CALLBACK_OVERFLOW,
+	TC_CALLBACK_ERROR,
+	TC_CALLBACK_CC_CHANNEL0,
+	TC_CALLBACK_CC_CHANNEL1,
+};
+struct tc_16bit_config {
+	uint16_t value;
+	uint16_t compare_capture_channel[2];
+};
+struct tc_config {
+	enum gclk_generator clock_source;
+	enum tc_clock_prescaler clock_prescaler;
+	enum tc_counter_size counter_size;
+	enum tc_wave_generation wave_generation;
+	bool oneshot;
+	bool run_in_standby;
+	struct tc_16bit_config counter_16_bit;
+};
+struct tc_module;
+typedef void (*tc_callback_t)(struct tc_module *const module);
+struct tc_module {
+	Tc *hw;
+	enum gclk_generator clock_source;
+	uint16_t compare;
+	tc_callback_t callback;
+};
+void tc_get_config_defaults(struct tc_config *const config);
+enum status_code tc_init(struct tc_module *const module_inst, Tc *const hw, const struct tc_config *const config);
+enum status_code tc_register_callback(struct tc_module *const module, tc_callback_t callback_func, const enum tc_callback callback_type);
+void tc_enable_callback(struct tc_module *const module, const enum tc_callback callback_type);
+void tc_enable(const struct tc_module *const module_inst);
+void tc_start_counter(const struct tc_module *const module_inst);
+void tc_stop_counter(const struct tc_module *const module_inst);
+enum status_code tc_set_compare_value(const struct tc_module *const module_inst, const enum tc_compare_capture_channel channel_index, const uint32_t compare_value);
+
+/* DSU and PAC registers, only what Checksum.c touches. Every access goes through
+/* dsu_model.c, which runs the CRC engine. ADDR is as wide as a host pointer */
+typedef struct {
+	struct { volatile uint8_t reg; } CTRL;
+	struct { volatile uint8_t reg; } STATUSA;
+	struct { volatile uintptr_t reg; } ADDR;
+	struct { volatile uint32_t reg; } LENGTH;
+	struct { volatile uint32_t reg; } DATA;
+} Dsu;
+typedef struct {
+	struct { volatile uint32_t reg; } WRCTRL;
+	struct { volatile uint32_t reg; } STATUSB;
+} Pac;
+Dsu * dsu_model_dsu(void);
+Pac * dsu_model_pac(void);
+#define DSU						(dsu_model_dsu())
+#define PAC						(dsu_model_pac())
+#define ID_DSU					33
+#define DSU_CTRL_CRC			(1UL << 2)
+#define DSU_STATUSA_DONE		(1UL << 0)
+#define DSU_STATUSA_BERR		(1UL << 2)
+#define DSU_LENGTH_LENGTH_Msk	(0x3FFFFFFFUL << 2)
+#define DSU_LENGTH_LENGTH(value)	(DSU_LENGTH_LENGTH_Msk & ((value) << 2))
+#define PAC_STATUSB_DSU			(1UL << 1)
+#define PAC_WRCTRL_PERID(value)	((value) & 0xFFFFUL)
+#define PAC_WRCTRL_KEY_CLR		(1UL << 16)
+
+/* Modules the headers declare instances of, never used on the host */
+struct i2c_master_module { Sercom *hw; };
+struct i2c_master_config { uint32_t baud_rate; };
+struct usart_config { uint32_t baudrate; bool transmitter_enable; };
+struct usart_module { Sercom *hw; };
+struct rtc_module { void *hw; };
+struct rtc_calendar_time {
+	uint8_t second;
+	uint8_t minute;
+	uint8_t hour;
+	bool pm;
+	uint8_t day;
+	uint8_t month;
+	uint16_t year;
+};
+
+#endif /* HOST_ASF_H_ */
@@ -0,0 +1,102 @@
+/************************************************************************/
+/* @file dsu_model.c
+/* @brief model of the DSU CRC engine. The registers are plain memory, every
+/* access goes through dsu_model_dsu, which runs a CRC the firmware started with
+/* its last write to CTRL before handing the registers back. The engine works as
+/* the data sheet has it: DATA holds the CRC so far, reflected polynomial
+/* 0xEDB88320, the words are read low byte first and nothing is inverted on the
+/* way in or out
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include "dsu_model.h"
+
+struct dsu_model_stats dsu_model_stats;
+bool dsu_model_bus_error;
+
+static Dsu dsu_model_registers;
+static Pac dsu_model_pac_registers = { .STATUSB.reg = PAC_STATUSB_DSU };
+
+/************************************************************************/
+/* @brief dsu_model_reset puts the DSU and the PAC back as they are after reset
+/* @params none
+/* @returns none
+/************************************************************************/
+void dsu_model_reset(void)
+{
+	memset(&dsu_model_stats, 0, sizeof(dsu_model_stats));
+	memset(&dsu_model_registers, 0, sizeof(dsu_model_registers));
+	memset(&dsu_model_pac_registers, 0, sizeof(dsu_model_pac_registers));
+	dsu_model_pac_registers.STATUSB.reg = PAC_STATUSB_DSU;
+	dsu_model_bus_error = false;
+}
+
+/************************************************************************/
+/* @brief dsu_model_key takes a key written to WRCTRL, only clearing the
+/* protection of the DSU is modelled
+/* @params none
+/* @returns none
+/************************************************************************/
+static void dsu_model_key(void)
+{
+	if(dsu_model_pac_registers.WRCTRL.reg == (PAC_WRCTRL_PERID(ID_DSU) | PAC_WRCTRL_KEY_CLR)){
+		dsu_model_pac_registers.STATUSB.reg &= ~PAC_STATUSB_DSU;
+	}
+	dsu_model_pac_registers.WRCTRL.reg = 0;
+}
+
+/************************************************************************/
+/* @brief dsu_model_pac hands the PAC registers out, after a key written with the
+/* last access
+/* @params none
+/* @returns the PAC registers
+/************************************************************************/
+Pac * dsu_model_pac(void)
+{
+	dsu_model_key();
+	return &dsu_model_pac_registers;
+}
+
+/************************************************************************/
+/* @brief dsu_model_dsu runs a CRC started by a write to CTRL. The firmware clears
+/* DONE and BERR before it starts, the start stands in for that write
+/* @params none
+/* @returns the DSU registers
+/************************************************************************/
+Dsu * dsu_model_dsu(void)
+{
+	const uint8_t * bytes;
+	uint32_t crc, length;
+	
+	dsu_model_key();
+	if(dsu_model_registers.CTRL.reg & DSU_CTRL_CRC){
+		dsu_model_registers.CTRL.reg = 0;
+		dsu_model_registers.STATUSA.reg = DSU_STATUSA_DONE;
+		if(dsu_model_pac_registers.STATUSB.reg & PAC_STATUSB_DSU){
+			// A write to a protected peripheral is dropped with a bus error
+			dsu_model_stats.protected_runs++;
+			dsu_model_registers.STATUSA.reg |= DSU_STATUSA_BERR;
+		}
+		else if(dsu_model_bus_error){
+			// DATA is left holding something, the firmware must not use it
+			dsu_model_registers.STATUSA.reg |= DSU_STATUSA_BERR;
+			dsu_model_registers.DATA.reg = ~dsu_model_registers.DATA.reg;
+		}
+		else{
+			bytes = (const uint8_t *)(dsu_model_registers.ADDR.reg & ~(uintptr_t)3);
+			length = dsu_model_registers.LENGTH.reg & DSU_LENGTH_LENGTH_Msk;
+			crc = dsu_model_registers.DATA.reg;
+			while(length--){
+				crc ^= *bytes++;
+				for(uint8_t bit = 0; bit < 8; bit++){
+					crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 1));
+				}
+			}
+			dsu_model_registers.DATA.reg = crc;
+			dsu_model_stats.runs++;
+			dsu_model_stats.words += (dsu_model_registers.LENGTH.reg & DSU_LENGTH_LENGTH_Msk) / 4;
+		}
+	}
+	return &dsu_model_registers;
+}
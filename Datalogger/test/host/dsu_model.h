@@ -0,0 +1,26 @@
+/************************************************************************/
+/* @file dsu_model.h
+/* @brief model of the DSU CRC engine and of the PAC write protection in front of
+/* it, for the host tests. Lets Checksum.c be built with CHECKSUM_DSU on the host
+/************************************************************************/
+
+#ifndef DSU_MODEL_H_
+#define DSU_MODEL_H_
+
+#include <asf.h>
+
+struct dsu_model_stats {
+	// CRC runs the engine did and the words it read
+	uint32_t runs;
+	uint32_t words;
+	// Runs started while the PAC still protected the DSU
+	uint32_t protected_runs;
+};
+
+extern struct dsu_model_stats dsu_model_stats;
+// Set to make the next runs end in a bus error
+extern bool dsu_model_bus_error;
+
+void dsu_model_reset(void);
+
+#endif /* DSU_MODEL_H_ */
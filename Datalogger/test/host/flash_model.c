@@ -0,0 +1,326 @@
+/************************************************************************/
+/* @file flash_model.c
+/* @brief RAM model of the two S70FL01 dies on SERCOM2. Stands in for the ASF SPI
+/* driver and the port pins the flash driver uses, so S70FL01.c runs unchanged
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include "flash_model.h"
+
+#define FLASH_MODEL_NO_DIE		0xFF
+#define FLASH_MODEL_ID_LENGTH	0x30
+
+uint8_t flash_model_memory[FLASH_MODEL_DIES][FLASH_MODEL_DIE_SIZE];
+struct flash_model_stats flash_model_stats;
+uint64_t flash_model_tpp_ns = FLASH_MODEL_TPP_NS;
+uint64_t flash_model_tse_ns = FLASH_MODEL_TSE_NS;
+uint32_t flash_model_clock;
+uint32_t flash_model_byte_cycles = FLASH_MODEL_BYTE_CYCLES;
+
+// Per die state
+struct flash_model_die {
+	bool wel;
+	uint64_t busy_until;
+	// Last program or erase, kept so a power loss can cut it short
+	uint8_t op;
+	uint32_t op_address;
+	uint32_t op_length;
+	uint8_t before[S70FL01_SECTOR_SIZE];
+	// Page being clocked in by the current 4PP
+	uint8_t page[S70FL01_PAGE_SIZE];
+};
+
+static struct flash_model_die flash_model_dies[FLASH_MODEL_DIES];
+static bool flash_model_powered;
+static uint32_t flash_model_baudrate = S70FL01_SPI_BAUD_SLOW;
+// Current transaction
+static uint8_t flash_model_selected = FLASH_MODEL_NO_DIE;
+static uint8_t flash_model_command;
+static uint32_t flash_model_index;
+static uint32_t flash_model_address;
+
+/************************************************************************/
+/* @brief flash_model_busy checks whether a die is still programming or erasing
+/* @params[in] die the die index
+/* @returns true while WIP would read as 1
+/************************************************************************/
+static bool flash_model_busy(uint8_t die)
+{
+	return host_time_ns < flash_model_dies[die].busy_until;
+}
+
+/************************************************************************/
+/* @brief flash_model_erasing checks whether a die is in the middle of a sector erase
+/* @params[in] die the die index
+/* @returns true while the erase runs
+/************************************************************************/
+bool flash_model_erasing(uint8_t die)
+{
+	return flash_model_busy(die) && flash_model_dies[die].op == S70FL01_4SE;
+}
+
+/************************************************************************/
+/* @brief flash_model_id gives a byte of the RDID response, the ID then the CFI table
+/* @params[in] index the byte of the response
+/* @returns the byte
+/************************************************************************/
+static uint8_t flash_model_id(uint32_t index)
+{
+	static const uint8_t id[FLASH_MODEL_ID_LENGTH] = {
+		[0x00] = 0x01, [0x01] = 0x02, [0x02] = 0x21,
+		[S70FL01_CFI_QRY_OFFSET + 0] = 'Q', [S70FL01_CFI_QRY_OFFSET + 1] = 'R', [S70FL01_CFI_QRY_OFFSET + 2] = 'Y',
+		[S70FL01_CFI_SIZE_OFFSET] = FLASH_MODEL_SIZE_LOG2,
+	};
+	return index < FLASH_MODEL_ID_LENGTH ? id[index] : 0xFF;
+}
+
+/************************************************************************/
+/* @brief flash_model_byte clocks one byte through the selected die. A byte takes 8 SCK
+/* periods plus the driver loop around it, the ASF driver waits for each byte to come back
+/* @params[in] out the byte the master sends
+/* @returns the byte the die sends back
+/************************************************************************/
+static uint8_t flash_model_byte(uint8_t out)
+{
+	struct flash_model_die * die;
+	uint8_t in = 0xFF;
+	
+	flash_model_stats.bytes++;
+	host_advance_ns(8000000000ULL / (flash_model_clock ? flash_model_clock : flash_model_baudrate)
+		+ flash_model_byte_cycles * 1000000000ULL / FLASH_MODEL_CORE_HZ);
+	if(flash_model_selected == FLASH_MODEL_NO_DIE) return in;
+	die = &flash_model_dies[flash_model_selected];
+	
+	if(flash_model_index == 0){
+		flash_model_command = out;
+		flash_model_address = 0;
+		if(!flash_model_powered || (flash_model_busy(flash_model_selected) && out != S70FL01_RDSR && out != S70FL01_CLSR)){
+			flash_model_stats.busy_violations++;
+		}
+		switch(out){
+		case S70FL01_WREN:
+			die->wel = true;
+			break;
+		case S70FL01_WRDI:
+			die->wel = false;
+			break;
+		case S70FL01_RDSR:
+			flash_model_stats.status_reads++;
+			break;
+		}
+	}else if(flash_model_command == S70FL01_RDSR){
+		in = (flash_model_busy(flash_model_selected) ? S70FL01_SR_WIP : 0) | (die->wel ? S70FL01_SR_WEL : 0);
+	}else if(flash_model_command == S70FL01_RDID){
+		in = flash_model_id(flash_model_index - 1);
+	}else if(flash_model_index <= 4){
+		flash_model_address = flash_model_address << 8 | out;
+	}else if(flash_model_command == S70FL01_4READ){
+		in = flash_model_memory[flash_model_selected][flash_model_address % FLASH_MODEL_DIE_SIZE];
+		flash_model_address++;
+	}else if(flash_model_command == S70FL01_4PP && flash_model_index - 5 < S70FL01_PAGE_SIZE){
+		die->page[flash_model_index - 5] = out;
+	}
+	flash_model_index++;
+	return in;
+}
+
+/************************************************************************/
+/* @brief flash_model_end runs the program or erase of a transaction when CS# goes high
+/* @params none
+/* @returns none
+/************************************************************************/
+static void flash_model_end(void)
+{
+	uint8_t index = flash_model_selected;
+	struct flash_model_die * die = &flash_model_dies[index];
+	uint8_t * memory = flash_model_memory[index];
+	uint32_t address = flash_model_address % FLASH_MODEL_DIE_SIZE;
+	uint32_t length, page;
+	bool dirty = false;
+	
+	if(!die->wel || flash_model_busy(index)) return;
+	if(flash_model_command == S70FL01_4PP && flash_model_index > 5){
+		// The address wraps within the page
+		length = flash_model_index - 5;
+		if(length > S70FL01_PAGE_SIZE) length = S70FL01_PAGE_SIZE;
+		page = address & ~(S70FL01_PAGE_SIZE - 1);
+		die->op = S70FL01_4PP;
+		die->op_address = address;
+		die->op_length = length;
+		for(uint32_t i = 0; i < length; i++){
+			uint32_t target = page + ((address + i) & (S70FL01_PAGE_SIZE - 1));
+			die->before[i] = memory[target];
+			if(memory[target] != 0xFF) dirty = true;
+			memory[target] &= die->page[i];
+		}
+		if(dirty) flash_model_stats.dirty_programs++;
+		flash_model_stats.programs++;
+		die->busy_until = host_time_ns + flash_model_tpp_ns;
+		flash_model_stats.busy_ns[index] += flash_model_tpp_ns;
+	}else if(flash_model_command == S70FL01_4SE && flash_model_index >= 5){
+		address &= ~(S70FL01_SECTOR_SIZE - 1);
+		die->op = S70FL01_4SE;
+		die->op_address = address;
+		die->op_length = S70FL01_SECTOR_SIZE;
+		memcpy(die->before, &memory[address], S70FL01_SECTOR_SIZE);
+		memset(&memory[address], 0xFF, S70FL01_SECTOR_SIZE);
+		flash_model_stats.erases++;
+		die->busy_until = host_time_ns + flash_model_tse_ns;
+		flash_model_stats.busy_ns[index] += flash_model_tse_ns;
+	}else if(flash_model_command == S70FL01_BE){
+		die->op = 0;
+		memset(memory, 0xFF, FLASH_MODEL_DIE_SIZE);
+		die->busy_until = host_time_ns + flash_model_tse_ns;
+	}else{
+		return;
+	}
+	die->wel = false;
+}
+
+/************************************************************************/
+/* @brief flash_model_erase puts both dies back to factory erased, idle and unpowered
+/* @params none
+/* @returns none
+/************************************************************************/
+void flash_model_erase(void)
+{
+	memset(flash_model_memory, 0xFF, sizeof(flash_model_memory));
+	memset(flash_model_dies, 0, sizeof(flash_model_dies));
+	memset(&flash_model_stats, 0, sizeof(flash_model_stats));
+	flash_model_powered = false;
+	flash_model_selected = FLASH_MODEL_NO_DIE;
+}
+
+/************************************************************************/
+/* @brief flash_model_power_loss cuts the power. A program or erase that is still
+/* running is left half done: the second half of the page keeps its old bytes, or
+/* the second half of the sector is not erased
+/* @params none
+/* @returns none
+/************************************************************************/
+void flash_model_power_loss(void)
+{
+	struct flash_model_die * die;
+	uint32_t page;
+	
+	for(uint8_t index = 0; index < FLASH_MODEL_DIES; index++){
+		die = &flash_model_dies[index];
+		if(flash_model_busy(index) && die->op == S70FL01_4PP){
+			page = die->op_address & ~(S70FL01_PAGE_SIZE - 1);
+			for(uint32_t i = die->op_length / 2; i < die->op_length; i++){
+				flash_model_memory[index][page + ((die->op_address + i) & (S70FL01_PAGE_SIZE - 1))] = die->before[i];
+			}
+		}else if(flash_model_busy(index) && die->op == S70FL01_4SE){
+			memcpy(&flash_model_memory[index][die->op_address + die->op_length / 2], &die->before[die->op_length / 2], die->op_length / 2);
+		}
+		die->busy_until = 0;
+		die->wel = false;
+	}
+	flash_model_powered = false;
+	flash_model_selected = FLASH_MODEL_NO_DIE;
+}
+
+/************************************************************************/
+/* @brief flash_model_spi_baudrate gives the SPI clock the driver last set up
+/* @params none
+/* @returns the clock in Hz
+/************************************************************************/
+uint32_t flash_model_spi_baudrate(void)
+{
+	return flash_model_baudrate;
+}
+
+/************************************************************************/
+/* @brief flash_model_pin follows the enable pin and the two chip selects, host.c
+/* hands it every port_pin_set_output_level
+/* @params[in] gpio_pin the pin
+/* @params[in] level the level driven
+/* @returns none
+/************************************************************************/
+void flash_model_pin(const uint8_t gpio_pin, const bool level)
+{
+	uint8_t die;
+	
+	if(gpio_pin == S70FL01_EN){
+		flash_model_powered = level;
+		return;
+	}
+	if(gpio_pin != S70FL01_CS1 && gpio_pin != S70FL01_CS2) return;
+	die = gpio_pin == S70FL01_CS1 ? 0 : 1;
+	if(level){
+		if(flash_model_selected == die) flash_model_end();
+		if(flash_model_selected == die) flash_model_selected = FLASH_MODEL_NO_DIE;
+		return;
+	}
+	if(flash_model_selected != FLASH_MODEL_NO_DIE && flash_model_selected != die) flash_model_stats.busy_violations++;
+	flash_model_selected = die;
+	flash_model_index = 0;
+	flash_model_stats.transactions++;
+}
+
+/* ASF SPI master on SERCOM2 */
+
+void spi_get_config_defaults(struct spi_config *const config)
+{
+	memset(config, 0, sizeof(*config));
+	config->mode_specific.master.baudrate = 100000;
+}
+
+void spi_slave_inst_get_config_defaults(struct spi_slave_inst_config *const config)
+{
+	memset(config, 0, sizeof(*config));
+}
+
+void spi_attach_slave(struct spi_slave_inst *const slave, const struct spi_slave_inst_config *const config)
+{
+	slave->ss_pin = config->ss_pin;
+}
+
+enum status_code spi_init(struct spi_module *const module, Sercom *const hw, const struct spi_config *const config)
+{
+	module->hw = hw;
+	module->baudrate = config->mode_specific.master.baudrate;
+	flash_model_baudrate = module->baudrate;
+	return STATUS_OK;
+}
+
+void spi_enable(struct spi_module *const module)
+{
+}
+
+void spi_disable(struct spi_module *const module)
+{
+}
+
+bool spi_is_ready_to_write(struct spi_module *const module)
+{
+	return true;
+}
+
+bool spi_is_ready_to_read(struct spi_module *const module)
+{
+	return true;
+}
+
+enum status_code spi_write(struct spi_module *module, uint16_t tx_data)
+{
+	flash_model_byte(tx_data);
+	return STATUS_OK;
+}
+
+enum status_code spi_write_buffer_wait(struct spi_module *const module, const uint8_t *tx_data, uint16_t length)
+{
+	for(uint16_t i = 0; i < length; i++){
+		flash_model_byte(tx_data[i]);
+	}
+	return STATUS_OK;
+}
+
+enum status_code spi_read_buffer_wait(struct spi_module *const module, uint8_t *rx_data, uint16_t length, uint16_t dummy)
+{
+	for(uint16_t i = 0; i < length; i++){
+		rx_data[i] = flash_model_byte(dummy);
+	}
+	return STATUS_OK;
+}
@@ -0,0 +1,56 @@
+/************************************************************************/
+/* @file flash_model.h
+/* @brief RAM model of the two S70FL01 dies on SERCOM2, for the host tests.
+/* Decodes the instructions the driver uses, keeps programs and erases busy
+/* for their datasheet times and counts the bus traffic
+/************************************************************************/
+
+#ifndef FLASH_MODEL_H_
+#define FLASH_MODEL_H_
+
+#include <asf.h>
+
+// log2 of the die size reported in the CFI table, 2 MB dies give a 16 sector ring
+#define FLASH_MODEL_SIZE_LOG2	21
+#define FLASH_MODEL_DIE_SIZE	(1UL << FLASH_MODEL_SIZE_LOG2)
+#define FLASH_MODEL_DIES		2
+
+// Program and erase times, typical figures from the S70FL01GS datasheet
+#define FLASH_MODEL_TPP_NS		340000ULL
+#define FLASH_MODEL_TSE_NS		520000000ULL
+// Core cycles the ASF spi_*_buffer_wait loop spends on each byte besides the 8 SCK periods, at the 4 MHz
+// core clock. An estimate of the poll, write, poll, read sequence, not a measurement on the target
+#define FLASH_MODEL_BYTE_CYCLES	40
+#define FLASH_MODEL_CORE_HZ		4000000ULL
+
+struct flash_model_stats {
+	// CS# assertions and bytes clocked, on either die
+	uint32_t transactions;
+	uint32_t bytes;
+	uint32_t programs;
+	uint32_t erases;
+	uint32_t status_reads;
+	// Instructions other than RDSR and CLSR sent to a die that was busy, or while the chip was unpowered
+	uint32_t busy_violations;
+	// Page programs over bytes that were not erased
+	uint32_t dirty_programs;
+	// Time each die was busy programming or erasing
+	uint64_t busy_ns[FLASH_MODEL_DIES];
+};
+
+extern uint8_t flash_model_memory[FLASH_MODEL_DIES][FLASH_MODEL_DIE_SIZE];
+extern struct flash_model_stats flash_model_stats;
+extern uint64_t flash_model_tpp_ns;
+extern uint64_t flash_model_tse_ns;
+// SPI clock to run the bus at instead of the one the driver sets up, 0 to follow the driver
+extern uint32_t flash_model_clock;
+// Driver loop cycles per byte, 0 for the SPI clock alone
+extern uint32_t flash_model_byte_cycles;
+
+void flash_model_erase(void);
+void flash_model_power_loss(void);
+bool flash_model_erasing(uint8_t die);
+void flash_model_pin(const uint8_t gpio_pin, const bool level);
+uint32_t flash_model_spi_baudrate(void);
+
+#endif /* FLASH_MODEL_H_ */
@@ -0,0 +1,273 @@
+/************************************************************************/
+/* @file host.c
+/* @brief host versions of the HAL services and the ASF timer and pinmux drivers.
+/* Time is simulated: it moves on when the code under test waits or sleeps, and
+/* a started timer fires its callback once the simulated time reaches it
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include <stdlib.h>
+
+// The timers count the 32.768 kHz clock
+#define HOST_TC_TICK_NS		(1000000000ULL / 32768)
+#define HOST_TC_COUNT		2
+#define HOST_WORK_DEPTH		16
+// Core cycles per ns at 4 MHz, for the cycle counter
+#define HOST_CYCLE_NS		250
+
+Sercom host_sercom[6];
+Tc host_tc[5];
+
+uint64_t host_time_ns;
+uint64_t host_wait_ns;
+uint32_t host_failures;
+
+// Running timers and when they expire
+static struct tc_module * host_tc_running[HOST_TC_COUNT];
+static uint64_t host_tc_deadline[HOST_TC_COUNT];
+
+static void (*host_work[HOST_WORK_DEPTH])(void);
+static uint8_t host_work_count;
+
+/************************************************************************/
+/* @brief host_reset forgets the running timers and posted work, as a reset would.
+/* The simulated time carries on
+/* @params none
+/* @returns none
+/************************************************************************/
+void host_reset(void)
+{
+	for(uint8_t i = 0; i < HOST_TC_COUNT; i++){
+		host_tc_running[i] = NULL;
+	}
+	host_work_count = 0;
+}
+
+/************************************************************************/
+/* @brief host_advance_ns moves the simulated time on, firing the timers that
+/* expire on the way
+/* @params[in] ns the time to move on by
+/* @returns none
+/************************************************************************/
+void host_advance_ns(uint64_t ns)
+{
+	uint64_t end = host_time_ns + ns;
+	struct tc_module * module;
+	
+	for(uint8_t i = 0; i < HOST_TC_COUNT; i++){
+		if(!host_tc_running[i] || host_tc_deadline[i] > end) continue;
+		// One-shot, the callback may start it again
+		module = host_tc_running[i];
+		host_tc_running[i] = NULL;
+		if(host_tc_deadline[i] > host_time_ns) host_time_ns = host_tc_deadline[i];
+		if(module->callback) module->callback(module);
+		// Start over, the callback may have started a timer that expires sooner
+		i = (uint8_t)-1;
+	}
+	host_time_ns = end;
+}
+
+/************************************************************************/
+/* @brief host_sleep stands in for sleep() in the main loop. The core wakes on
+/* the next timer, or straight away if work is posted
+/* @params none
+/* @returns false if nothing would ever wake the core
+/************************************************************************/
+bool host_sleep(void)
+{
+	uint64_t next = UINT64_MAX;
+	
+	if(host_work_count) return true;
+	for(uint8_t i = 0; i < HOST_TC_COUNT; i++){
+		if(host_tc_running[i] && host_tc_deadline[i] < next) next = host_tc_deadline[i];
+	}
+	if(next == UINT64_MAX) return false;
+	host_advance_ns(next > host_time_ns ? next - host_time_ns : 0);
+	return true;
+}
+
+/************************************************************************/
+/* @brief host_run_work runs the posted work, like work_run in the main loop
+/* @params none
+/* @returns none
+/************************************************************************/
+void host_run_work(void)
+{
+	void (*handler)(void);
+	
+	while(host_work_count){
+		handler = host_work[0];
+		host_work_count--;
+		memmove(&host_work[0], &host_work[1], host_work_count * sizeof(host_work[0]));
+		handler();
+	}
+}
+
+/************************************************************************/
+/* @brief host_result reports the checks of a test program
+/* @params[in] name the test program
+/* @returns the exit status, 0 if every check passed
+/************************************************************************/
+int host_result(const char * name)
+{
+	printf("%s: %s (%u failed checks)\n", name, host_failures ? "FAIL" : "PASS", (unsigned)host_failures);
+	return host_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* HAL services */
+
+void wait_us(uint32_t us)
+{
+	host_wait_ns += us * 1000ULL;
+	host_advance_ns(us * 1000ULL);
+}
+
+void wait_ms(uint32_t ms)
+{
+	host_wait_ns += ms * 1000000ULL;
+	host_advance_ns(ms * 1000000ULL);
+}
+
+uint32_t cycle_count(void)
+{
+	return (uint32_t)(host_time_ns / HOST_CYCLE_NS);
+}
+
+uint32_t cycles_since(uint32_t start)
+{
+	return cycle_count() - start;
+}
+
+uint8_t work_post(void (*handler)(void))
+{
+	if(host_work_count >= HOST_WORK_DEPTH){
+		work_dropped++;
+		return 0;
+	}
+	host_work[host_work_count++] = handler;
+	return 1;
+}
+
+bool work_pending(void)
+{
+	return host_work_count != 0;
+}
+
+void get_timestamp(uint8_t * ucTimestampVector)
+{
+	uint32_t seconds = (uint32_t)(host_time_ns / 1000000000ULL);
+	
+	ucTimestampVector[0] = seconds >> 24 & 0xFF;
+	ucTimestampVector[1] = seconds >> 16 & 0xFF;
+	ucTimestampVector[2] = seconds >> 8 & 0xFF;
+	ucTimestampVector[3] = seconds >> 0 & 0xFF;
+}
+
+/* ASF pinmux */
+
+void system_pinmux_get_config_defaults(struct system_pinmux_config *const config)
+{
+	config->mux_position = SYSTEM_PINMUX_GPIO;
+	config->direction = SYSTEM_PINMUX_PIN_DIR_INPUT;
+	config->input_pull = SYSTEM_PINMUX_PIN_PULL_UP;
+	config->powersave = false;
+}
+
+void system_pinmux_pin_set_config(const uint8_t gpio_pin, const struct system_pinmux_config *const config)
+{
+}
+
+void system_pinmux_pin_set_input_sample_mode(const uint8_t gpio_pin, const enum system_pinmux_pin_sample mode)
+{
+}
+
+/* ASF port, outputs go to the models with pins on them. A test without one of the
+/* models gets the empty default in its place */
+
+void __attribute__((weak)) flash_model_pin(const uint8_t gpio_pin, const bool level)
+{
+}
+
+void __attribute__((weak)) i2c_model_pin(const uint8_t gpio_pin, const bool level)
+{
+}
+
+void port_pin_set_output_level(const uint8_t gpio_pin, const bool level)
+{
+	flash_model_pin(gpio_pin, level);
+	i2c_model_pin(gpio_pin, level);
+}
+
+/* ASF port, inputs read high as the pulled up interrupt lines do when idle */
+
+bool port_pin_get_input_level(const uint8_t gpio_pin)
+{
+	return true;
+}
+
+/* ASF EIC, the handlers are called by the tests themselves */
+
+volatile uint32_t host_eic[5];
+
+enum status_code extint_register_callback(const extint_callback_t callback, const uint8_t channel, const enum extint_callback_type type)
+{
+	return STATUS_OK;
+}
+
+/* ASF TC, counters are one-shot on the 32.768 kHz clock */
+
+void tc_get_config_defaults(struct tc_config *const config)
+{
+	memset(config, 0, sizeof(*config));
+}
+
+enum status_code tc_init(struct tc_module *const module_inst, Tc *const hw, const struct tc_config *const config)
+{
+	module_inst->hw = hw;
+	module_inst->clock_source = config->clock_source;
+	module_inst->compare = config->counter_16_bit.compare_capture_channel[TC_COMPARE_CAPTURE_CHANNEL_0];
+	module_inst->callback = NULL;
+	return STATUS_OK;
+}
+
+enum status_code tc_register_callback(struct tc_module *const module, tc_callback_t callback_func, const enum tc_callback callback_type)
+{
+	if(callback_type == TC_CALLBACK_CC_CHANNEL0) module->callback = callback_func;
+	return STATUS_OK;
+}
+
+void tc_enable_callback(struct tc_module *const module, const enum tc_callback callback_type)
+{
+}
+
+void tc_enable(const struct tc_module *const module_inst)
+{
+}
+
+void tc_start_counter(const struct tc_module *const module_inst)
+{
+	uint8_t slot = HOST_TC_COUNT;
+	
+	for(uint8_t i = 0; i < HOST_TC_COUNT; i++){
+		if(host_tc_running[i] == module_inst) slot = i;
+		else if(!host_tc_running[i] && slot == HOST_TC_COUNT) slot = i;
+	}
+	if(slot == HOST_TC_COUNT) abort();
+	host_tc_running[slot] = (struct tc_module *)module_inst;
+	host_tc_deadline[slot] = host_time_ns + module_inst->compare * HOST_TC_TICK_NS;
+}
+
+void tc_stop_counter(const struct tc_module *const module_inst)
+{
+	for(uint8_t i = 0; i < HOST_TC_COUNT; i++){
+		if(host_tc_running[i] == module_inst) host_tc_running[i] = NULL;
+	}
+}
+
+enum status_code tc_set_compare_value(const struct tc_module *const module_inst, const enum tc_compare_capture_channel channel_index,
+	const uint32_t compare_value)
+{
+	if(channel_index == TC_COMPARE_CAPTURE_CHANNEL_0) ((struct tc_module *)module_inst)->compare = compare_value;
+	return STATUS_OK;
+}
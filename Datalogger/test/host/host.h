@@ -0,0 +1,29 @@
+/************************************************************************/
+/* @file host.h
+/* @brief simulated time, work queue and test helpers for the host builds
+/************************************************************************/
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <asf.h>
+#include <stdio.h>
+
+// Simulated time in ns. It only moves on bus transfers, waits and host_sleep
+extern uint64_t host_time_ns;
+// Time spent in wait_us/wait_ms, the core would be blocked for it
+extern uint64_t host_wait_ns;
+// Checks that failed, the test exits non-zero if any did
+extern uint32_t host_failures;
+
+#define HOST_CHECK(expr) do{ if(!(expr)){ host_failures++; printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #expr); } }while(0)
+#define HOST_CHECK_EQUAL(a, b) do{ long long _a = (long long)(a), _b = (long long)(b); if(_a != _b){ host_failures++; \
+	printf("  FAIL %s:%d: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); } }while(0)
+
+void host_reset(void);
+void host_advance_ns(uint64_t ns);
+bool host_sleep(void);
+void host_run_work(void);
+int host_result(const char * name);
+
+#endif /* HOST_H_ */
@@ -0,0 +1,287 @@
+/************************************************************************/
+/* @file i2c_model.c
+/* @brief model of the I2C bus with the ADXL375 and the ADT7420. Replaces I2C.c,
+/* so the sensor drivers run unchanged against register models of the parts.
+/* Also drives the ADT7420 enable pin, the sensor only answers while powered
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include "i2c_model.h"
+
+#define I2C_MODEL_REGISTERS		64
+
+struct i2c_model_stats i2c_model_stats;
+
+// ADXL375, registers and the FIFO of x, y, z entries
+static uint8_t i2c_model_adxl375[I2C_MODEL_REGISTERS];
+static uint8_t i2c_model_adxl375_pointer;
+static uint8_t i2c_model_fifo[ADXL375_FIFO_DEPTH][ADXL375_SAMPLE_SIZE];
+static uint8_t i2c_model_fifo_entries;
+// INT_SOURCE bits latched until it is read, and the overrun latched until the FIFO is
+static uint8_t i2c_model_int_source;
+static bool i2c_model_overrun;
+
+// ADT7420, registers and its power switch
+static uint8_t i2c_model_adt7420[I2C_MODEL_REGISTERS];
+static uint8_t i2c_model_adt7420_pointer;
+static bool i2c_model_adt7420_powered;
+
+/************************************************************************/
+/* @brief i2c_model_reset empties the FIFO, clears the registers and the counts
+/* @params none
+/* @returns none
+/************************************************************************/
+void i2c_model_reset(void)
+{
+	memset(i2c_model_adxl375, 0, sizeof(i2c_model_adxl375));
+	memset(i2c_model_adt7420, 0, sizeof(i2c_model_adt7420));
+	i2c_model_adxl375_pointer = 0;
+	i2c_model_adt7420_pointer = 0;
+	i2c_model_fifo_entries = 0;
+	i2c_model_int_source = 0;
+	i2c_model_overrun = false;
+	memset(&i2c_model_stats, 0, sizeof(i2c_model_stats));
+}
+
+/************************************************************************/
+/* @brief i2c_model_fifo_push adds a sample to the ADXL375 FIFO, as a conversion would.
+/* A full FIFO drops its oldest entry and sets OVERRUN, as in stream mode
+/* @params[in] sample x, y, z
+/* @returns false if the FIFO was full and a sample lost
+/************************************************************************/
+bool i2c_model_fifo_push(const int16_t * sample)
+{
+	bool kept = true;
+	
+	if(i2c_model_fifo_entries >= ADXL375_FIFO_DEPTH){
+		memmove(i2c_model_fifo[0], i2c_model_fifo[1], --i2c_model_fifo_entries * ADXL375_SAMPLE_SIZE);
+		i2c_model_overrun = true;
+		kept = false;
+	}
+	for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+		i2c_model_fifo[i2c_model_fifo_entries][2*axis] = sample[axis] & 0xFF;
+		i2c_model_fifo[i2c_model_fifo_entries][2*axis + 1] = sample[axis] >> 8 & 0xFF;
+	}
+	i2c_model_fifo_entries++;
+	return kept;
+}
+
+/************************************************************************/
+/* @brief i2c_model_fifo_count gives the entries still in the ADXL375 FIFO
+/* @params none
+/* @returns the number of entries
+/************************************************************************/
+uint8_t i2c_model_fifo_count(void)
+{
+	return i2c_model_fifo_entries;
+}
+
+/************************************************************************/
+/* @brief i2c_model_fifo_watermark tells whether the FIFO holds the FIFO_CTL
+/* samples count or more, the level the watermark interrupt is raised at
+/* @params none
+/* @returns true at or above the watermark
+/************************************************************************/
+bool i2c_model_fifo_watermark(void)
+{
+	uint8_t samples = i2c_model_adxl375[ADXL375_FIFO_ADDR] & ADXL375_FIFO_SAMPLES;
+	
+	return samples && i2c_model_fifo_entries >= samples;
+}
+
+/************************************************************************/
+/* @brief i2c_model_measuring tells whether POWER_CTL has the ADXL375 measuring
+/* @params none
+/* @returns true while the part takes samples
+/************************************************************************/
+bool i2c_model_measuring(void)
+{
+	return i2c_model_adxl375[ADXL375_POWER_CTL_ADDR] & ADXL375_POWER_CTL_MEASUSRE;
+}
+
+/************************************************************************/
+/* @brief i2c_model_activity latches the ADXL375 activity event, as movement over
+/* THRESH_ACT would
+/* @params none
+/* @returns none
+/************************************************************************/
+void i2c_model_activity(void)
+{
+	i2c_model_int_source |= ADXL375_INT_SRC_ACTIVITY;
+}
+
+/************************************************************************/
+/* @brief i2c_model_set_temperature sets the ADT7420 temperature registers
+/* @params[in] raw the 16 bit register pair, MS byte first on the bus
+/* @returns none
+/************************************************************************/
+void i2c_model_set_temperature(uint16_t raw)
+{
+	i2c_model_adt7420[TEMP_SENSOR_TEMP_REG_MS_ADDR] = raw >> 8;
+	i2c_model_adt7420[TEMP_SENSOR_TEMP_REG_MS_ADDR + 1] = raw & 0xFF;
+}
+
+/************************************************************************/
+/* @brief i2c_model_bus_ns gives the bus time of the traffic counted in stats,
+/* 9 clocks a byte and one for each START and STOP
+/* @params[in] stats the counts
+/* @returns the time in ns
+/************************************************************************/
+uint64_t i2c_model_bus_ns(const struct i2c_model_stats * stats)
+{
+	return (9ULL * stats->bytes + stats->starts + stats->transactions) * 1000000000ULL / I2C_MODEL_CLOCK;
+}
+
+/************************************************************************/
+/* @brief i2c_model_adxl375_read reads the register the pointer is on and moves
+/* it on. The FIFO pops when a read that touched the data registers ends
+/* @params[in] touched set if a data register was read
+/* @returns the register value
+/************************************************************************/
+static uint8_t i2c_model_adxl375_read(bool * touched)
+{
+	uint8_t reg = i2c_model_adxl375_pointer++ % I2C_MODEL_REGISTERS;
+	uint8_t value;
+	
+	if(reg == ADXL375_FIFO_STATUS_ADDR) return i2c_model_fifo_entries;
+	if(reg == ADXL375_INT_SRC_ADDR){
+		// The events clear on the read, WATERMARK and OVERRUN follow the FIFO
+		value = i2c_model_int_source | (i2c_model_fifo_watermark() ? ADXL375_INT_SRC_WATERMARK : 0) | (i2c_model_overrun ? ADXL375_INT_SRC_OVERRUN : 0);
+		i2c_model_int_source = 0;
+		return value;
+	}
+	if(reg >= ADXL375_DATAX0 && reg < ADXL375_DATAX0 + ADXL375_SAMPLE_SIZE){
+		*touched = true;
+		return i2c_model_fifo_entries ? i2c_model_fifo[0][reg - ADXL375_DATAX0] : 0;
+	}
+	return i2c_model_adxl375[reg];
+}
+
+/************************************************************************/
+/* @brief i2c_model_run puts one transaction on the bus: START, the write phase,
+/* a repeated START and the read phase, STOP
+/* @params[in] transaction the transaction
+/* @returns the transaction status
+/************************************************************************/
+static enum status_code i2c_model_run(struct i2c_transaction * transaction)
+{
+	uint8_t * registers;
+	uint8_t * pointer;
+	bool touched = false;
+	
+	i2c_model_stats.starts++;
+	i2c_model_stats.transactions++;
+	if(transaction->address == ADXL375_ADDR){
+		registers = i2c_model_adxl375;
+		pointer = &i2c_model_adxl375_pointer;
+	}else if(transaction->address == TEMP_SENSOR_ADDRESS && i2c_model_adt7420_powered){
+		registers = i2c_model_adt7420;
+		pointer = &i2c_model_adt7420_pointer;
+	}else{
+		// Only the address byte goes out before the NAK
+		i2c_model_stats.bytes++;
+		i2c_model_stats.naks++;
+		i2c_model_stats.interrupts++;
+		return STATUS_ERR_BAD_ADDRESS;
+	}
+	
+	if(transaction->write_length){
+		i2c_model_stats.bytes += 1 + transaction->write_length;
+		i2c_model_stats.interrupts += 1 + transaction->write_length;
+		*pointer = transaction->write_data[0];
+		for(uint8_t i = 1; i < transaction->write_length; i++){
+			// The ADXL375 INT_SOURCE, data and FIFO status registers are read only, FIFO_CTL between them is not
+			if(registers != i2c_model_adxl375 || (*pointer != ADXL375_INT_SRC_ADDR && *pointer != ADXL375_FIFO_STATUS_ADDR &&
+				(*pointer < ADXL375_DATAX0 || *pointer >= ADXL375_DATAX0 + ADXL375_SAMPLE_SIZE))){
+				registers[*pointer % I2C_MODEL_REGISTERS] = transaction->write_data[i];
+			}
+			(*pointer)++;
+		}
+	}
+	if(transaction->read_length){
+		if(transaction->write_length) i2c_model_stats.starts++;
+		i2c_model_stats.bytes += 1 + transaction->read_length;
+		// Smart mode, the address of a read raises no interrupt unless it is not acknowledged
+		i2c_model_stats.interrupts += transaction->read_length;
+		for(uint8_t i = 0; i < transaction->read_length; i++){
+			if(registers == i2c_model_adxl375){
+				transaction->read_data[i] = i2c_model_adxl375_read(&touched);
+			}else{
+				transaction->read_data[i] = registers[(*pointer)++ % I2C_MODEL_REGISTERS];
+			}
+		}
+		if(touched && i2c_model_fifo_entries){
+			i2c_model_overrun = false;
+			memmove(i2c_model_fifo[0], i2c_model_fifo[1], --i2c_model_fifo_entries * ADXL375_SAMPLE_SIZE);
+		}
+	}
+	return STATUS_OK;
+}
+
+/************************************************************************/
+/* @brief i2c_model_pin follows the ADT7420 power switch, host.c hands it every
+/* port_pin_set_output_level
+/* @params[in] gpio_pin the pin
+/* @params[in] level the level driven
+/* @returns none
+/************************************************************************/
+void i2c_model_pin(const uint8_t gpio_pin, const bool level)
+{
+	if(gpio_pin == ADT7420_EN_PIN) i2c_model_adt7420_powered = level;
+}
+
+/* I2C.c */
+
+void configure_I2C_engine(void)
+{
+}
+
+void I2C_submit(struct i2c_transaction * transaction)
+{
+	transaction->next = NULL;
+	i2c_model_stats.submits++;
+	transaction->status = i2c_model_run(transaction);
+	if(transaction->callback) transaction->callback(transaction);
+}
+
+enum status_code I2C_transfer(struct i2c_transaction * transaction)
+{
+	i2c_model_stats.waits++;
+	I2C_submit(transaction);
+	return transaction->status;
+}
+
+enum status_code I2C_write_reg(uint8_t address, uint8_t reg, uint8_t value)
+{
+	return I2C_write_regs(address, reg, &value, 1);
+}
+
+enum status_code I2C_write_regs(uint8_t address, uint8_t reg, const uint8_t * data, uint8_t length)
+{
+	uint8_t wr_buffer[I2C_WRITE_MAX + 1];
+	struct i2c_transaction transaction = {
+		.address = address,
+		.write_data = wr_buffer,
+		.write_length = length + 1,
+		.read_length = 0,
+	};
+	
+	if(length > I2C_WRITE_MAX) return STATUS_ERR_INVALID_ARG;
+	wr_buffer[0] = reg;
+	memcpy(&wr_buffer[1], data, length);
+	return I2C_transfer(&transaction);
+}
+
+enum status_code I2C_read_regs(uint8_t address, uint8_t reg, uint8_t * data, uint8_t length)
+{
+	struct i2c_transaction transaction = {
+		.address = address,
+		.write_data = &reg,
+		.write_length = 1,
+		.read_data = data,
+		.read_length = length,
+	};
+	
+	return I2C_transfer(&transaction);
+}
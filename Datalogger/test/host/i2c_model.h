@@ -0,0 +1,45 @@
+/************************************************************************/
+/* @file i2c_model.h
+/* @brief model of the I2C bus on SERCOM3 with the ADXL375 and the ADT7420 on it,
+/* for the host tests. Stands in for I2C.c, runs each transaction as soon as it
+/* is submitted and counts what it would put on the bus
+/************************************************************************/
+
+#ifndef I2C_MODEL_H_
+#define I2C_MODEL_H_
+
+#include <asf.h>
+
+// The bus clock, each byte and its ACK take 9 clocks
+#define I2C_MODEL_CLOCK		100000UL
+
+struct i2c_model_stats {
+	// STOPs, so transactions as the engine sees them
+	uint32_t transactions;
+	// STARTs and repeated STARTs
+	uint32_t starts;
+	// Bytes clocked, the address bytes included
+	uint32_t bytes;
+	// Transactions the device did not acknowledge
+	uint32_t naks;
+	// SERCOM3 interrupts the engine in I2C.c takes: MB for the address and each byte
+	// written, SB for each byte read
+	uint32_t interrupts;
+	// Transactions handed to the engine, and those the caller slept waiting for
+	uint32_t submits;
+	uint32_t waits;
+};
+
+extern struct i2c_model_stats i2c_model_stats;
+
+void i2c_model_reset(void);
+bool i2c_model_fifo_push(const int16_t * sample);
+uint8_t i2c_model_fifo_count(void);
+bool i2c_model_fifo_watermark(void);
+bool i2c_model_measuring(void);
+void i2c_model_activity(void);
+void i2c_model_set_temperature(uint16_t raw);
+uint64_t i2c_model_bus_ns(const struct i2c_model_stats * stats);
+void i2c_model_pin(const uint8_t gpio_pin, const bool level);
+
+#endif /* I2C_MODEL_H_ */
@@ -0,0 +1,435 @@
+/************************************************************************/
+/* @file test_flash.c
+/* @brief host test of the S70FL01 driver on the RAM flash model. Records are
+/* written through the offload loop, the chip is reset and S70FL01_mount has to
+/* find the write head and the oldest data again. The flash is then read back
+/* with the reader rule of Record.h
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include "flash_model.h"
+
+#define TEST_SECTORS	(FLASH_MODEL_DIES * FLASH_MODEL_DIE_SIZE / S70FL01_SECTOR_SIZE)
+
+// What reading the stream back found
+struct test_scan {
+	uint32_t sectors;
+	uint32_t records;
+	// Records with a bad crc or running past the end of their sector
+	uint32_t corrupt;
+	// Places where the record ids jump, records lost to a reset
+	uint32_t gaps;
+	// Sector headers whose sequence number does not follow the previous sector
+	uint32_t sequence_breaks;
+	uint32_t first_id;
+	uint32_t last_id;
+};
+
+// Id carried in the payload of the next record
+static uint32_t test_next_id;
+
+// Where test_stream_chunk expects the next streamed byte, as a ring sector and offset
+static uint32_t test_stream_sector;
+static uint32_t test_stream_offset;
+static uint32_t test_stream_mismatches;
+static uint32_t test_stream_bytes;
+
+/************************************************************************/
+/* @brief test_sector_memory gives the flash model bytes of a ring sector
+/* @params[in] sector the sector number in the ring
+/* @returns pointer to the first byte of the sector
+/************************************************************************/
+static uint8_t * test_sector_memory(uint32_t sector)
+{
+	return &flash_model_memory[sector % FLASH_MODEL_DIES][(sector / FLASH_MODEL_DIES) * S70FL01_SECTOR_SIZE];
+}
+
+/************************************************************************/
+/* @brief test_ring_sector gives the ring sector that holds an address
+/* @params[in] die the die index
+/* @params[in] address any address inside the sector
+/* @returns the sector number in the ring
+/************************************************************************/
+static uint32_t test_ring_sector(uint8_t die, uint32_t address)
+{
+	return (address / S70FL01_SECTOR_SIZE) * FLASH_MODEL_DIES + die;
+}
+
+/************************************************************************/
+/* @brief test_head_sector gives the ring sector the driver's write head is in
+/* @params none
+/* @returns the sector number in the ring
+/************************************************************************/
+static uint32_t test_head_sector(void)
+{
+	return test_ring_sector(S70FL01_active_die, S70FL01_address);
+}
+
+/************************************************************************/
+/* @brief test_boot brings the flash up after a reset, as main() does
+/* @params none
+/* @returns what S70FL01_mount returned
+/************************************************************************/
+static uint8_t test_boot(void)
+{
+	host_reset();
+	HOST_CHECK(configure_S70FL01(S70FL01_CS1, false));
+	return S70FL01_mount();
+}
+
+/************************************************************************/
+/* @brief test_settle runs the main loop with nothing to write until the flash
+/* jobs and the erase-ahead are done
+/* @params none
+/* @returns none
+/************************************************************************/
+static void test_settle(void)
+{
+	do{
+		host_run_work();
+		S70FL01_erase_ahead();
+	}while(host_sleep());
+}
+
+/************************************************************************/
+/* @brief test_write_record writes one record the way offload_step does: it
+/* comes back later if the write would wait for an erase
+/* @params none
+/* @returns none
+/************************************************************************/
+static void test_write_record(void)
+{
+	static const uint8_t timestamp[4] = {0};
+	struct record record;
+	uint8_t length = 4 + (test_next_id * 37) % 200;
+	
+	for(;;){
+		host_run_work();
+		S70FL01_erase_ahead();
+		if(!S70FL01_busy(RECORD_MAX_SIZE)) break;
+		if(!host_sleep()){
+			HOST_CHECK(!"writer waits on an erase that never starts");
+			return;
+		}
+	}
+	record_begin(&record, RECORD_KIND_DATA_SET, RECORD_CHANNEL_TEMPERATURE, RECORD_ENCODING_S16LE, timestamp);
+	for(uint8_t i = 0; i < length; i++){
+		record.payload[i] = i < 4 ? test_next_id >> (8 * i) & 0xFF : i;
+	}
+	record.length = length;
+	record_write(&record);
+	test_next_id++;
+}
+
+/************************************************************************/
+/* @brief test_write_until writes records until the write head is past an offset
+/* in the given number of sectors from where it started
+/* @params[in] sectors the sectors to move on by
+/* @params[in] offset the offset in the last sector
+/* @returns none
+/************************************************************************/
+static void test_write_until(uint32_t sectors, uint32_t offset)
+{
+	uint32_t sector = test_head_sector();
+	uint32_t crossed = 0;
+	
+	S70FL01_write_begin();
+	while(crossed < sectors || (S70FL01_address & (S70FL01_SECTOR_SIZE - 1)) < offset){
+		test_write_record();
+		if(test_head_sector() != sector){
+			sector = test_head_sector();
+			crossed++;
+		}
+	}
+}
+
+/************************************************************************/
+/* @brief test_scan reads the stream back from the oldest record, following Record.h
+/* @params[out] scan what was found
+/* @returns none
+/************************************************************************/
+static void test_scan(struct test_scan * scan)
+{
+	uint32_t sector = test_ring_sector(S70FL01_oldest_die, S70FL01_oldest_address);
+	uint32_t sequence = 0, offset, size, crc, stored, id;
+	uint8_t * memory;
+	
+	memset(scan, 0, sizeof(*scan));
+	for(uint32_t i = 0; i < TEST_SECTORS; i++, sector = (sector + 1) % TEST_SECTORS){
+		memory = test_sector_memory(sector);
+		// A sector erased from its start ends the stream
+		if(((uint16_t)memory[0] << 8 | memory[1]) != S70FL01_SECTOR_MAGIC) break;
+		stored = (uint32_t)memory[2] << 24 | (uint32_t)memory[3] << 16 | (uint32_t)memory[4] << 8 | memory[5];
+		if(scan->sectors && stored != sequence + 1) scan->sequence_breaks++;
+		sequence = stored;
+		scan->sectors++;
+		
+		for(offset = S70FL01_SECTOR_HEADER_SIZE; offset + RECORD_HEADER_SIZE <= S70FL01_SECTOR_SIZE; offset += size){
+			// Erased, the rest of the sector is unused
+			if(memory[offset] == RECORD_ERASED) break;
+			size = RECORD_HEADER_SIZE + memory[offset + 1] + RECORD_TRAILER_SIZE;
+			if(offset + size > S70FL01_SECTOR_SIZE){
+				scan->corrupt++;
+				break;
+			}
+			crc = ~checksum_update(CHECKSUM_SEED, &memory[offset], size - RECORD_TRAILER_SIZE);
+			stored = (uint32_t)memory[offset + size - 4] << 24 | (uint32_t)memory[offset + size - 3] << 16
+				| (uint32_t)memory[offset + size - 2] << 8 | memory[offset + size - 1];
+			// The length can't be trusted either, the rest of the sector is skipped
+			if(crc != stored){
+				scan->corrupt++;
+				break;
+			}
+			id = (uint32_t)memory[offset + 8] | (uint32_t)memory[offset + 9] << 8 | (uint32_t)memory[offset + 10] << 16 | (uint32_t)memory[offset + 11] << 24;
+			if(!scan->records) scan->first_id = id;
+			else if(id != scan->last_id + 1) scan->gaps++;
+			scan->last_id = id;
+			scan->records++;
+		}
+	}
+}
+
+/************************************************************************/
+/* @brief test_check_model checks the flash model saw no misuse
+/* @params none
+/* @returns none
+/************************************************************************/
+static void test_check_model(void)
+{
+	HOST_CHECK_EQUAL(flash_model_stats.busy_violations, 0);
+	HOST_CHECK_EQUAL(flash_model_stats.dirty_programs, 0);
+	HOST_CHECK_EQUAL(S70FL01_erase_stalls, 0);
+}
+
+/************************************************************************/
+/* @brief test_empty mounts a blank chip, writing starts at the start of die 0
+/* @params none
+/* @returns none
+/************************************************************************/
+static void test_empty(void)
+{
+	struct test_scan scan;
+	
+	printf("empty chip\n");
+	flash_model_erase();
+	test_next_id = 0;
+	HOST_CHECK_EQUAL(test_boot(), 0);
+	HOST_CHECK_EQUAL(S70FL01_active_die, 0);
+	HOST_CHECK_EQUAL(S70FL01_address, 0);
+	HOST_CHECK_EQUAL(S70FL01_oldest_die, 0);
+	HOST_CHECK_EQUAL(S70FL01_oldest_address, 0);
+	
+	S70FL01_write_begin();
+	for(uint8_t i = 0; i < 10; i++){
+		test_write_record();
+	}
+	S70FL01_write_end();
+	test_settle();
+	
+	test_scan(&scan);
+	HOST_CHECK_EQUAL(scan.records, 10);
+	HOST_CHECK_EQUAL(scan.first_id, 0);
+	HOST_CHECK_EQUAL(scan.corrupt, 0);
+	HOST_CHECK_EQUAL(test_sector_memory(0)[5], 0);
+	test_check_model();
+}
+
+/************************************************************************/
+/* @brief test_partial_head writes into the middle of a sector, resets and
+/* checks writing resumes at the start of the next sector
+/* @params[in] sectors the sectors to fill before stopping in the middle of the next one
+/* @returns none
+/************************************************************************/
+static void test_partial_head(uint32_t sectors)
+{
+	struct test_scan scan;
+	uint32_t written;
+	
+	printf("partial head sector, stopping in ring sector %u\n", (unsigned)sectors);
+	flash_model_erase();
+	test_next_id = 0;
+	test_boot();
+	test_write_until(sectors, S70FL01_SECTOR_SIZE / 2);
+	S70FL01_write_end();
+	test_settle();
+	written = test_next_id;
+	
+	flash_model_power_loss();
+	HOST_CHECK_EQUAL(test_boot(), 1);
+	HOST_CHECK_EQUAL(test_head_sector(), sectors + 1);
+	HOST_CHECK_EQUAL(S70FL01_active_die, (sectors + 1) % FLASH_MODEL_DIES);
+	HOST_CHECK_EQUAL(S70FL01_address, ((sectors + 1) / FLASH_MODEL_DIES) * S70FL01_SECTOR_SIZE);
+	HOST_CHECK_EQUAL(S70FL01_oldest_die, 0);
+	HOST_CHECK_EQUAL(S70FL01_oldest_address, S70FL01_SECTOR_HEADER_SIZE);
+	
+	S70FL01_write_begin();
+	for(uint8_t i = 0; i < 10; i++){
+		test_write_record();
+	}
+	S70FL01_write_end();
+	test_settle();
+	
+	test_scan(&scan);
+	HOST_CHECK_EQUAL(scan.records, written + 10);
+	HOST_CHECK_EQUAL(scan.sectors, sectors + 2);
+	HOST_CHECK_EQUAL(scan.corrupt, 0);
+	HOST_CHECK_EQUAL(scan.gaps, 0);
+	HOST_CHECK_EQUAL(scan.sequence_breaks, 0);
+	test_check_model();
+}
+
+/************************************************************************/
+/* @brief test_wrapped writes round the ring and past its start, resets and
+/* checks the head and the oldest data are found across the wrap
+/* @params none
+/* @returns none
+/************************************************************************/
+static void test_wrapped(void)
+{
+	struct test_scan scan;
+	uint32_t last = (TEST_SECTORS + 5) % TEST_SECTORS;
+	
+	printf("wrapped ring\n");
+	flash_model_erase();
+	test_next_id = 0;
+	test_boot();
+	test_write_until(TEST_SECTORS + 5, S70FL01_SECTOR_SIZE / 3);
+	S70FL01_write_end();
+	test_settle();
+	
+	flash_model_power_loss();
+	HOST_CHECK_EQUAL(test_boot(), 1);
+	HOST_CHECK_EQUAL(test_head_sector(), last + 1);
+	// The erase-ahead kept the sector after the head erased, the oldest data is in the one after that
+	HOST_CHECK_EQUAL(S70FL01_oldest_die, (last + 2) % FLASH_MODEL_DIES);
+	HOST_CHECK_EQUAL(S70FL01_oldest_address, ((last + 2) / FLASH_MODEL_DIES) * S70FL01_SECTOR_SIZE + S70FL01_SECTOR_HEADER_SIZE);
+	
+	S70FL01_write_begin();
+	for(uint8_t i = 0; i < 10; i++){
+		test_write_record();
+	}
+	S70FL01_write_end();
+	test_settle();
+	
+	test_scan(&scan);
+	HOST_CHECK_EQUAL(scan.last_id, test_next_id - 1);
+	HOST_CHECK_EQUAL(scan.corrupt, 0);
+	HOST_CHECK_EQUAL(scan.gaps, 0);
+	HOST_CHECK_EQUAL(scan.sequence_breaks, 0);
+	test_check_model();
+}
+
+/************************************************************************/
+/* @brief test_reset_mid_page cuts the power while a page programs. The records
+/* in that page and in the page buffer are lost, everything before them and
+/* everything written after the reset reads back
+/* @params none
+/* @returns none
+/************************************************************************/
+static void test_reset_mid_page(void)
+{
+	struct test_scan scan;
+	uint32_t programs;
+	
+	printf("reset in the middle of a page\n");
+	flash_model_erase();
+	test_next_id = 0;
+	test_boot();
+	test_write_until(1, S70FL01_SECTOR_SIZE / 4);
+	// Carry on until a record starts a page program, then cut the power while it runs
+	programs = flash_model_stats.programs;
+	while(flash_model_stats.programs == programs){
+		test_write_record();
+	}
+	flash_model_power_loss();
+	
+	HOST_CHECK_EQUAL(test_boot(), 1);
+	HOST_CHECK_EQUAL(test_head_sector(), 2);
+	S70FL01_write_begin();
+	for(uint8_t i = 0; i < 10; i++){
+		test_write_record();
+	}
+	S70FL01_write_end();
+	test_settle();
+	
+	test_scan(&scan);
+	HOST_CHECK_EQUAL(scan.first_id, 0);
+	HOST_CHECK_EQUAL(scan.last_id, test_next_id - 1);
+	HOST_CHECK(scan.corrupt <= 1);
+	HOST_CHECK_EQUAL(scan.gaps, 1);
+	HOST_CHECK_EQUAL(scan.sequence_breaks, 0);
+	test_check_model();
+}
+
+/************************************************************************/
+/* @brief test_stream_chunk S70FL01_read_stream callback, compares each piece
+/* with the flash model memory it should have come from
+/* @params[in] data the piece
+/* @params[in] length the piece length
+/* @returns none
+/************************************************************************/
+static void test_stream_chunk(const uint8_t * data, uint16_t length)
+{
+	HOST_CHECK(length <= S70FL01_STREAM_CHUNK);
+	for(uint16_t i = 0; i < length; i++){
+		if(data[i] != test_sector_memory(test_stream_sector)[test_stream_offset]) test_stream_mismatches++;
+		if(++test_stream_offset == S70FL01_SECTOR_SIZE){
+			test_stream_sector = (test_stream_sector + 1) % TEST_SECTORS;
+			test_stream_offset = 0;
+		}
+	}
+	test_stream_bytes += length;
+}
+
+/************************************************************************/
+/* @brief test_read_stream streams from the end of the last ring sector across
+/* the wrap into sector 0 and on into sector 1, so the session changes die twice
+/* without the caller seeing it
+/* @params none
+/* @returns none
+/************************************************************************/
+static void test_read_stream(void)
+{
+	const uint32_t start = S70FL01_SECTOR_SIZE - 1000;
+	const uint32_t length = S70FL01_SECTOR_SIZE + 2000;
+	uint32_t seed = 12345;
+	uint32_t transactions;
+	
+	printf("streamed read across the dies\n");
+	flash_model_erase();
+	for(uint32_t sector = TEST_SECTORS - 1; sector != 2; sector = (sector + 1) % TEST_SECTORS){
+		for(uint32_t i = 0; i < S70FL01_SECTOR_SIZE; i++){
+			seed = seed * 1103515245UL + 12345;
+			test_sector_memory(sector)[i] = seed >> 16;
+		}
+	}
+	test_boot();
+	
+	test_stream_sector = TEST_SECTORS - 1;
+	test_stream_offset = start;
+	test_stream_mismatches = 0;
+	test_stream_bytes = 0;
+	transactions = flash_model_stats.transactions;
+	HOST_CHECK(S70FL01_read_open(1, (TEST_SECTORS / FLASH_MODEL_DIES - 1) * S70FL01_SECTOR_SIZE + start));
+	HOST_CHECK(S70FL01_read_stream(length, test_stream_chunk));
+	S70FL01_read_close();
+	HOST_CHECK_EQUAL(test_stream_bytes, length);
+	HOST_CHECK_EQUAL(test_stream_mismatches, 0);
+	HOST_CHECK_EQUAL(test_stream_sector, 1);
+	// One read instruction per sector, whatever the size of the pieces
+	HOST_CHECK_EQUAL(flash_model_stats.transactions - transactions, 3);
+	test_check_model();
+}
+
+int main(void)
+{
+	test_empty();
+	test_partial_head(3);
+	// Stopping in ring sector 2 on die 0 puts the new head on die 1
+	test_partial_head(2);
+	test_wrapped();
+	test_reset_mid_page();
+	test_read_stream();
+	return host_result("test_flash");
+}
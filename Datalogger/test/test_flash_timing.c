@@ -0,0 +1,218 @@
+/************************************************************************/
+/* @file test_flash_timing.c
+/* @brief timing model of the erase-ahead on the RAM flash model. The same records
+/* are written through the offload loop at several SPI clocks twice: once with the
+/* main loop running the erase-ahead, and once without it, where the writer erases
+/* each sector itself when it gets there. With the ring sectors alternating between
+/* the dies the erase of the next sector runs on the other die, so the erase-ahead
+/* run should finish sooner, by about tSE a sector, and never wait for an erase
+/* while writing a sector takes longer than erasing one
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include "flash_model.h"
+
+// Sectors written per run, after the first one which starts with the erase of the head sector
+#define TIMING_SECTORS	4
+
+struct timing_run {
+	// Run the erase-ahead from the main loop, otherwise the writer erases inline
+	bool erase_ahead;
+	// Simulated time to write TIMING_SECTORS sectors
+	uint64_t elapsed_ns;
+	// Time offload_step would have returned early because S70FL01_busy
+	uint64_t deferred_ns;
+	// Time the writer was blocked in the driver's waits
+	uint64_t blocked_ns;
+	uint32_t erases;
+	// Erases the writer had to do itself
+	uint32_t stalls;
+};
+
+/************************************************************************/
+/* @brief timing_boot brings the flash up on a blank chip, as main() does
+/* @params none
+/* @returns none
+/************************************************************************/
+static void timing_boot(void)
+{
+	flash_model_erase();
+	host_reset();
+	HOST_CHECK(configure_S70FL01(S70FL01_CS1, false));
+	S70FL01_mount();
+}
+
+/************************************************************************/
+/* @brief timing_write_record writes one full size record the way offload_step
+/* does, and adds up the time it was held off or blocked. Without the erase-ahead
+/* the record is written straight away, as offload_step did before S70FL01_busy
+/* @params[in,out] run the totals
+/* @returns none
+/************************************************************************/
+static void timing_write_record(struct timing_run * run)
+{
+	static const uint8_t timestamp[4] = {0};
+	struct record record;
+	uint64_t start;
+	
+	for(;;){
+		host_run_work();
+		if(!run->erase_ahead) break;
+		S70FL01_erase_ahead();
+		if(!S70FL01_busy(RECORD_MAX_SIZE)) break;
+		start = host_time_ns;
+		if(!host_sleep()){
+			HOST_CHECK(!"writer waits on an erase that never starts");
+			return;
+		}
+		run->deferred_ns += host_time_ns - start;
+	}
+	record_begin(&record, RECORD_KIND_DATA_SET, RECORD_CHANNEL_ACCEL, RECORD_ENCODING_S16X3_RICE, timestamp);
+	memset(record.payload, 0x55, RECORD_MAX_PAYLOAD);
+	record.length = RECORD_MAX_PAYLOAD;
+	start = host_wait_ns;
+	record_write(&record);
+	run->blocked_ns += host_wait_ns - start;
+}
+
+/************************************************************************/
+/* @brief timing_sector writes records until the write head moves on to the next sector
+/* @params[in,out] run the totals
+/* @returns none
+/************************************************************************/
+static void timing_sector(struct timing_run * run)
+{
+	uint8_t die = S70FL01_active_die;
+	uint32_t address = S70FL01_address & ~(S70FL01_SECTOR_SIZE - 1);
+	
+	while(S70FL01_active_die == die && (S70FL01_address & ~(S70FL01_SECTOR_SIZE - 1)) == address){
+		timing_write_record(run);
+	}
+}
+
+/************************************************************************/
+/* @brief timing_stream writes TIMING_SECTORS sectors in one write session
+/* @params[in] clock the SPI clock in Hz
+/* @params[out] run the totals, not counting the first sector
+/* @returns none
+/************************************************************************/
+static void timing_stream(uint32_t clock, bool erase_ahead, struct timing_run * run)
+{
+	struct timing_run warmup = {.erase_ahead = erase_ahead};
+	uint32_t erases, stalls;
+	uint64_t start;
+	
+	flash_model_clock = clock;
+	timing_boot();
+	S70FL01_write_begin();
+	// The head sector is erased on the die being written, the writer waits for it once
+	timing_sector(&warmup);
+	
+	memset(run, 0, sizeof(*run));
+	run->erase_ahead = erase_ahead;
+	start = host_time_ns;
+	erases = flash_model_stats.erases;
+	stalls = S70FL01_erase_stalls;
+	for(uint8_t i = 0; i < TIMING_SECTORS; i++){
+		timing_sector(run);
+	}
+	run->elapsed_ns = host_time_ns - start;
+	run->erases = flash_model_stats.erases - erases;
+	run->stalls = S70FL01_erase_stalls - stalls;
+	S70FL01_write_end();
+}
+
+/************************************************************************/
+/* @brief timing_restart ends an offload in the middle of a sector, lets the main
+/* loop run the erase-ahead for a moment and starts the next offload. The next
+/* offload must not find its die erasing
+/* @params[in] idle_ns how long the main loop runs between the offloads
+/* @params[out] erasing set if the erase-ahead was still erasing when the next offload started
+/* @returns the time the second offload was held off
+/************************************************************************/
+static uint64_t timing_restart(uint64_t idle_ns, bool * erasing)
+{
+	struct timing_run run = {.erase_ahead = true};
+	uint64_t end;
+	
+	flash_model_clock = 0;
+	timing_boot();
+	S70FL01_write_begin();
+	timing_sector(&run);
+	for(uint16_t i = 0; i < 100; i++){
+		timing_write_record(&run);
+	}
+	S70FL01_write_end();
+	
+	end = host_time_ns + idle_ns;
+	while(host_time_ns < end){
+		host_run_work();
+		S70FL01_erase_ahead();
+		if(!host_sleep()) break;
+	}
+	
+	*erasing = flash_model_erasing(0) || flash_model_erasing(1);
+	run.deferred_ns = 0;
+	S70FL01_write_begin();
+	for(uint16_t i = 0; i < 100; i++){
+		timing_write_record(&run);
+	}
+	S70FL01_write_end();
+	return run.deferred_ns;
+}
+
+int main(void)
+{
+	static const uint32_t clocks[] = {10000, 1000000, S70FL01_SPI_BAUD_FAST, 4000000, 12000000, 24000000};
+	struct timing_run ahead, serial;
+	uint64_t saved_ns, waited_ns;
+	uint32_t erasing_starts = 0;
+	bool erasing;
+	
+	printf("tPP %u us, tSE %u ms, %u sectors of %u full size records, with and without the erase-ahead\n",
+		(unsigned)(flash_model_tpp_ns / 1000), (unsigned)(flash_model_tse_ns / 1000000), TIMING_SECTORS,
+		(unsigned)(S70FL01_SECTOR_SIZE / RECORD_MAX_SIZE));
+	// ms per sector and ms the writer waited, with the erase-ahead and serial, and the time saved per tSE of erasing
+	printf("%10s %12s %12s %12s %12s %10s\n", "SPI Hz", "ahead ms/sec", "serial", "ahead wait", "serial", "saved/tSE");
+	for(uint8_t i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++){
+		timing_stream(clocks[i], true, &ahead);
+		timing_stream(clocks[i], false, &serial);
+		// The time the erase-ahead saved, as a share of the time the dies spent erasing
+		saved_ns = serial.elapsed_ns - ahead.elapsed_ns;
+		waited_ns = ahead.deferred_ns + ahead.blocked_ns;
+		printf("%10u %12.1f %12.1f %12.1f %12.1f %9.1f%%\n", (unsigned)clocks[i],
+			ahead.elapsed_ns / 1e6 / TIMING_SECTORS, serial.elapsed_ns / 1e6 / TIMING_SECTORS,
+			waited_ns / 1e6, serial.blocked_ns / 1e6, 100.0 * saved_ns / (ahead.erases * flash_model_tse_ns));
+		HOST_CHECK_EQUAL(ahead.erases, TIMING_SECTORS);
+		HOST_CHECK_EQUAL(serial.erases, TIMING_SECTORS);
+		// Without the erase-ahead the writer erases every sector itself and waits all of tSE for it
+		HOST_CHECK_EQUAL(ahead.stalls, 0);
+		HOST_CHECK_EQUAL(serial.stalls, TIMING_SECTORS);
+		HOST_CHECK(serial.blocked_ns >= TIMING_SECTORS * flash_model_tse_ns);
+		HOST_CHECK(ahead.elapsed_ns < serial.elapsed_ns);
+		HOST_CHECK(waited_ns < serial.blocked_ns);
+		// Only the page buffer waits for its last program block the writer, never an erase
+		HOST_CHECK(ahead.blocked_ns <= TIMING_SECTORS * (S70FL01_SECTOR_SIZE / S70FL01_PAGE_SIZE) * S70FL01_PROGRAM_POLL_US * 1000ULL);
+		// While writing a sector takes longer than erasing one the erase is fully hidden
+		if(ahead.elapsed_ns / TIMING_SECTORS > flash_model_tse_ns){
+			HOST_CHECK_EQUAL(ahead.deferred_ns, 0);
+			HOST_CHECK(saved_ns >= TIMING_SECTORS * flash_model_tse_ns * 9 / 10);
+		}
+	}
+	HOST_CHECK_EQUAL(flash_model_stats.busy_violations, 0);
+	
+	// An offload that starts while the main loop runs the erase-ahead between offloads. The
+	// erase is on the other die, so the offload must go ahead without waiting for it
+	for(uint64_t idle_ms = 0; idle_ms <= 1000; idle_ms += 250){
+		uint64_t deferred = timing_restart(idle_ms * 1000000ULL, &erasing);
+		printf("next offload %4u ms after the last one, %s: held off %.1f ms\n", (unsigned)idle_ms,
+			erasing ? "erase running" : "erase done   ", deferred / 1e6);
+		HOST_CHECK_EQUAL(deferred, 0);
+		erasing_starts += erasing;
+	}
+	// Some of the offloads did start during an erase, or the zero hold-off above shows nothing
+	HOST_CHECK(erasing_starts > 0);
+	HOST_CHECK_EQUAL(flash_model_stats.busy_violations, 0);
+	return host_result("test_flash_timing");
+}
@@ -0,0 +1,230 @@
+/************************************************************************/
+/* @file test_offload.c
+/* @brief worst case acquisition burst through the rings and the offload. The
+/* ADXL375 on the I2C model samples at 12.5 Hz for the whole run, its watermark
+/* work drains the FIFO into accel_ring, the temperature is read at the active
+/* period, and the main loop writes the swapped out halves to the RAM flash model
+/* with offload_step. Every sample has to reach the rings: the FIFO, ring and
+/* driver overrun counters must all stay at 0
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include "flash_model.h"
+#include "i2c_model.h"
+
+// 12.5 Hz on the 32.768 kHz timer clock
+#define BURST_SAMPLE_TICKS	2621
+#define BURST_SECONDS		(2 * 60 * 60UL)
+// 38 C as a 13 bit reading, above the activity threshold so the mode stays active
+#define BURST_TEMPERATURE	(38 * ADT7420_LSB_PER_C)
+
+struct burst_run {
+	// SPI clock, 0 for the one the driver sets up
+	uint32_t clock;
+	uint32_t samples;
+	// Samples the FIFO dropped, and the most entries it held
+	uint32_t lost;
+	uint8_t fifo_peak;
+	uint16_t fifo_overruns;
+	uint16_t accel_overruns;
+	uint16_t temperature_overruns;
+	uint16_t erase_stalls;
+	// Longest offload_step and longest pass of the deferred work
+	uint64_t step_ns;
+	uint64_t work_ns;
+	uint32_t bytes;
+};
+
+static uint32_t burst_random_state = 2463534242UL;
+// The ADXL375 sample clock, it fires as the simulated time passes, in the middle of the driver's waits too
+static struct tc_module burst_tc;
+static struct burst_run * burst_current;
+static uint64_t burst_temperature;
+
+/* The firmware services the drivers call, not part of this test */
+
+uint32_t schedule_now(void)
+{
+	return host_time_ns / 1000000000ULL;
+}
+
+void schedule_at(enum schedule_task task, uint32_t deadline, uint32_t period, uint16_t slack, void (*handler)(void))
+{
+}
+
+void schedule_cancel(enum schedule_task task)
+{
+}
+
+/************************************************************************/
+/* @brief burst_random gives the next value of a xorshift generator, so every
+/* run sees the same samples
+/* @params none
+/* @returns 32 random bits
+/************************************************************************/
+static uint32_t burst_random(void)
+{
+	burst_random_state ^= burst_random_state << 13;
+	burst_random_state ^= burst_random_state >> 17;
+	burst_random_state ^= burst_random_state << 5;
+	return burst_random_state;
+}
+
+/************************************************************************/
+/* @brief burst_sample takes one sample on the sample clock. The samples are random
+/* 13 bit values, the most the codec can be made to write. When the driver stops
+/* sampling after a burst the animal is still moving, so the next sample raises
+/* the activity interrupt and sampling starts again. A temperature reading that is
+/* due is held back to the worst moment, the FIFO reaching the watermark, and its
+/* conversion wait runs before the watermark work
+/* @params[in] module the sample clock
+/* @returns none
+/************************************************************************/
+static void burst_sample(struct tc_module *const module)
+{
+	int16_t sample[ACCEL_AXES];
+	bool watermark;
+	
+	tc_start_counter(&burst_tc);
+	if(!i2c_model_measuring()){
+		i2c_model_activity();
+		ADXL375_ISR_Handler();
+		return;
+	}
+	for(uint8_t axis = 0; axis < ACCEL_AXES; axis++) sample[axis] = (int16_t)(burst_random() % 8192) - 4096;
+	watermark = i2c_model_fifo_watermark();
+	if(!i2c_model_fifo_push(sample)) burst_current->lost++;
+	burst_current->samples++;
+	if(i2c_model_fifo_count() > burst_current->fifo_peak) burst_current->fifo_peak = i2c_model_fifo_count();
+	// INT1 goes up when the FIFO reaches the watermark
+	if(watermark || !i2c_model_fifo_watermark()) return;
+	if(burst_temperature <= host_time_ns){
+		work_post(ADT7420_read_temp);
+		burst_temperature += TEMPERATURE_PERIOD_ACTIVE * 1000000000ULL;
+	}
+	ADXL375_ISR_Handler();
+}
+
+/************************************************************************/
+/* @brief burst_run boots on a blank chip and runs the main loop for BURST_SECONDS,
+/* then writes out what is left
+/* @params[in,out] run the totals, clock set by the caller
+/* @returns none
+/************************************************************************/
+static void burst_run(struct burst_run * run)
+{
+	struct tc_config config;
+	uint64_t end, start;
+	bool more;
+	
+	flash_model_erase();
+	memset(&flash_model_stats, 0, sizeof(flash_model_stats));
+	flash_model_clock = run->clock;
+	host_reset();
+	HOST_CHECK(configure_S70FL01(S70FL01_CS1, false));
+	S70FL01_mount();
+	S70FL01_erase_stalls = 0;
+	
+	i2c_model_reset();
+	i2c_model_set_temperature(BURST_TEMPERATURE);
+	ucActiveInactive_Mode = ACTIVE_MODE;
+	ucMotion_State = STATIONARY_MODE;
+	ucActivityTemperatureThreshold = 30;
+	ucInactivityTemperatureThreshold = 30;
+	configure_ADXL375();
+	configure_ADT7420();
+	configure_databuffers();
+	ADXL375_begin_sampling();
+	
+	burst_current = run;
+	burst_temperature = host_time_ns;
+	tc_get_config_defaults(&config);
+	config.counter_16_bit.compare_capture_channel[TC_COMPARE_CAPTURE_CHANNEL_0] = BURST_SAMPLE_TICKS;
+	tc_init(&burst_tc, TC0, &config);
+	tc_register_callback(&burst_tc, burst_sample, TC_CALLBACK_CC_CHANNEL0);
+	tc_start_counter(&burst_tc);
+	
+	end = host_time_ns + BURST_SECONDS * 1000000000ULL;
+	while(host_time_ns < end){
+		// The main loop
+		start = host_time_ns;
+		host_run_work();
+		if(host_time_ns - start > run->work_ns) run->work_ns = host_time_ns - start;
+		S70FL01_erase_ahead();
+		start = host_time_ns;
+		more = offload_step();
+		if(host_time_ns - start > run->step_ns) run->step_ns = host_time_ns - start;
+		if(more) continue;
+		if(acquisition_half_full()){
+			offload_data();
+			continue;
+		}
+		host_sleep();
+	}
+	
+	// Write out the rest, waiting for the erase-ahead where offload_step holds off
+	tc_stop_counter(&burst_tc);
+	ADXL375_end_sampling();
+	offload_data();
+	while(offload_step() || S70FL01_busy(RECORD_MAX_SIZE)){
+		S70FL01_erase_ahead();
+		host_advance_ns(1000000);
+	}
+	offload_data();
+	while(offload_step());
+	
+	run->fifo_overruns = ADXL375_fifo_overruns;
+	run->accel_overruns = accel_ring.overruns;
+	run->temperature_overruns = temperature_ring.overruns;
+	run->erase_stalls = S70FL01_erase_stalls;
+	run->bytes = flash_model_stats.bytes;
+	
+	// Every sample the ADXL375 took went through the ring and out to the flash
+	HOST_CHECK_EQUAL(accel_ring.head, (uint16_t)(run->samples - run->lost - i2c_model_fifo_count()));
+	HOST_CHECK_EQUAL(ring_count(&accel_ring), 0);
+	HOST_CHECK_EQUAL(ring_count(&temperature_ring), 0);
+	HOST_CHECK_EQUAL(temperature_ring.head, BURST_SECONDS / TEMPERATURE_PERIOD_ACTIVE);
+	HOST_CHECK_EQUAL(flash_model_stats.busy_violations, 0);
+	HOST_CHECK_EQUAL(flash_model_stats.dirty_programs, 0);
+}
+
+/************************************************************************/
+/* @brief burst_print prints one line of the table
+/* @params[in] run the totals
+/* @returns none
+/************************************************************************/
+static void burst_print(const struct burst_run * run)
+{
+	printf("%8u %8u %6u %6u/%u %8u %8u %8u %7u %9.1f %9.1f\n", (unsigned)(run->clock ? run->clock : S70FL01_SPI_BAUD_FAST),
+		(unsigned)run->samples, (unsigned)run->lost, run->fifo_peak, ADXL375_FIFO_DEPTH, run->fifo_overruns, run->accel_overruns,
+		run->temperature_overruns, run->erase_stalls, run->step_ns / 1e6, run->work_ns / 1e6);
+}
+
+int main(void)
+{
+	struct burst_run fast = {0};
+	struct burst_run slow = {S70FL01_SPI_BAUD_SLOW};
+	
+	printf("%lu s at 12.5 Hz, random 13 bit samples, temperature every %u s\n", BURST_SECONDS, TEMPERATURE_PERIOD_ACTIVE);
+	printf("%8s %8s %6s %9s %8s %8s %8s %7s %9s %9s\n", "SPI Hz", "samples", "lost", "FIFO peak", "FIFO ovr", "accel",
+		"temp", "stalls", "step ms", "work ms");
+	
+	burst_run(&fast);
+	burst_print(&fast);
+	HOST_CHECK(fast.samples >= BURST_SECONDS * 12);
+	HOST_CHECK_EQUAL(fast.lost, 0);
+	HOST_CHECK_EQUAL(fast.fifo_overruns, 0);
+	HOST_CHECK_EQUAL(fast.accel_overruns, 0);
+	HOST_CHECK_EQUAL(fast.temperature_overruns, 0);
+	HOST_CHECK_EQUAL(fast.erase_stalls, 0);
+	
+	// The 10 kHz clock the flash ran at before it was moved to OSC16M, for comparison
+	burst_run(&slow);
+	burst_print(&slow);
+	// The driver counts every FIFO overrun it finds
+	HOST_CHECK(slow.fifo_overruns <= slow.lost);
+	HOST_CHECK(!slow.lost || slow.fifo_overruns);
+	
+	return host_result("test_offload");
+}
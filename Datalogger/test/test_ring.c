@@ -0,0 +1,194 @@
+/************************************************************************/
+/* @file test_ring.c
+/* @brief host test of the single-producer/single-consumer ring. The producer and
+/* consumer run interleaved step by step with random batch sizes, then in two
+/* threads, each time for enough elements to wrap the 16 bit head and tail many
+/* times. Every element the producer got in has to come out once, in order, and
+/* everything it was refused has to be counted in overruns
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+// Small and a power of two, so the ring is full and empty often
+#define RING_TEST_CAPACITY	16
+#define RING_TEST_BATCH		8
+#define RING_TEST_ELEMENTS	2000000UL
+
+// Sized like an accelerometer sample, the check half catches a torn copy
+struct ring_test_element {
+	uint32_t value;
+	uint16_t check;
+};
+
+static struct ring ring_test_ring;
+static struct ring_test_element ring_test_buffer[RING_TEST_CAPACITY];
+
+// What each side saw
+struct ring_test_side {
+	uint32_t next;
+	uint32_t dropped;
+	uint32_t errors;
+	uint32_t seed;
+};
+
+/************************************************************************/
+/* @brief ring_test_random is a small xorshift generator, each side has its own
+/* @params[in,out] seed the generator state
+/* @returns the next number
+/************************************************************************/
+static uint32_t ring_test_random(uint32_t * seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return *seed;
+}
+
+/************************************************************************/
+/* @brief ring_test_produce writes a batch of the next values. Only the elements
+/* the ring took are numbered, so the consumer expects every value exactly once
+/* @params[in,out] producer the producer side
+/* @returns none
+/************************************************************************/
+static void ring_test_produce(struct ring_test_side * producer)
+{
+	struct ring_test_element batch[RING_TEST_BATCH];
+	uint16_t count = 1 + ring_test_random(&producer->seed) % RING_TEST_BATCH;
+	uint16_t written;
+	
+	for(uint16_t i = 0; i < count; i++){
+		batch[i].value = producer->next + i;
+		batch[i].check = ~(producer->next + i) & 0xFFFF;
+	}
+	written = ring_write(&ring_test_ring, batch, count);
+	producer->next += written;
+	producer->dropped += count - written;
+}
+
+/************************************************************************/
+/* @brief ring_test_consume reads a batch, with ring_read or with ring_peek and a
+/* partial ring_skip as offload_step does, and checks the values
+/* @params[in,out] consumer the consumer side
+/* @returns none
+/************************************************************************/
+static void ring_test_consume(struct ring_test_side * consumer)
+{
+	struct ring_test_element batch[RING_TEST_BATCH];
+	uint32_t choice = ring_test_random(&consumer->seed);
+	uint16_t count = 1 + choice % RING_TEST_BATCH;
+	
+	if(choice & 0x100){
+		count = ring_read(&ring_test_ring, batch, count);
+	}else{
+		count = ring_peek(&ring_test_ring, batch, count);
+		// Only some of the peeked elements are used, the rest are read again next time
+		if(count) count = 1 + (choice >> 9) % count;
+		ring_skip(&ring_test_ring, count);
+	}
+	for(uint16_t i = 0; i < count; i++){
+		if(batch[i].value != consumer->next || batch[i].check != (~batch[i].value & 0xFFFF)){
+			if(consumer->errors++ < 5) printf("  got %u expected %u\n", (unsigned)batch[i].value, (unsigned)consumer->next);
+		}
+		consumer->next = batch[i].value + 1;
+	}
+}
+
+/************************************************************************/
+/* @brief ring_test_check checks a finished run
+/* @params[in] producer the producer side
+/* @params[in] consumer the consumer side
+/* @returns none
+/************************************************************************/
+static void ring_test_check(struct ring_test_side * producer, struct ring_test_side * consumer)
+{
+	HOST_CHECK_EQUAL(consumer->errors, 0);
+	HOST_CHECK_EQUAL(consumer->next, producer->next);
+	HOST_CHECK_EQUAL(ring_count(&ring_test_ring), 0);
+	HOST_CHECK_EQUAL(ring_test_ring.overruns, producer->dropped & 0xFFFF);
+	HOST_CHECK(producer->dropped > 0);
+	printf("  %u elements through, %u overruns\n", (unsigned)consumer->next, (unsigned)producer->dropped);
+}
+
+/************************************************************************/
+/* @brief ring_test_interleaved runs both sides in one thread, picking which one
+/* steps next at random. The producer gets ahead more often so the ring fills
+/* @params none
+/* @returns none
+/************************************************************************/
+static void ring_test_interleaved(void)
+{
+	struct ring_test_side producer = {.seed = 1}, consumer = {.seed = 2};
+	uint32_t seed = 3;
+	
+	printf("interleaved\n");
+	ring_init(&ring_test_ring, ring_test_buffer, sizeof(struct ring_test_element), RING_TEST_CAPACITY);
+	while(producer.next < RING_TEST_ELEMENTS){
+		if(ring_test_random(&seed) % 5 < 3){
+			ring_test_produce(&producer);
+		}else{
+			ring_test_consume(&consumer);
+		}
+	}
+	while(ring_count(&ring_test_ring)){
+		ring_test_consume(&consumer);
+	}
+	ring_test_check(&producer, &consumer);
+}
+
+static struct ring_test_side ring_test_producer, ring_test_consumer;
+static volatile bool ring_test_done;
+
+static void * ring_test_producer_thread(void * argument)
+{
+	while(ring_test_producer.next < RING_TEST_ELEMENTS){
+		ring_test_produce(&ring_test_producer);
+		if(!(ring_test_random(&ring_test_producer.seed) & 7)) sched_yield();
+	}
+	__DMB();
+	ring_test_done = true;
+	return NULL;
+}
+
+static void * ring_test_consumer_thread(void * argument)
+{
+	for(;;){
+		bool done = ring_test_done;
+		__DMB();
+		if(done && !ring_count(&ring_test_ring)) break;
+		ring_test_consume(&ring_test_consumer);
+		if(!(ring_test_random(&ring_test_consumer.seed) & 7)) sched_yield();
+	}
+	return NULL;
+}
+
+/************************************************************************/
+/* @brief ring_test_threads runs the producer and the consumer in two threads
+/* @params none
+/* @returns none
+/************************************************************************/
+static void ring_test_threads(void)
+{
+	pthread_t producer, consumer;
+	
+	printf("two threads\n");
+	ring_init(&ring_test_ring, ring_test_buffer, sizeof(struct ring_test_element), RING_TEST_CAPACITY);
+	ring_test_producer = (struct ring_test_side){.seed = 4};
+	ring_test_consumer = (struct ring_test_side){.seed = 5};
+	ring_test_done = false;
+	pthread_create(&producer, NULL, ring_test_producer_thread, NULL);
+	pthread_create(&consumer, NULL, ring_test_consumer_thread, NULL);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+	ring_test_check(&ring_test_producer, &ring_test_consumer);
+}
+
+int main(void)
+{
+	ring_test_interleaved();
+	ring_test_threads();
+	return host_result("test_ring");
+}
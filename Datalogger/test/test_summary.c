@@ -0,0 +1,237 @@
+/************************************************************************/
+/* @file test_summary.c
+/* @brief host test of the activity summaries. Traces are fed through summary_add
+/* in watermark sized blocks, the way ADXL375_service does, and every summary is
+/* compared with a double precision reference worked out from the definitions:
+/* the gravity of an axis is the mean over its block, ODBA and VeDBA are the mean
+/* absolute sum and vector length of what is left, and the peak is the largest
+/* magnitude. Then the flash taken by a summary record is compared with the Rice
+/* coded samples of the same epoch, the RECORD_ENCODING_S16X3_RICE records the
+/* summary mode replaces
+/************************************************************************/
+
+#include "HAL.h"
+#include "host.h"
+#include <math.h>
+
+#define SUMMARY_TEST_SAMPLES	1510
+// A block as the watermark drains it
+#define SUMMARY_TEST_BLOCK		ADXL375_FIFO_WATERMARK
+
+// 49 mg per LSB
+#define SUMMARY_TEST_G			20.4
+
+// What the reference works out for one epoch
+struct summary_reference {
+	uint16_t samples;
+	double sums[ACCEL_AXES];
+	double squares[ACCEL_AXES];
+	double odba;
+	double vedba;
+	double peak;
+};
+
+static uint32_t summary_random_state = 2463534242UL;
+
+/************************************************************************/
+/* @brief summary_random gives the next value of a xorshift generator, so every
+/* run sees the same traces
+/* @params none
+/* @returns 32 random bits
+/************************************************************************/
+static uint32_t summary_random(void)
+{
+	summary_random_state ^= summary_random_state << 13;
+	summary_random_state ^= summary_random_state >> 17;
+	summary_random_state ^= summary_random_state << 5;
+	return summary_random_state;
+}
+
+/************************************************************************/
+/* @brief summary_motion fills a trace with gravity on z, a swing on all three axes
+/* and noise on every axis, as bench_codec does
+/* @params[out] trace x, y, z per sample
+/* @params[in] swing the amplitude of the swing in g
+/* @params[in] period the period of the swing in samples
+/* @params[in] noise the noise, +-LSB
+/* @returns none
+/************************************************************************/
+static void summary_motion(int16_t * trace, double swing, double period, uint8_t noise)
+{
+	double phase;
+	
+	for(uint16_t i = 0; i < SUMMARY_TEST_SAMPLES; i++){
+		phase = 2 * M_PI * i / period;
+		trace[i * ACCEL_AXES + 0] = (int16_t)lround(swing * SUMMARY_TEST_G * sin(phase));
+		trace[i * ACCEL_AXES + 1] = (int16_t)lround(swing * SUMMARY_TEST_G * 0.5 * sin(phase + 1));
+		trace[i * ACCEL_AXES + 2] = (int16_t)lround(SUMMARY_TEST_G + swing * SUMMARY_TEST_G * 0.3 * cos(2 * phase));
+		for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+			trace[i * ACCEL_AXES + axis] += (int16_t)(summary_random() % (2 * noise + 1)) - noise;
+		}
+	}
+}
+
+/************************************************************************/
+/* @brief summary_reference_epochs works the epochs of a trace out in double
+/* @params[in] trace x, y, z per sample
+/* @params[out] epochs room for every epoch of the trace
+/* @returns the number of epochs, the last one may be short
+/************************************************************************/
+static uint16_t summary_reference_epochs(const int16_t * trace, struct summary_reference * epochs)
+{
+	struct summary_reference * epoch = epochs;
+	double gravity[ACCEL_AXES], dynamic, absolute, squares, magnitude;
+	uint16_t length;
+	
+	memset(epochs, 0, sizeof(*epochs));
+	for(uint16_t block = 0; block < SUMMARY_TEST_SAMPLES; block += length){
+		length = (SUMMARY_TEST_SAMPLES - block < SUMMARY_TEST_BLOCK) ? SUMMARY_TEST_SAMPLES - block : SUMMARY_TEST_BLOCK;
+		for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+			gravity[axis] = 0;
+			for(uint16_t i = block; i < block + length; i++) gravity[axis] += trace[i * ACCEL_AXES + axis];
+			gravity[axis] /= length;
+		}
+		for(uint16_t i = block; i < block + length; i++){
+			absolute = squares = magnitude = 0;
+			for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+				dynamic = trace[i * ACCEL_AXES + axis] - gravity[axis];
+				absolute += fabs(dynamic);
+				squares += dynamic * dynamic;
+				magnitude += (double)trace[i * ACCEL_AXES + axis] * trace[i * ACCEL_AXES + axis];
+				epoch->sums[axis] += trace[i * ACCEL_AXES + axis];
+				epoch->squares[axis] += (double)trace[i * ACCEL_AXES + axis] * trace[i * ACCEL_AXES + axis];
+			}
+			epoch->odba += absolute;
+			epoch->vedba += sqrt(squares);
+			if(sqrt(magnitude) > epoch->peak) epoch->peak = sqrt(magnitude);
+			if(++epoch->samples == SUMMARY_EPOCH_SAMPLES) memset(++epoch, 0, sizeof(*epoch));
+		}
+	}
+	return (epoch - epochs) + (epoch->samples != 0);
+}
+
+/************************************************************************/
+/* @brief summary_check feeds a trace through summary_add and compares each summary
+/* with the reference. The q15 block means are truncated, which moves ODBA and
+/* VeDBA by less than a count per axis, the roots and means are truncated by less
+/* than one more
+/* @params[in] name the trace
+/* @params[in] trace x, y, z per sample
+/* @returns none
+/************************************************************************/
+static void summary_check(const char * name, const int16_t * trace)
+{
+	static struct summary_reference reference[SUMMARY_TEST_SAMPLES / SUMMARY_EPOCH_SAMPLES + 1];
+	struct accel_summary summary;
+	uint16_t epochs, length, failures = host_failures;
+	double mean, variance, worst[5] = {0};
+	
+	ring_init(&summary_ring, summary_buffer, sizeof(summary_buffer[0]), SUMMARY_RING_SIZE);
+	epochs = summary_reference_epochs(trace, reference);
+	for(uint16_t block = 0, epoch = 0; block < SUMMARY_TEST_SAMPLES || epoch < epochs; block += length){
+		length = (SUMMARY_TEST_SAMPLES - block < SUMMARY_TEST_BLOCK) ? SUMMARY_TEST_SAMPLES - block : SUMMARY_TEST_BLOCK;
+		if(length) summary_add(&trace[block * ACCEL_AXES], length);
+		// Sampling stops at the end of the trace, which closes the short epoch
+		else summary_flush();
+		
+		while(ring_read(&summary_ring, &summary, 1)){
+			HOST_CHECK(epoch < epochs);
+			if(epoch >= epochs) return;
+			HOST_CHECK_EQUAL(summary.samples, reference[epoch].samples);
+			for(uint8_t axis = 0; axis < ACCEL_AXES; axis++){
+				mean = reference[epoch].sums[axis] / reference[epoch].samples;
+				variance = reference[epoch].squares[axis] / reference[epoch].samples - mean * mean;
+				HOST_CHECK(fabs(summary.mean[axis] - mean) < 1);
+				HOST_CHECK(fabs(summary.variance[axis] - variance) <= 1);
+				worst[0] = fmax(worst[0], fabs(summary.mean[axis] - mean));
+				worst[1] = fmax(worst[1], fabs(summary.variance[axis] - variance));
+			}
+			HOST_CHECK(fabs(summary.odba - reference[epoch].odba / reference[epoch].samples) <= ACCEL_AXES + 1);
+			HOST_CHECK(fabs(summary.vedba - reference[epoch].vedba / reference[epoch].samples) <= ACCEL_AXES + 1);
+			HOST_CHECK(fabs(summary.peak - reference[epoch].peak) <= 1);
+			worst[2] = fmax(worst[2], fabs(summary.odba - reference[epoch].odba / reference[epoch].samples));
+			worst[3] = fmax(worst[3], fabs(summary.vedba - reference[epoch].vedba / reference[epoch].samples));
+			worst[4] = fmax(worst[4], fabs(summary.peak - reference[epoch].peak));
+			epoch++;
+		}
+		if(!length && epoch < epochs){
+			HOST_CHECK(!"a summary is missing");
+			break;
+		}
+	}
+	HOST_CHECK_EQUAL(summary_ring.overruns, 0);
+	printf("%-24s %6u %8.2f %8.2f %8.2f %8.2f %8.2f  %s\n", name, epochs, worst[0], worst[1], worst[2], worst[3], worst[4],
+		host_failures == failures ? "ok" : "FAIL");
+}
+
+/************************************************************************/
+/* @brief summary_coded gives the flash the Rice coded samples of a trace take
+/* per sample, records included, cut into records the way offload_step does
+/* @params[in] trace x, y, z per sample
+/* @returns bytes per sample
+/************************************************************************/
+static double summary_coded(const int16_t * trace)
+{
+	static uint8_t payload[RECORD_MAX_PAYLOAD];
+	uint32_t bytes = 0;
+	uint8_t chunk, encoded;
+	
+	for(uint16_t done = 0; done < SUMMARY_TEST_SAMPLES; done += encoded){
+		chunk = (SUMMARY_TEST_SAMPLES - done < ACCEL_CODEC_MAX_SAMPLES) ? SUMMARY_TEST_SAMPLES - done : ACCEL_CODEC_MAX_SAMPLES;
+		bytes += RECORD_HEADER_SIZE + RECORD_TRAILER_SIZE + accel_encode(&trace[done * ACCEL_AXES], chunk, payload, RECORD_MAX_PAYLOAD, &encoded);
+		if(!encoded) break;
+	}
+	return (double)bytes / SUMMARY_TEST_SAMPLES;
+}
+
+/************************************************************************/
+/* @brief summary_ratio prints the flash of the coded samples of an epoch against
+/* its summary record, for 1 s, 10 s and 60 s epochs
+/* @params[in] name the trace
+/* @params[in] trace x, y, z per sample
+/* @returns the ratio at SUMMARY_EPOCH_SAMPLES
+/************************************************************************/
+static double summary_ratio(const char * name, const int16_t * trace)
+{
+	const double record = SUMMARY_PAYLOAD_SIZE + RECORD_HEADER_SIZE + RECORD_TRAILER_SIZE;
+	double coded = summary_coded(trace);
+	
+	printf("%-24s %8.2f %8.0f %8.1fx %8.1fx %8.1fx\n", name, 8 * coded, coded * SUMMARY_EPOCH_SAMPLES,
+		coded * 12 / record, coded * 125 / record, coded * 750 / record);
+	return coded * SUMMARY_EPOCH_SAMPLES / record;
+}
+
+int main(void)
+{
+	static int16_t trace[SUMMARY_TEST_SAMPLES * ACCEL_AXES];
+	static int16_t rest[SUMMARY_TEST_SAMPLES * ACCEL_AXES];
+	double ratio;
+	
+	printf("summaries of %u sample epochs in blocks of %u, largest difference from the double reference\n",
+		SUMMARY_EPOCH_SAMPLES, SUMMARY_TEST_BLOCK);
+	printf("%-24s %6s %8s %8s %8s %8s %8s\n", "trace", "epochs", "mean", "variance", "ODBA", "VeDBA", "peak");
+	
+	summary_motion(rest, 0, 1, 1);
+	summary_check("rest, +-1 LSB noise", rest);
+	summary_motion(trace, 1, 6, 2);
+	summary_check("1 g walking sway", trace);
+	summary_motion(trace, 4, 3, 4);
+	summary_check("4 g running", trace);
+	// Full scale on every axis, the q15 sums and squares must not saturate
+	for(uint16_t i = 0; i < SUMMARY_TEST_SAMPLES * ACCEL_AXES; i++) trace[i] = (int16_t)(summary_random() % 8192) - 4096;
+	summary_check("random 13 bit", trace);
+	
+	printf("\na summary record takes %u bytes, against the Rice coded samples of the epoch\n",
+		SUMMARY_PAYLOAD_SIZE + RECORD_HEADER_SIZE + RECORD_TRAILER_SIZE);
+	printf("%-24s %8s %8s %9s %9s %9s\n", "trace", "bits", "bytes", "1 s", "10 s", "60 s");
+	ratio = summary_ratio("rest, +-1 LSB noise", rest);
+	// Even at rest a 10 s summary takes less than the samples
+	HOST_CHECK(ratio > 1);
+	summary_motion(trace, 1, 6, 2);
+	summary_ratio("1 g walking sway", trace);
+	summary_motion(trace, 4, 3, 4);
+	ratio = summary_ratio("4 g running", trace);
+	HOST_CHECK(ratio > 1);
+	
+	return host_result("test_summary");
+}